@@ -17,13 +17,27 @@
 #include <ui.h>
 #include <common.h>
 
+/*
+按字体文件的扩展名选择字体引擎：tools/mkatlas 生成的 .atlas 图集直接映射，不需要 FreeType 光栅化
+输入参数：字体文件路径
+*/
+static char *fontengine_forfile(char *a_fontfilename)
+{
+    int len = strlen(a_fontfilename);
+
+    if(len > 6 && strcmp(a_fontfilename + len - 6, ".atlas") == 0)
+        return "atlas";
+    return "freetype";
+}
+
 int main(int argc,char **argv)
 {
     int error;
+    int i;
     
-    if(argc !=2)
+    if(argc < 2)
     {
-        printf("usage:%s <font_size>" ,argv[0]);
+        printf("usage:%s <font_file> [fallback_font_file ...]\n" ,argv[0]);
         return -1;
     }
 
@@ -33,7 +47,9 @@ int main(int argc,char **argv)
     selectdefaultdisplay("fb"); // 选择默认显示设备（这里是"fb"，即帧缓冲设备）
     initdefaultdisplay();// 初始化默认显示设备（如打开/dev/fb0）
 
-    //初始化输入系统
+    //初始化输入系统：TOUCH_BACKEND=evdev 时触摸屏不经过 tslib，直接读取 evdev（设备文件同样由 TSLIB_TSDEVICE 指定）
+    if(settouchscreen(getenv("TOUCH_BACKEND"), NULL))
+        return -1;
     input_system_register();//以前是input_init();
 
     input_deviceinit();
@@ -42,12 +58,21 @@ int main(int argc,char **argv)
     font_system_register();//以前为fontsregister();
 
     //选择并初始化字体引擎
-    error = selectandinitfont("freetype", argv[1]);
+    error = selectandinitfont(fontengine_forfile(argv[1]), argv[1]);
     if(error)
     {
         printf("selectandinitfont err\n");
         return -1;
     }
+    //其余参数按顺序作为后备字体（如主字体是拉丁字体时再给一个中文字体），主字体没有的字符从后备字体取
+    for(i = 2; i < argc; i++)
+    {
+        if(addfallbackfont(fontengine_forfile(argv[i]), argv[i]))
+            printf("addfallbackfont %s err\n", argv[i]);
+    }
+    //文字按覆盖度混合（抗锯齿），小字号也清晰；
+    //更在意带宽时可改为 TEXT_MODE_SOLID 加 setfontrendermode(FONT_PIXEL_MODE_MONO)，字形数据减少到 1/8
+    settextmode(TEXT_MODE_BLEND);
 
     //初始化页面系统
     page_system_register();//以前是page_register();
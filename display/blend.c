@@ -0,0 +1,283 @@
+/*
+抗锯齿文字绘制（属于显示管理层的绘制后端）
+freetype 生成的是 8 位灰度覆盖度，以前只按“非 0 即画”处理，小字号在 16 位屏上锯齿明显。
+这里按覆盖度把文字颜色混合到已有背景上：out = (fg * a + bg * (255 - a)) / 255。
+每种像素格式一个行混合函数：RGB565 一次处理 8 个像素，XRGB8888 一次处理 4（SSE2）或 8（NEON）个像素，
+覆盖度全 0 的像素组直接跳过、全 255 的直接写文字颜色，其余平台用 C 实现。
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include <disp_manager.h>
+#include <font_manager.h>
+
+/*
+单个分量混合，除以255用 (t + (t >> 8)) >> 8 近似（t 已加 128，结果与四舍五入一致）
+*/
+static inline unsigned int blend_channel(unsigned int fg, unsigned int bg, unsigned int a)
+{
+    unsigned int t = fg * a + bg * (255 - a) + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+static inline unsigned short blend_pixel16(unsigned short fg, unsigned short bg, unsigned int a)
+{
+    return (blend_channel(fg >> 11, bg >> 11, a) << 11) |
+           (blend_channel((fg >> 5) & 63, (bg >> 5) & 63, a) << 5) |
+            blend_channel(fg & 31, bg & 31, a);
+}
+
+static inline unsigned int blend_pixel32(unsigned int fg, unsigned int bg, unsigned int a)
+{
+    return (blend_channel((fg >> 24) & 0xFF, (bg >> 24) & 0xFF, a) << 24) |
+           (blend_channel((fg >> 16) & 0xFF, (bg >> 16) & 0xFF, a) << 16) |
+           (blend_channel((fg >> 8) & 0xFF, (bg >> 8) & 0xFF, a) << 8) |
+            blend_channel(fg & 0xFF, bg & 0xFF, a);
+}
+
+/*
+判断一组（4 或 8 个）覆盖度是否全为0或全为255
+返回值：0 全透明；1 全覆盖；-1 需要混合
+*/
+static inline int coverage_class(const unsigned char *cov, int n)
+{
+    unsigned long long v8 = 0;
+    unsigned int v4 = 0;
+
+    //按整字读取，避免逐字节比较
+    if(n == 8)
+    {
+        memcpy(&v8, cov, 8);
+        return (v8 == 0) ? 0 : (v8 == ~0ULL ? 1 : -1);
+    }
+    memcpy(&v4, cov, 4);
+    return (v4 == 0) ? 0 : (v4 == ~0U ? 1 : -1);
+}
+
+#if !defined(__SSE2__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+//与 blend_channel 相同的除以255近似：t 加 128 后 (t + (t >> 8)) >> 8
+static inline uint16x8_t div255_u16(uint16x8_t t)
+{
+    t = vaddq_u16(t, vdupq_n_u16(128));
+    return vshrq_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8);
+}
+#endif
+
+/*
+RGB565 行混合
+输入参数：目标行（已偏移到起点），覆盖度，像素个数，文字颜色（RGB565）
+*/
+static void blend_span16(unsigned short *dst, const unsigned char *cov, int n, unsigned short fg)
+{
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i v255 = _mm_set1_epi16(255);
+    const __m128i v128 = _mm_set1_epi16(128);
+    const __m128i m6   = _mm_set1_epi16(63);
+    const __m128i m5   = _mm_set1_epi16(31);
+    const __m128i fr   = _mm_set1_epi16(fg >> 11);
+    const __m128i fgr  = _mm_set1_epi16((fg >> 5) & 63);
+    const __m128i fb   = _mm_set1_epi16(fg & 31);
+    __m128i p, a, ia, r, g, b, t;
+
+    for(; n >= 8; n -= 8, dst += 8, cov += 8)
+    {
+        switch (coverage_class(cov, 8))
+        {
+            case 0:
+                continue;
+            case 1:
+                _mm_storeu_si128((__m128i *)dst, _mm_set1_epi16(fg));
+                continue;
+        }
+        p  = _mm_loadu_si128((const __m128i *)dst);
+        a  = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)cov), zero);
+        ia = _mm_sub_epi16(v255, a);
+
+        r = _mm_srli_epi16(p, 11);
+        g = _mm_and_si128(_mm_srli_epi16(p, 5), m6);
+        b = _mm_and_si128(p, m5);
+
+        t = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(fr, a), _mm_mullo_epi16(r, ia)), v128);
+        r = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        t = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(fgr, a), _mm_mullo_epi16(g, ia)), v128);
+        g = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        t = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(fb, a), _mm_mullo_epi16(b, ia)), v128);
+        b = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+
+        p = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(r, 11), _mm_slli_epi16(g, 5)), b);
+        _mm_storeu_si128((__m128i *)dst, p);
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const uint16x8_t v255 = vdupq_n_u16(255);
+    const uint16x8_t m6   = vdupq_n_u16(63);
+    const uint16x8_t m5   = vdupq_n_u16(31);
+    const uint16x8_t fr   = vdupq_n_u16(fg >> 11);
+    const uint16x8_t fgr  = vdupq_n_u16((fg >> 5) & 63);
+    const uint16x8_t fb   = vdupq_n_u16(fg & 31);
+    uint16x8_t p, a, ia, r, g, b;
+
+    for(; n >= 8; n -= 8, dst += 8, cov += 8)
+    {
+        switch (coverage_class(cov, 8))
+        {
+            case 0:
+                continue;
+            case 1:
+                vst1q_u16(dst, vdupq_n_u16(fg));
+                continue;
+        }
+        p  = vld1q_u16(dst);
+        a  = vmovl_u8(vld1_u8(cov));
+        ia = vsubq_u16(v255, a);
+
+        r = vshrq_n_u16(p, 11);
+        g = vandq_u16(vshrq_n_u16(p, 5), m6);
+        b = vandq_u16(p, m5);
+
+        r = div255_u16(vmlaq_u16(vmulq_u16(fr, a), r, ia));
+        g = div255_u16(vmlaq_u16(vmulq_u16(fgr, a), g, ia));
+        b = div255_u16(vmlaq_u16(vmulq_u16(fb, a), b, ia));
+
+        vst1q_u16(dst, vorrq_u16(vorrq_u16(vshlq_n_u16(r, 11), vshlq_n_u16(g, 5)), b));
+    }
+#endif
+    for(; n > 0; n--, dst++, cov++)
+    {
+        if(*cov == 0)
+            continue;
+        *dst = (*cov == 255) ? fg : blend_pixel16(fg, *dst, *cov);
+    }
+}
+
+/*
+XRGB8888 行混合
+输入参数：目标行（已偏移到起点），覆盖度，像素个数，文字颜色
+*/
+static void blend_span32(unsigned int *dst, const unsigned char *cov, int n, unsigned int fg)
+{
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i v255 = _mm_set1_epi16(255);
+    const __m128i v128 = _mm_set1_epi16(128);
+    const __m128i f16  = _mm_unpacklo_epi8(_mm_set1_epi32((int)fg), zero);// 两个像素的4个分量展开为16位
+    __m128i p, a, lo, hi, alo, ahi, t;
+    int cov4;
+
+    for(; n >= 4; n -= 4, dst += 4, cov += 4)
+    {
+        switch (coverage_class(cov, 4))
+        {
+            case 0:
+                continue;
+            case 1:
+                _mm_storeu_si128((__m128i *)dst, _mm_set1_epi32((int)fg));
+                continue;
+        }
+        memcpy(&cov4, cov, 4);
+        //把每个像素的覆盖度复制到它的4个分量上
+        a = _mm_cvtsi32_si128(cov4);
+        a = _mm_unpacklo_epi8(a, a);
+        a = _mm_unpacklo_epi16(a, a);
+        alo = _mm_unpacklo_epi8(a, zero);
+        ahi = _mm_unpackhi_epi8(a, zero);
+
+        p  = _mm_loadu_si128((const __m128i *)dst);
+        lo = _mm_unpacklo_epi8(p, zero);
+        hi = _mm_unpackhi_epi8(p, zero);
+
+        t  = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(f16, alo), _mm_mullo_epi16(lo, _mm_sub_epi16(v255, alo))), v128);
+        lo = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        t  = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(f16, ahi), _mm_mullo_epi16(hi, _mm_sub_epi16(v255, ahi))), v128);
+        hi = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+
+        _mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(lo, hi));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    uint8x8x4_t px;
+    uint8x8_t a, ia;
+    uint16x8_t t;
+    int i;
+    const uint8x8_t fc[4] = {
+        vdup_n_u8(fg & 0xFF), vdup_n_u8((fg >> 8) & 0xFF),
+        vdup_n_u8((fg >> 16) & 0xFF), vdup_n_u8((fg >> 24) & 0xFF),
+    };
+
+    for(; n >= 8; n -= 8, dst += 8, cov += 8)
+    {
+        switch (coverage_class(cov, 8))
+        {
+            case 0:
+                continue;
+            case 1:
+                vst1q_u32(dst, vdupq_n_u32(fg));
+                vst1q_u32(dst + 4, vdupq_n_u32(fg));
+                continue;
+        }
+        //vld4_u8 把8个像素按分量拆开：val[0]=B, val[1]=G, val[2]=R, val[3]=X
+        px = vld4_u8((const uint8_t *)dst);
+        a  = vld1_u8(cov);
+        ia = vmvn_u8(a);
+        for(i = 0; i < 4; i++)
+        {
+            t = vmlal_u8(vmull_u8(fc[i], a), px.val[i], ia);
+            //vraddhn_u16(t, (t + 128) >> 8) = (t + 128 + ((t + 128) >> 8)) >> 8
+            px.val[i] = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+        }
+        vst4_u8((uint8_t *)dst, px);
+    }
+#endif
+    for(; n > 0; n--, dst++, cov++)
+    {
+        if(*cov == 0)
+            continue;
+        *dst = (*cov == 255) ? fg : blend_pixel32(fg, *dst, *cov);
+    }
+}
+
+/*
+各像素格式的字形混合：灰度位图逐行混合，单色位图没有覆盖度，退回逐段绘制
+输入参数：显示缓冲区指针，位图数据结构体指针，目标区域（已裁剪），原生颜色
+*/
+void glyphblend16(pdispbuff ptdispbuff, p_fontbitmap pt_fontbitmap, p_region pt_region, unsigned int color)
+{
+    int line_width = dispbuff_linebytes(ptdispbuff);
+    int pitch = pt_fontbitmap->i_pitch ? pt_fontbitmap->i_pitch : pt_fontbitmap->t_region.width;
+    unsigned char *src, *row;
+    int y;
+
+    if(pt_fontbitmap->i_pixelmode != FONT_PIXEL_MODE_GRAY)
+    {
+        glyphblit16(ptdispbuff, pt_fontbitmap, pt_region, color);
+        return;
+    }
+    src = pt_fontbitmap->puc_buffer + (pt_region->y - pt_fontbitmap->t_region.y) * pitch + (pt_region->x - pt_fontbitmap->t_region.x);
+    row = (unsigned char *)ptdispbuff->buff + pt_region->y * line_width + pt_region->x * 2;
+    for(y = 0; y < pt_region->height; y++, src += pitch, row += line_width)
+        blend_span16((unsigned short *)row, src, pt_region->width, color);
+}
+
+void glyphblend32(pdispbuff ptdispbuff, p_fontbitmap pt_fontbitmap, p_region pt_region, unsigned int color)
+{
+    int line_width = dispbuff_linebytes(ptdispbuff);
+    int pitch = pt_fontbitmap->i_pitch ? pt_fontbitmap->i_pitch : pt_fontbitmap->t_region.width;
+    unsigned char *src, *row;
+    int y;
+
+    if(pt_fontbitmap->i_pixelmode != FONT_PIXEL_MODE_GRAY)
+    {
+        glyphblit32(ptdispbuff, pt_fontbitmap, pt_region, color);
+        return;
+    }
+    src = pt_fontbitmap->puc_buffer + (pt_region->y - pt_fontbitmap->t_region.y) * pitch + (pt_region->x - pt_fontbitmap->t_region.x);
+    row = (unsigned char *)ptdispbuff->buff + pt_region->y * line_width + pt_region->x * 4;
+    for(y = 0; y < pt_region->height; y++, src += pitch, row += line_width)
+        blend_span32((unsigned int *)row, src, pt_region->width, color);
+}
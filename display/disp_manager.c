@@ -17,6 +17,9 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
 #include <disp_manager.h>
 #include <font_manager.h>
 #include  <common.h>
@@ -24,10 +27,27 @@
 /*管理底层的LCD、WEB*/
 static pdispopr g_dispdevs = NULL;// 显示设备链表头指针（管理所有注册的显示设备）
 static pdispopr g_dispdefault = NULL;// 默认选中的显示设备（上层实际使用的设备）
-static dispbuff g_tdispbuff;// 全局显示缓冲区（存储屏幕像素数据）
-static int line_width; // 屏幕每行的字节数
+static dispbuff g_tdispbuff;// 全局显示缓冲区（系统内存中的后台缓冲区，所有绘制都写到这里）
+static dispbuff g_tdevbuff;// 设备缓冲区（底层设备 getbuffer 得到的帧缓冲内存，只在刷新时写入）
+static int line_width; // 后台缓冲区每行的字节数
 static int pixel_width; // 每个像素的字节数（如32位像素为4字节）
 
+//像素格式操作表：initdefaultdisplay 时按设备的像素格式选定一次
+#ifdef DISP_FIXED_PIXFMT
+#define PIXOPR ((p_pixelopr)&g_at_pixelopr[DISP_FIXED_PIXFMT])
+#else
+static p_pixelopr g_ptpixopr = NULL;
+#define PIXOPR g_ptpixopr
+#endif
+
+//脏矩形链表：记录自上次刷新以来被修改过的区域，相互重叠或相邻的区域会被合并
+#define DIRTY_REGION_MAX 16
+static region g_atdirtyregions[DIRTY_REGION_MAX];
+static int g_idirtycnt = 0;
+static dispstat g_tdispstat;// 刷新统计
+static int g_itextmode = TEXT_MODE_SOLID;// 文字绘制模式
+static long long g_llastframe_us = 0;// 上一帧刷新的时间
+
 
 /*
 @1 显示系统注册（注册framebuffer）
@@ -39,6 +59,9 @@ void display_system_register(void)
 {
     extern void framebuffer_register(void);
     framebuffer_register();      
+
+    extern void memdisplay_register(void);
+    memdisplay_register();//无头显示设备，没有 /dev/fb0 时用于测试和性能分析
 }
 // @1.3  把底层实现的结构体放入链表
 //也就把底层构造的framebuffer操作接口地址赋值给显示设备链表头指针g_dispdevs
@@ -87,15 +110,47 @@ int initdefaultdisplay(void)
         printf("Failed to init device\n");
         return -1;
     }
-    ret = g_dispdefault->getbuffer(&g_tdispbuff); 
+    ret = g_dispdefault->getbuffer(&g_tdevbuff); 
     if(ret)
     {
         printf("Failed to get buffer\n");
         return -1;
     }
 
-    line_width = g_tdispbuff.ixres * g_tdispbuff.ibpp / 8;
-    pixel_width = g_tdispbuff.ibpp / 8;
+    //选择像素格式操作表，之后的绘制不再判断 bpp
+#ifdef DISP_FIXED_PIXFMT
+    if(getpixelopr(&g_tdevbuff) != PIXOPR)
+    {
+        printf("Display format does not match DISP_FIXED_PIXFMT\n");
+        return -1;
+    }
+#else
+    g_ptpixopr = getpixelopr(&g_tdevbuff);
+    if(!g_ptpixopr)
+        return -1;
+#endif
+
+    line_width = g_tdevbuff.ixres * g_tdevbuff.ibpp / 8;
+    pixel_width = g_tdevbuff.ibpp / 8;
+
+    //在系统内存中分配后台缓冲区，绘制不再直接写无缓存的显存，避免用户看到画了一半的按钮
+    //后台缓冲区每行紧密排列，设备的行字节数（可能有填充）只在刷新时使用
+    g_tdispbuff = g_tdevbuff;
+    g_tdispbuff.iline_bytes = line_width;
+    g_tdispbuff.ipixfmt = PIXOPR->ipixfmt;
+    g_tdispbuff.buff = malloc(line_width * g_tdevbuff.iyres);
+    if(!g_tdispbuff.buff)
+    {
+        printf("Failed to alloc back buffer\n");
+        return -1;
+    }
+    //以设备当前内容作为初始画面
+    for(ret = 0; ret < g_tdevbuff.iyres; ret++)
+        memcpy(g_tdispbuff.buff + ret * line_width, g_tdevbuff.buff + ret * dispbuff_linebytes(&g_tdevbuff), line_width);
+    ret = 0;
+
+    g_idirtycnt = 0;
+    memset(&g_tdispstat, 0, sizeof(g_tdispstat));
     return 0;
 }
 
@@ -106,7 +161,7 @@ int initdefaultdisplay(void)
 获取显示缓冲区
 输出参数：显示缓冲区指针
 */ 
-int getdisplaybuffer(void)
+pdispbuff getdisplaybuffer(void)
 {
     return &g_tdispbuff;
 }
@@ -119,76 +174,78 @@ int getdisplaybuffer(void)
 */ 
 int putpixel(int x, int y, unsigned int dwcolor)
 {
-    // 根据输入的的（x，y）计算(x,y)坐标在缓冲区中的内存地址（起始地址 + 行偏移 + 列偏移）
-    unsigned char *pen_8 = (unsigned char *)g_tdispbuff.buff + y * line_width + x * pixel_width;  //8位像素指针
-    unsigned short *pen_16 ;
-    unsigned int *pen_32;
-
-    unsigned int red,green,blue;
-    pen_16 = (unsigned short *)pen_8;// 16位像素指针
-    pen_32 = (unsigned int *)pen_8;// 32位像素指针
+    region t_region = {x, y, 1, 1};
 
-    switch (g_tdispbuff.ibpp)
+    if(displist_recording())
     {
-        case 8:
-        {
-            *pen_8 = dwcolor;
-            break;
-        }
-        case 16:
-        {
-            red = (dwcolor >> 16) & 0xFF;
-            green = (dwcolor >> 8) & 0xFF;
-            blue = (dwcolor >> 0) & 0xFF;
-            dwcolor = ((red >> 3) << 11) | ((green >> 2) << 5) | (blue >> 3);
-            *pen_16 = dwcolor;  
-            break;
-        }
-        case 32:
-        {
-            *pen_32 = dwcolor;
-            break;
-        }
-        default:
-        {
-            printf("Unsupported pixel format: %d bits per pixel\n", g_tdispbuff.ibpp);
-            return -1;
-            break;
-        }
+        //记录成 1x1 的填充，保证与其他命令的先后顺序
+        displist_addfill(&t_region, PIXOPR->mapcolor(dwcolor));
+        return 0;
     }
+    PIXOPR->put(&g_tdispbuff, x, y, PIXOPR->mapcolor(dwcolor));
     return 0;
 }
 
+/*
+@5
+把 0xRRGGBB 颜色转换为显示设备的原生像素格式
+需要逐像素绘制的调用者先转换一次，再通过 getdisplaypixelopr 得到的操作表直接绘制
+*/
+unsigned int mapdisplaycolor(unsigned int dwcolor)
+{
+    return PIXOPR->mapcolor(dwcolor);
+}
+
+/*
+@5
+获得显示设备的像素格式操作表（initdefaultdisplay 之后有效）
+*/
+p_pixelopr getdisplaypixelopr(void)
+{
+    return PIXOPR;
+}
+
 /*
 @5 
 绘制字符，到位图缓冲区
 输入参数：位图数据结构体指针，颜色
 */ 
 
+static void draw_glyph(p_fontbitmap pt_fontbitmap, p_region pt_clip, unsigned int color, p_region pt_drawn)
+{
+    //一次性裁剪到屏幕和裁剪区域，再交给当前像素格式的字形函数：按连续像素段写入或按覆盖度混合
+    if(!clip_region(&g_tdispbuff, &pt_fontbitmap->t_region, pt_clip, pt_drawn))
+        return;
+    if(displist_recording())
+        displist_addglyph(pt_fontbitmap, pt_drawn, color, g_itextmode == TEXT_MODE_BLEND);
+    else if(g_itextmode == TEXT_MODE_BLEND)
+        PIXOPR->glyphblend(&g_tdispbuff, pt_fontbitmap, pt_drawn, color);
+    else
+        PIXOPR->glyphblit(&g_tdispbuff, pt_fontbitmap, pt_drawn, color);
+}
+
 void drawfontbitmap(p_fontbitmap pt_fontbitmap,unsigned int dwcolor)
 {
-    int i,j,p,q;
-    // 获取字符绘制的区域坐标（左上角x,y）和区域范围（x_max,y_max）
-    int x = pt_fontbitmap->t_region.x;
-    int y = pt_fontbitmap->t_region.y;
-    int x_max = x + pt_fontbitmap->t_region.width;
-    int y_max = y + pt_fontbitmap->t_region.height;
-    int width = pt_fontbitmap->t_region.width;
-    unsigned char *buffer = pt_fontbitmap->puc_buffer;
-
-    //遍历字符区域的每个像素，根据位图数据绘制
-    for(j = y,q = 0;j < y_max;j++,q++)
-    {
-        for(i = x,p = 0;i < x_max;i++,p++)
-        {
-            if(i < 0    || j < 0  ||
-                i >=g_tdispbuff.ixres || j >= g_tdispbuff.iyres)
-            continue;
+    region t_drawn;
 
-            if(buffer[q*width + p])
-                putpixel(i,j,dwcolor);
-        }
-    }
+    draw_glyph(pt_fontbitmap, NULL, PIXOPR->mapcolor(dwcolor), &t_drawn);
+    add_dirtyregion(&t_drawn);
+}
+
+/*
+@5
+设置文字绘制模式
+TEXT_MODE_BLEND 需要 8 位灰度覆盖度，所以同时把字体位图切换为灰度
+输入参数：TEXT_MODE_SOLID 或 TEXT_MODE_BLEND
+*/
+int settextmode(int i_textmode)
+{
+    if(i_textmode != TEXT_MODE_SOLID && i_textmode != TEXT_MODE_BLEND)
+        return -1;
+    if(i_textmode == TEXT_MODE_BLEND && setfontrendermode(FONT_PIXEL_MODE_GRAY))
+        return -1;
+    g_itextmode = i_textmode;
+    return 0;
 }
 
 /*
@@ -198,67 +255,251 @@ void drawfontbitmap(p_fontbitmap pt_fontbitmap,unsigned int dwcolor)
 */
 void draw_region(p_region pt_region,unsigned int dwcolor)
 {
-    int x = pt_region->x;
-    int y = pt_region->y;
-    int width = pt_region->width;
-    int height = pt_region->height;
-    int i, j;
-    for (j = y; j < y + height; j++)
-    {
-        for (i = x; i < x + width; i++)
-        {
-            putpixel(i, j, dwcolor);
-        }
-    }
+    region t_clipped;
+
+    //交给填充引擎：裁剪一次、颜色转换一次、按整行填充
+    if(!clip_region(&g_tdispbuff, pt_region, NULL, &t_clipped))
+        return;
+    if(displist_recording())
+        displist_addfill(&t_clipped, PIXOPR->mapcolor(dwcolor));
+    else
+        PIXOPR->fillrect(&g_tdispbuff, &t_clipped, PIXOPR->mapcolor(dwcolor));
+    add_dirtyregion(&t_clipped);
+}
+
+/*
+@5
+把同格式的像素块（如预先渲染好的图标）拷贝到显示区域
+输入参数：绘制区域指针，区域左上角对应的源像素，源每行的字节数
+*/
+void draw_pixels(p_region pt_region, unsigned char *src, int src_pitch)
+{
+    region t_clipped;
+
+    if(!clip_region(&g_tdispbuff, pt_region, NULL, &t_clipped))
+        return;
+    //源指针移到裁剪后的左上角
+    src += (t_clipped.y - pt_region->y) * src_pitch + (t_clipped.x - pt_region->x) * pixel_width;
+    if(displist_recording())
+        displist_addblit(&t_clipped, src, src_pitch);
+    else
+        PIXOPR->blitcopy(&g_tdispbuff, &t_clipped, src, src_pitch);
+    add_dirtyregion(&t_clipped);
 }
 
 /*
 @5 
 绘制字符在区域中央
-输入参数：字符（字符串指针），绘制区域指针，颜色
+字符串按 UTF-8 解码，排版结果（每个字符的位置和整行外框）由字体管理层缓存，同一个标签再次绘制时直接按缓存的位置取字形
+输入参数：字符（UTF-8 字符串指针），绘制区域指针，颜色
 */
 void drawtext_inregioncentral(char *name, p_region pt_region, unsigned int dwcolor)
 {
     fontbitmap t_fontbitmap; // 字符位图结构体（存储单个字符的位图信息）
-    region_cartesian t_regioncar;//显示区域结构体（笛卡尔坐标系）
+    p_textrun pt_run;        // 排好版的一行文字
 
     int i_originx,i_originy;
-    int i = 0;
+    int i;
     int error;
+    unsigned int color = PIXOPR->mapcolor(dwcolor);// 颜色只转换一次
+    region t_drawn;
 
-    //计算字符串的外框
-    getstring_regioncar(name,&t_regioncar);
+    //排版结果在本线程下一次 gettextrun 之前、字形位图在下一次 getfontbitmap 之前有效，其他线程同时取字形不影响
+    //排版：解码、求每个字符的位置和字符串的外框（缓存命中时只是查表）
+    pt_run = gettextrun(name);
+    if(!pt_run)
+    {
+        printf("gettextrun err\n");
+        return;
+    }
 
-    i_originx = pt_region->x + (pt_region->width - t_regioncar.width) / 2 - t_regioncar.x;
-    i_originy = pt_region->y + (pt_region->height - t_regioncar.height) / 2 + t_regioncar.y;
+    i_originx = pt_region->x + (pt_region->width - pt_run->t_extent.width) / 2 - pt_run->t_extent.x;
+    i_originy = pt_region->y + (pt_region->height - pt_run->t_extent.height) / 2 + pt_run->t_extent.y;
 
     //逐个绘制
-    while(name[i])
+    for(i = 0; i < pt_run->i_count; i++)
     {
-        // 1. 设置当前字符的绘制基点（起始坐标）
-        t_fontbitmap.i_cur_originx = i_originx;
+        // 1. 当前字符的绘制基点 = 行首基点 + 排版好的偏移
+        t_fontbitmap.i_cur_originx = i_originx + pt_run->at_glyphs[i].i_x;
         t_fontbitmap.i_cur_originy = i_originy;
-        // 2. 获取当前字符的位图信息，存放在t_fontbitmap（函数内部会自动计算下一个基点并写入i_next_originx/y）
-        error = getfontbitmap(name[i],&t_fontbitmap);
+        // 2. 获取当前字符的位图信息，存放在t_fontbitmap（字形缓存命中时不经过字体引擎）
+        error = getfontbitmap(pt_run->at_glyphs[i].dwcode,&t_fontbitmap);
         if(error)
         {
-            printf("selectandinitfont err\n");
-            return -1;
+            printf("getfontbitmap err\n");
+            return;
+        }
+        // 3. 绘制字符到缓冲区，字形裁剪到按钮区域内，不会画到相邻按钮上
+        draw_glyph(&t_fontbitmap, pt_region, color, &t_drawn);
+    }
+    add_dirtyregion(pt_region);
+}
+
+/*
+判断两个区域是否重叠或相邻（相邻的区域合并后不会多刷像素）
+输入参数：两个区域指针
+*/
+static int is_region_touched(p_region pt_a, p_region pt_b)
+{
+    return pt_a->x <= pt_b->x + pt_b->width  && pt_b->x <= pt_a->x + pt_a->width &&
+           pt_a->y <= pt_b->y + pt_b->height && pt_b->y <= pt_a->y + pt_a->height;
+}
+
+/*
+求两个区域的外接矩形，结果存放在pt_a中
+输入参数：两个区域指针
+*/
+static void union_region(p_region pt_a, p_region pt_b)
+{
+    int x_max = pt_a->x + pt_a->width;
+    int y_max = pt_a->y + pt_a->height;
+
+    if(pt_b->x + pt_b->width > x_max)
+        x_max = pt_b->x + pt_b->width;
+    if(pt_b->y + pt_b->height > y_max)
+        y_max = pt_b->y + pt_b->height;
+    if(pt_b->x < pt_a->x)
+        pt_a->x = pt_b->x;
+    if(pt_b->y < pt_a->y)
+        pt_a->y = pt_b->y;
+    pt_a->width  = x_max - pt_a->x;
+    pt_a->height = y_max - pt_a->y;
+}
+
+/*
+@6
+把区域加入脏矩形链表
+区域先被裁剪到屏幕范围内，再与已有的重叠/相邻区域合并；
+链表满时合并到外接矩形面积增加最少的那个区域
+输入参数：显示区域指针
+*/
+void add_dirtyregion(p_region ptregion)
+{
+    region t_region;
+    int i, best, area, best_area;
+    region t_union;
+
+    if(!ptregion)
+        return;
+
+    //裁剪到屏幕范围
+    t_region = *ptregion;
+    if(t_region.x < 0)
+    {
+        t_region.width += t_region.x;
+        t_region.x = 0;
+    }
+    if(t_region.y < 0)
+    {
+        t_region.height += t_region.y;
+        t_region.y = 0;
+    }
+    if(t_region.x + t_region.width > g_tdispbuff.ixres)
+        t_region.width = g_tdispbuff.ixres - t_region.x;
+    if(t_region.y + t_region.height > g_tdispbuff.iyres)
+        t_region.height = g_tdispbuff.iyres - t_region.y;
+    if(t_region.width <= 0 || t_region.height <= 0)
+        return;
+
+    //与已有区域合并，合并后的区域可能又和别的区域重叠，所以要重新扫描
+    i = 0;
+    while(i < g_idirtycnt)
+    {
+        if(is_region_touched(&g_atdirtyregions[i], &t_region))
+        {
+            union_region(&t_region, &g_atdirtyregions[i]);
+            g_atdirtyregions[i] = g_atdirtyregions[--g_idirtycnt];
+            i = 0;
+            continue;
         }
-        // 3. 绘制字符到位图缓冲区
-        drawfontbitmap(&t_fontbitmap,dwcolor);
-        
-        i_originx = t_fontbitmap.i_next_originx;
-        i_originy = t_fontbitmap.i_next_originy;
         i++;
     }
+
+    if(g_idirtycnt < DIRTY_REGION_MAX)
+    {
+        g_atdirtyregions[g_idirtycnt++] = t_region;
+        return;
+    }
+
+    //链表已满：选择合并代价最小的区域
+    best = 0;
+    best_area = -1;
+    for(i = 0; i < g_idirtycnt; i++)
+    {
+        t_union = g_atdirtyregions[i];
+        union_region(&t_union, &t_region);
+        area = t_union.width * t_union.height;
+        if(best_area < 0 || area < best_area)
+        {
+            best_area = area;
+            best = i;
+        }
+    }
+    union_region(&g_atdirtyregions[best], &t_region);
+}
+
+//当前时间，微秒
+static long long get_time_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
 }
 
 /*
 @6  把绘制好的区域刷到硬件上
-输入参数：显示区域指针，显示缓冲区指针
+ptregion 先加入脏矩形链表，然后把合并后的所有脏矩形按整行从 ptdispbuff 拷贝到设备，
+最后调用设备的 presentframe 结束这一帧（如双缓冲翻页）
+输入参数：显示区域指针（可为NULL，只刷已记录的脏矩形），
+        显示缓冲区指针（NULL 表示 getdisplaybuffer 的后台缓冲区；其他缓冲区的分辨率和像素格式必须与它相同）
 */
 int flushdisplayregion(p_region ptregion, pdispbuff ptdispbuff)
 {
-    return g_dispdefault->flushregion(ptregion, ptdispbuff);
+    int i;
+    int ret = 0;
+    unsigned long bytes = 0;
+    long long start_us;
+
+    if(!ptdispbuff)
+        ptdispbuff = &g_tdispbuff;
+    //脏矩形按屏幕裁剪，来源缓冲区的尺寸或格式不同时会越界
+    if(ptdispbuff->ixres != g_tdispbuff.ixres || ptdispbuff->iyres != g_tdispbuff.iyres
+       || ptdispbuff->ibpp != g_tdispbuff.ibpp || ptdispbuff->ipixfmt != g_tdispbuff.ipixfmt)
+        return -1;
+
+    add_dirtyregion(ptregion);
+    //正在记录显示列表：脏矩形已记下，等 displist_end 回放后统一刷新
+    if(displist_deferflush())
+        return 0;
+    start_us = get_time_us();
+
+    for(i = 0; i < g_idirtycnt; i++)
+    {
+        if(g_dispdefault->flushregion(&g_atdirtyregions[i], ptdispbuff))
+            ret = -1;
+        bytes += (unsigned long)g_atdirtyregions[i].width * pixel_width * g_atdirtyregions[i].height;
+    }
+    if(g_dispdefault->presentframe && g_dispdefault->presentframe(ptdispbuff))
+        ret = -1;
+
+    g_tdispstat.frames++;
+    g_tdispstat.regions_lastframe = g_idirtycnt;
+    g_tdispstat.bytes_lastframe   = bytes;
+    g_tdispstat.bytes_total      += bytes;
+    g_tdispstat.update_us_lastframe = get_time_us() - start_us;
+    if(g_llastframe_us)
+        g_tdispstat.interval_us_lastframe = start_us - g_llastframe_us;
+    g_llastframe_us = start_us;
+    g_idirtycnt = 0;
+    return ret;
+}
+
+/*
+@7 获取刷新统计
+输入参数：统计结构体指针
+*/
+int getdisplaystat(pdispstat ptdispstat)
+{
+    *ptdispstat = g_tdispstat;
+    return 0;
 }
@@ -0,0 +1,483 @@
+/*
+显示列表（属于显示管理层）
+按钮的绘制过程是 draw_region → drawtext_inregioncentral → flushdisplayregion，每一步都立即写后台缓冲区并刷新，
+底色在文字下面被写两遍、一次只能刷一个按钮，也没有机会调整顺序。
+displist_begin 之后，draw_region / drawtext_inregioncentral / drawfontbitmap / draw_pixels 不再立即绘制，
+而是记录成填充、字形、像素块三种命令（字形位图拷贝到 arena 中），flushdisplayregion 只记录脏矩形；
+displist_end 时：
+1. 被之后的不透明命令（填充、像素块）完全覆盖的命令直接丢弃；
+2. 命令按目标区域的起始行分桶（计数排序）；
+3. 按 DISPLIST_BAND_HEIGHT 行一个条带回放，每个条带内按记录顺序执行与之相交的命令，
+   底色和压在上面的文字在同一条带里先后写入，第二遍写时这些行还在缓存中；
+4. 全部回放完再统一刷新一次。
+整页重绘时条带交给 tilerender.c 的线程池并行回放，每个线程只写自己领到的条带。
+begin/end 可以嵌套，只有最外层的 end 回放，所以按钮的 on_draw 在整页重绘时也只刷新一次。
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <disp_manager.h>
+
+#define DISPLIST_BAND_HEIGHT 16 // 回放条带的行数：1024 宽、32 位时一个条带 64KB，回放期间能留在 L2 中
+#define DISPLIST_TILE_BANDS  4  // 并行回放时每个线程一次领取的条带数
+#define DISPLIST_PARALLEL_PIXELS (256 * 1024) // 命令覆盖的像素达到这个数才并行回放（大约半个 1024x600 屏幕）
+
+//命令类型
+#define DL_CMD_FILL  0 // 填充矩形
+#define DL_CMD_GLYPH 1 // 字形（覆盖度非0即画或按覆盖度混合）
+#define DL_CMD_BLIT  2 // 拷贝同格式的像素块
+
+/*
+显示列表命令
+t_region 是已经裁剪到屏幕和裁剪区域的目标区域，color 是已经转换好的原生颜色
+*/
+typedef struct dlcmd{
+    int itype;
+    int iculled;                // 被之后的不透明命令完全覆盖，不再回放
+    region t_region;            // 目标区域（已裁剪）
+    unsigned int color;         // 原生颜色
+    int iblend;                 // 字形：1 按覆盖度混合，0 覆盖度非0即画
+    fontbitmap t_bitmap;        // 字形：位图信息，puc_buffer 在回放时才指向 arena
+    unsigned long ioffset;      // 字形位图/像素块在 arena 中的偏移
+    int ipitch;                 // 像素块每行的字节数
+    int iband_first;            // 回放时：第一个和最后一个条带
+    int iband_last;
+}dlcmd,*p_dlcmd;
+
+static int g_idepth = 0;                // begin/end 嵌套深度，大于0表示正在记录
+static int g_iflushpending = 0;         // 记录期间有人调用过 flushdisplayregion
+static p_dlcmd g_ptcmds = NULL;         // 命令数组
+static int g_icmdcnt = 0;
+static int g_icmdmax = 0;
+static unsigned char *g_pucarena = NULL;// 字形位图、像素块的拷贝
+static unsigned long g_iarenaused = 0;
+static unsigned long g_iarenasize = 0;
+static int g_iculled = 0;               // 当前帧被丢弃的命令数
+static displiststat g_tdlstat;          // 统计
+
+//当前时间，微秒
+static long long dl_time_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+//区域 pt_in 是否完全在区域 pt_out 内
+static int region_contains(p_region pt_out, p_region pt_in)
+{
+    return pt_in->x >= pt_out->x && pt_in->y >= pt_out->y &&
+           pt_in->x + pt_in->width  <= pt_out->x + pt_out->width &&
+           pt_in->y + pt_in->height <= pt_out->y + pt_out->height;
+}
+
+/*
+执行一条命令，只画与 pt_clip 相交的部分
+输入参数：命令指针，条带区域
+*/
+static void dl_execute(p_dlcmd pt_cmd, p_region pt_clip)
+{
+    pdispbuff ptdispbuff = getdisplaybuffer();
+    p_pixelopr pt_pixopr = getdisplaypixelopr();
+    region t_region;
+    unsigned char *src;
+
+    if(!clip_region(ptdispbuff, &pt_cmd->t_region, pt_clip, &t_region))
+        return;
+
+    switch (pt_cmd->itype)
+    {
+        case DL_CMD_FILL:
+            pt_pixopr->fillrect(ptdispbuff, &t_region, pt_cmd->color);
+            break;
+        case DL_CMD_GLYPH:
+            if(pt_cmd->iblend)
+                pt_pixopr->glyphblend(ptdispbuff, &pt_cmd->t_bitmap, &t_region, pt_cmd->color);
+            else
+                pt_pixopr->glyphblit(ptdispbuff, &pt_cmd->t_bitmap, &t_region, pt_cmd->color);
+            break;
+        case DL_CMD_BLIT:
+            src = g_pucarena + pt_cmd->ioffset + (t_region.y - pt_cmd->t_region.y) * pt_cmd->ipitch +
+                  (t_region.x - pt_cmd->t_region.x) * (ptdispbuff->ibpp / 8);
+            pt_pixopr->blitcopy(ptdispbuff, &t_region, src, pt_cmd->ipitch);
+            break;
+    }
+}
+
+//一次回放中各条带共用的分桶结果，回放期间只读
+typedef struct dlreplay{
+    int *pi_bucketstart;        // 各条带开始的命令在 pi_sorted 中的起点
+    int *pi_sorted;             // 按起始条带排序的命令下标
+    unsigned long ipixels;      // 所有命令覆盖的像素数，用来判断值不值得并行
+}dlreplay,*p_dlreplay;
+
+/*
+回放 [b_begin, b_end) 条带，可以在多个线程中同时调用（条带互不重叠）
+逐条带维护“活动命令”表（按记录顺序），每个条带只执行与它相交的命令，结果只写这些条带的行
+输入参数：第一个条带，最后一个条带之后，分桶结果
+*/
+static void dl_replay_tile(int b_begin, int b_end, void *p_arg)
+{
+    p_dlreplay pt_replay = (p_dlreplay)p_arg;
+    pdispbuff ptdispbuff = getdisplaybuffer();
+    int *pi_active;
+    int i, b, n, nactive, pos, k;
+    region t_band;
+
+    t_band.x = 0;
+    t_band.width = ptdispbuff->ixres;
+
+    pi_active = malloc(g_icmdcnt * sizeof(int));
+    if(!pi_active)
+    {
+        //内存不足：按记录顺序执行，裁剪到这几个条带
+        t_band.y = b_begin * DISPLIST_BAND_HEIGHT;
+        t_band.height = (b_end - b_begin) * DISPLIST_BAND_HEIGHT;
+        for(i = 0; i < g_icmdcnt; i++)
+        {
+            if(!g_ptcmds[i].iculled)
+                dl_execute(&g_ptcmds[i], &t_band);
+        }
+        return;
+    }
+
+    //在 b_begin 之前开始、延续到 b_begin 的命令，按记录顺序放入活动表
+    nactive = 0;
+    for(i = 0; i < g_icmdcnt; i++)
+    {
+        if(!g_ptcmds[i].iculled && g_ptcmds[i].iband_first < b_begin && g_ptcmds[i].iband_last >= b_begin)
+            pi_active[nactive++] = i;
+    }
+
+    for(b = b_begin; b < b_end; b++)
+    {
+        //把本条带开始的命令合并进活动表，两边都是按记录顺序排好的
+        n = pt_replay->pi_bucketstart[b + 1] - pt_replay->pi_bucketstart[b];
+        if(n)
+        {
+            pos = nactive + n;
+            i = nactive - 1;
+            k = pt_replay->pi_bucketstart[b + 1] - 1;
+            while(k >= pt_replay->pi_bucketstart[b])
+            {
+                if(i >= 0 && pi_active[i] > pt_replay->pi_sorted[k])
+                    pi_active[--pos] = pi_active[i--];
+                else
+                    pi_active[--pos] = pt_replay->pi_sorted[k--];
+            }
+            nactive += n;
+        }
+        if(nactive == 0)
+            continue;
+
+        t_band.y = b * DISPLIST_BAND_HEIGHT;
+        t_band.height = DISPLIST_BAND_HEIGHT;
+        for(i = 0; i < nactive; i++)
+            dl_execute(&g_ptcmds[pi_active[i]], &t_band);
+
+        //去掉在本条带结束的命令
+        for(i = 0, k = 0; i < nactive; i++)
+        {
+            if(g_ptcmds[pi_active[i]].iband_last > b)
+                pi_active[k++] = pi_active[i];
+        }
+        nactive = k;
+    }
+    free(pi_active);
+}
+
+/*
+回放所有记录的命令并清空列表
+命令先按起始条带分桶；覆盖的像素足够多时（整页重绘）条带分给 tilerender 的线程池并行回放，
+否则（单个按钮）在当前线程中回放，省掉唤醒线程的开销
+*/
+static void dl_replay(void)
+{
+    pdispbuff ptdispbuff = getdisplaybuffer();
+    int nbands = (ptdispbuff->iyres + DISPLIST_BAND_HEIGHT - 1) / DISPLIST_BAND_HEIGHT;
+    dlreplay t_replay;
+    int i, b;
+    int ithreads = 1;
+    p_dlcmd pt_cmd;
+    long long start_us = dl_time_us();
+
+    if(g_icmdcnt == 0)
+        return;
+
+    t_replay.pi_bucketstart = calloc(nbands + 1, sizeof(int));
+    t_replay.pi_sorted = malloc(g_icmdcnt * sizeof(int));
+    t_replay.ipixels = 0;
+    if(!t_replay.pi_bucketstart || !t_replay.pi_sorted)
+    {
+        //内存不足：按记录顺序整条执行
+        for(i = 0; i < g_icmdcnt; i++)
+        {
+            g_ptcmds[i].t_bitmap.puc_buffer = g_pucarena + g_ptcmds[i].ioffset;
+            if(!g_ptcmds[i].iculled)
+                dl_execute(&g_ptcmds[i], NULL);
+        }
+        goto out;
+    }
+
+    //1. 计数排序：按起始条带分桶，同一桶内保持记录顺序
+    for(i = 0; i < g_icmdcnt; i++)
+    {
+        pt_cmd = &g_ptcmds[i];
+        if(pt_cmd->iculled)
+            continue;
+        pt_cmd->t_bitmap.puc_buffer = g_pucarena + pt_cmd->ioffset;// arena 在记录期间可能被 realloc，这时才确定地址
+        pt_cmd->iband_first = pt_cmd->t_region.y / DISPLIST_BAND_HEIGHT;
+        pt_cmd->iband_last  = (pt_cmd->t_region.y + pt_cmd->t_region.height - 1) / DISPLIST_BAND_HEIGHT;
+        t_replay.pi_bucketstart[pt_cmd->iband_first + 1]++;
+        t_replay.ipixels += (unsigned long)pt_cmd->t_region.width * pt_cmd->t_region.height;
+    }
+    for(b = 0; b < nbands; b++)
+        t_replay.pi_bucketstart[b + 1] += t_replay.pi_bucketstart[b];
+    for(i = 0; i < g_icmdcnt; i++)
+    {
+        if(!g_ptcmds[i].iculled)
+            t_replay.pi_sorted[t_replay.pi_bucketstart[g_ptcmds[i].iband_first]++] = i;
+    }
+    //还原各桶的起点
+    for(b = nbands; b > 0; b--)
+        t_replay.pi_bucketstart[b] = t_replay.pi_bucketstart[b - 1];
+    t_replay.pi_bucketstart[0] = 0;
+
+    //2. 逐条带回放
+    if(t_replay.ipixels >= DISPLIST_PARALLEL_PIXELS)
+        ithreads = tilerender_run(nbands, DISPLIST_TILE_BANDS, dl_replay_tile, &t_replay);
+    else
+        dl_replay_tile(0, nbands, &t_replay);
+
+out:
+    free(t_replay.pi_bucketstart);
+    free(t_replay.pi_sorted);
+
+    g_tdlstat.frames++;
+    g_tdlstat.cmds_lastframe   = g_icmdcnt;
+    g_tdlstat.culled_lastframe = g_iculled;
+    g_tdlstat.arena_bytes_lastframe = g_iarenaused;
+    g_tdlstat.replay_us_lastframe = dl_time_us() - start_us;
+    g_tdlstat.threads_lastframe = ithreads;
+    g_tdlstat.cmds_total   += g_icmdcnt;
+    g_tdlstat.culled_total += g_iculled;
+
+    g_icmdcnt = 0;
+    g_iarenaused = 0;
+    g_iculled = 0;
+}
+
+/*
+在命令数组末尾取一条新命令，空间不够时扩大一倍
+返回值：命令指针，内存不足时返回 NULL
+*/
+static p_dlcmd dl_newcmd(void)
+{
+    p_dlcmd pt_cmds;
+    int imax;
+
+    if(g_icmdcnt == g_icmdmax)
+    {
+        imax = g_icmdmax ? g_icmdmax * 2 : 64;
+        pt_cmds = realloc(g_ptcmds, imax * sizeof(dlcmd));
+        if(!pt_cmds)
+            return NULL;
+        g_ptcmds = pt_cmds;
+        g_icmdmax = imax;
+    }
+    memset(&g_ptcmds[g_icmdcnt], 0, sizeof(dlcmd));
+    return &g_ptcmds[g_icmdcnt++];
+}
+
+/*
+在 arena 中分配 isize 字节（按8字节对齐），空间不够时扩大一倍
+输出参数：pi_offset 返回偏移（arena 可能被 realloc，只能保存偏移）
+返回值：0 成功；-1 内存不足
+*/
+static int dl_alloc(unsigned long isize, unsigned long *pi_offset)
+{
+    unsigned char *puc_arena;
+    unsigned long inew;
+
+    isize = (isize + 7) & ~7UL;
+    if(g_iarenaused + isize > g_iarenasize)
+    {
+        inew = g_iarenasize ? g_iarenasize : 16 * 1024;
+        while(g_iarenaused + isize > inew)
+            inew *= 2;
+        puc_arena = realloc(g_pucarena, inew);
+        if(!puc_arena)
+            return -1;
+        g_pucarena = puc_arena;
+        g_iarenasize = inew;
+    }
+    *pi_offset = g_iarenaused;
+    g_iarenaused += isize;
+    return 0;
+}
+
+/*
+新加入不透明命令后，丢弃被它完全覆盖的旧命令
+输入参数：新命令的区域
+*/
+static void dl_cull(p_region pt_region)
+{
+    int i;
+
+    for(i = 0; i < g_icmdcnt - 1; i++)
+    {
+        if(!g_ptcmds[i].iculled && region_contains(pt_region, &g_ptcmds[i].t_region))
+        {
+            g_ptcmds[i].iculled = 1;
+            g_iculled++;
+        }
+    }
+}
+
+/*
+开始记录一帧，可以嵌套
+*/
+int displist_begin(void)
+{
+    g_idepth++;
+    return 0;
+}
+
+/*
+结束记录：最外层的 end 回放所有命令，记录期间请求过刷新时统一刷新一次
+*/
+int displist_end(void)
+{
+    if(g_idepth <= 0)
+        return -1;
+    if(--g_idepth > 0)
+        return 0;
+
+    dl_replay();
+    if(g_iflushpending)
+    {
+        g_iflushpending = 0;
+        return flushdisplayregion(NULL, getdisplaybuffer());
+    }
+    return 0;
+}
+
+/*
+是否正在记录
+*/
+int displist_recording(void)
+{
+    return g_idepth > 0;
+}
+
+/*
+记录期间的刷新请求：只记下来，由 displist_end 统一刷新
+返回值：1 已推迟；0 没有在记录，调用者应立即刷新
+*/
+int displist_deferflush(void)
+{
+    if(g_idepth <= 0)
+        return 0;
+    g_iflushpending = 1;
+    return 1;
+}
+
+/*
+记录填充命令
+输入参数：目标区域（已裁剪），原生颜色
+*/
+void displist_addfill(p_region pt_region, unsigned int color)
+{
+    p_dlcmd pt_cmd = dl_newcmd();
+
+    if(!pt_cmd)
+    {
+        //内存不足：先回放已记录的命令，保证绘制顺序，再直接画
+        dl_replay();
+        getdisplaypixelopr()->fillrect(getdisplaybuffer(), pt_region, color);
+        return;
+    }
+    pt_cmd->itype = DL_CMD_FILL;
+    pt_cmd->t_region = *pt_region;
+    pt_cmd->color = color;
+    dl_cull(pt_region);
+}
+
+/*
+记录字形命令，字形位图拷贝到 arena（字体模块的位图缓冲区在取下一个字时会被覆盖）
+输入参数：位图数据结构体指针，目标区域（已裁剪），原生颜色，是否按覆盖度混合
+*/
+void displist_addglyph(p_fontbitmap pt_fontbitmap, p_region pt_region, unsigned int color, int iblend)
+{
+    p_dlcmd pt_cmd;
+    int pitch = pt_fontbitmap->i_pitch;
+    unsigned long isize, ioffset;
+
+    if(pitch == 0 && pt_fontbitmap->i_pixelmode == FONT_PIXEL_MODE_GRAY)
+        pitch = pt_fontbitmap->t_region.width;
+    isize = (unsigned long)pitch * pt_fontbitmap->t_region.height;
+
+    pt_cmd = dl_newcmd();
+    if(!pt_cmd || dl_alloc(isize, &ioffset))
+    {
+        if(pt_cmd)
+            g_icmdcnt--;
+        dl_replay();
+        if(iblend)
+            getdisplaypixelopr()->glyphblend(getdisplaybuffer(), pt_fontbitmap, pt_region, color);
+        else
+            getdisplaypixelopr()->glyphblit(getdisplaybuffer(), pt_fontbitmap, pt_region, color);
+        return;
+    }
+    memcpy(g_pucarena + ioffset, pt_fontbitmap->puc_buffer, isize);
+    pt_cmd->itype = DL_CMD_GLYPH;
+    pt_cmd->t_region = *pt_region;
+    pt_cmd->color = color;
+    pt_cmd->iblend = iblend;
+    pt_cmd->t_bitmap = *pt_fontbitmap;
+    pt_cmd->t_bitmap.i_pitch = pitch;
+    pt_cmd->t_bitmap.puc_buffer = NULL;
+    pt_cmd->ioffset = ioffset;
+}
+
+/*
+记录像素块命令，像素拷贝到 arena
+输入参数：目标区域（已裁剪），区域左上角对应的源像素，源每行字节数
+*/
+void displist_addblit(p_region pt_region, unsigned char *src, int src_pitch)
+{
+    p_dlcmd pt_cmd;
+    int row_bytes = pt_region->width * (getdisplaybuffer()->ibpp / 8);
+    unsigned long ioffset;
+    int y;
+
+    pt_cmd = dl_newcmd();
+    if(!pt_cmd || dl_alloc((unsigned long)row_bytes * pt_region->height, &ioffset))
+    {
+        if(pt_cmd)
+            g_icmdcnt--;
+        dl_replay();
+        getdisplaypixelopr()->blitcopy(getdisplaybuffer(), pt_region, src, src_pitch);
+        return;
+    }
+    for(y = 0; y < pt_region->height; y++)
+        memcpy(g_pucarena + ioffset + y * row_bytes, src + y * src_pitch, row_bytes);
+    pt_cmd->itype = DL_CMD_BLIT;
+    pt_cmd->t_region = *pt_region;
+    pt_cmd->ioffset = ioffset;
+    pt_cmd->ipitch = row_bytes;
+    dl_cull(pt_region);
+}
+
+/*
+获取显示列表统计
+输入参数：统计结构体指针
+*/
+int getdispliststat(pdispliststat ptdispliststat)
+{
+    *ptdispliststat = g_tdlstat;
+    return 0;
+}
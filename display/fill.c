@@ -0,0 +1,210 @@
+/*
+矩形填充引擎，属于显示管理层的绘制后端
+draw_region 以前对每个像素调用一次 putpixel，每次都要重新计算地址、走一遍 bpp 的 switch、重新做 RGB565 转换。
+这里把矩形先裁剪一次、颜色转换一次，然后按整行调用各像素格式的行填充函数（经 pixfmt.c 的操作表选择）：
+8 位直接 memset；16/32 位在 x86 上用 SSE2、在 ARM 上用 NEON 一次写 16 字节，其余平台用可移植的 C 实现。
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include <disp_manager.h>
+
+/*
+16位行填充
+输入参数：行首地址，像素颜色（已转换为RGB565），像素个数
+*/
+static void fill_span16(unsigned short *dst, unsigned short color, int n)
+{
+#if defined(__SSE2__)
+    __m128i v = _mm_set1_epi16((short)color);
+    //先逐个写到16字节对齐，再每次写8个像素
+    while(n > 0 && ((unsigned long)dst & 15))
+    {
+        *dst++ = color;
+        n--;
+    }
+    while(n >= 16)
+    {
+        _mm_store_si128((__m128i *)dst, v);
+        _mm_store_si128((__m128i *)(dst + 8), v);
+        dst += 16;
+        n -= 16;
+    }
+    if(n >= 8)
+    {
+        _mm_store_si128((__m128i *)dst, v);
+        dst += 8;
+        n -= 8;
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    uint16x8_t v = vdupq_n_u16(color);
+    while(n >= 16)
+    {
+        vst1q_u16(dst, v);
+        vst1q_u16(dst + 8, v);
+        dst += 16;
+        n -= 16;
+    }
+    if(n >= 8)
+    {
+        vst1q_u16(dst, v);
+        dst += 8;
+        n -= 8;
+    }
+#else
+    //可移植实现：两个像素拼成一个32位字写入（用 memcpy 而不是经 unsigned int* 写，不违反严格别名规则，编译器仍生成一条32位存储）
+    unsigned int pair = ((unsigned int)color << 16) | color;
+    if(n > 0 && ((unsigned long)dst & 3))
+    {
+        *dst++ = color;
+        n--;
+    }
+    while(n >= 2)
+    {
+        memcpy(dst, &pair, sizeof(pair));
+        dst += 2;
+        n -= 2;
+    }
+#endif
+    while(n-- > 0)
+        *dst++ = color;
+}
+
+/*
+32位行填充
+输入参数：行首地址，像素颜色，像素个数
+*/
+static void fill_span32(unsigned int *dst, unsigned int color, int n)
+{
+#if defined(__SSE2__)
+    __m128i v = _mm_set1_epi32((int)color);
+    while(n > 0 && ((unsigned long)dst & 15))
+    {
+        *dst++ = color;
+        n--;
+    }
+    while(n >= 8)
+    {
+        _mm_store_si128((__m128i *)dst, v);
+        _mm_store_si128((__m128i *)(dst + 4), v);
+        dst += 8;
+        n -= 8;
+    }
+    if(n >= 4)
+    {
+        _mm_store_si128((__m128i *)dst, v);
+        dst += 4;
+        n -= 4;
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    uint32x4_t v = vdupq_n_u32(color);
+    while(n >= 8)
+    {
+        vst1q_u32(dst, v);
+        vst1q_u32(dst + 4, v);
+        dst += 8;
+        n -= 8;
+    }
+    if(n >= 4)
+    {
+        vst1q_u32(dst, v);
+        dst += 4;
+        n -= 4;
+    }
+#endif
+    while(n-- > 0)
+        *dst++ = color;
+}
+
+/*
+各像素格式的画点、水平线、矩形填充
+颜色是原生格式，区域已经裁剪好
+*/
+void put8(pdispbuff ptdispbuff, int x, int y, unsigned int color)
+{
+    *((unsigned char *)ptdispbuff->buff + y * dispbuff_linebytes(ptdispbuff) + x) = color;
+}
+
+void put16(pdispbuff ptdispbuff, int x, int y, unsigned int color)
+{
+    *((unsigned short *)(ptdispbuff->buff + y * dispbuff_linebytes(ptdispbuff)) + x) = color;
+}
+
+void put32(pdispbuff ptdispbuff, int x, int y, unsigned int color)
+{
+    *((unsigned int *)(ptdispbuff->buff + y * dispbuff_linebytes(ptdispbuff)) + x) = color;
+}
+
+void hline8(pdispbuff ptdispbuff, int x, int y, int n, unsigned int color)
+{
+    memset(ptdispbuff->buff + y * dispbuff_linebytes(ptdispbuff) + x, color, n);
+}
+
+void hline16(pdispbuff ptdispbuff, int x, int y, int n, unsigned int color)
+{
+    fill_span16((unsigned short *)(ptdispbuff->buff + y * dispbuff_linebytes(ptdispbuff)) + x, color, n);
+}
+
+void hline32(pdispbuff ptdispbuff, int x, int y, int n, unsigned int color)
+{
+    fill_span32((unsigned int *)(ptdispbuff->buff + y * dispbuff_linebytes(ptdispbuff)) + x, color, n);
+}
+
+void fillrect8(pdispbuff ptdispbuff, p_region pt_region, unsigned int color)
+{
+    int line_width = dispbuff_linebytes(ptdispbuff);
+    unsigned char *row = (unsigned char *)ptdispbuff->buff + pt_region->y * line_width + pt_region->x;
+    int y;
+
+    //整行宽度的矩形在内存中是连续的，一次 memset 即可
+    if(pt_region->width == line_width)
+    {
+        memset(row, color, pt_region->width * pt_region->height);
+        return;
+    }
+    for(y = 0; y < pt_region->height; y++, row += line_width)
+        memset(row, color, pt_region->width);
+}
+
+void fillrect16(pdispbuff ptdispbuff, p_region pt_region, unsigned int color)
+{
+    int line_width = dispbuff_linebytes(ptdispbuff);
+    unsigned char *row = (unsigned char *)ptdispbuff->buff + pt_region->y * line_width + pt_region->x * 2;
+    int y;
+
+    for(y = 0; y < pt_region->height; y++, row += line_width)
+        fill_span16((unsigned short *)row, color, pt_region->width);
+}
+
+void fillrect32(pdispbuff ptdispbuff, p_region pt_region, unsigned int color)
+{
+    int line_width = dispbuff_linebytes(ptdispbuff);
+    unsigned char *row = (unsigned char *)ptdispbuff->buff + pt_region->y * line_width + pt_region->x * 4;
+    int y;
+
+    for(y = 0; y < pt_region->height; y++, row += line_width)
+        fill_span32((unsigned int *)row, color, pt_region->width);
+}
+
+/*
+拷贝同格式的像素块，每行一次 memcpy（所有像素格式共用）
+输入参数：目标缓冲区，目标区域（已裁剪），源像素块首地址，源每行字节数
+*/
+void blitcopy_rows(pdispbuff ptdispbuff, p_region pt_region, unsigned char *src, int src_pitch)
+{
+    int line_width = dispbuff_linebytes(ptdispbuff);
+    int pixel_width = ptdispbuff->ibpp / 8;
+    int row_bytes = pt_region->width * pixel_width;
+    unsigned char *dst = (unsigned char *)ptdispbuff->buff + pt_region->y * line_width + pt_region->x * pixel_width;
+    int y;
+
+    for(y = 0; y < pt_region->height; y++, src += src_pitch, dst += line_width)
+        memcpy(dst, src, row_bytes);
+}
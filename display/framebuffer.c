@@ -28,11 +28,27 @@ static int fd_fb;                           // 帧缓冲设备文件描述符（
 定义在 <linux/fb.h> 中
 */
 static struct fb_var_screeninfo var ;       // 屏幕可变信息（分辨率、像素格式等）
+static struct fb_fix_screeninfo fix ;       // 屏幕固定信息（每行字节数 line_length 等）
 static int screen_size;                     // 屏幕缓冲区总大小（字节）
 static unsigned char *fb_base;              // 映射到用户空间的帧缓冲内存首地址
-static unsigned int line_width;             // 屏幕每行的字节数
+static int g_imapsize;                      // 映射的长度（字节）；翻页失败退回单页后仍按它解除映射
+static unsigned int line_width;             // 屏幕每行的字节数（驱动的 fix.line_length，可能带填充）
 static unsigned int pixel_width;            // 每个像素的字节数（如32位像素为4字节）
 
+//双缓冲翻页：虚拟分辨率能放下两屏时，绘制到隐藏页，再用 FBIOPAN_DISPLAY 切换显示页
+#define FB_WAIT_FOR_VSYNC 1                 // 翻页前是否用 FBIO_WAITFORVSYNC 等待垂直同步（驱动不支持时自动忽略）
+#define FB_FRAME_REGION_MAX 16              // 每帧记录的刷新区域个数，超出时合并为外接矩形
+static int g_ipages = 1;                    // 页数：1 表示不翻页，直接写显示页；2 表示双缓冲
+static int g_ibackpage = 0;                 // 当前隐藏页（绘制目标）的序号
+static int g_iwaitvsync = FB_WAIT_FOR_VSYNC;
+//隐藏页比显示页旧一帧：上一帧刷到另一页的区域，这一帧也要拷贝到隐藏页，两页才能保持一致
+static region g_atprevregions[FB_FRAME_REGION_MAX];
+static int g_iprevcnt = 0;
+static region g_atcurregions[FB_FRAME_REGION_MAX];
+static int g_icurcnt = 0;
+
+
+static int fbdetectpages(void);
 
 /*
 设备初始化
@@ -58,31 +74,117 @@ static int fbdeviceinit(void)
         return -1;
     }
 
-    // 3. 计算屏幕缓冲区总大小（y 方向分辨率 × x 方向分辨率 × 每个像素位数 ÷ 8 转换为字节）
-    screen_size = var.yres * var.xres * var.bits_per_pixel / 8;
-    // 4. 内存映射：将帧缓冲设备内存映射到用户空间，PROT_READ|PROT_WRITE 表示可读写，MAP_SHARED 表示共享映射
-    fb_base = (unsigned char*)mmap(NULL, screen_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_fb, 0);
-    line_width = var.xres * var.bits_per_pixel / 8;
+    // 3. 判断虚拟分辨率能否放下两页，放不下时尝试向驱动申请
+    g_ipages = fbdetectpages();
+
+    // 4. 获取屏幕固定信息，每行字节数以驱动的 line_length 为准（有的驱动每行末尾有填充）
+    if (ioctl(fd_fb, FBIOGET_FSCREENINFO, &fix) || fix.line_length == 0)
+        fix.line_length = var.xres * var.bits_per_pixel / 8;
+    line_width = fix.line_length;
     pixel_width = var.bits_per_pixel / 8;
-    // 7. 映射失败判断（mmap 返回 (void*)-1 表示失败）
+    // 计算一页屏幕缓冲区的大小（y 方向分辨率 × 每行字节数）
+    screen_size = var.yres * line_width;
+
+    // 5. 内存映射：将帧缓冲设备内存映射到用户空间，PROT_READ|PROT_WRITE 表示可读写，MAP_SHARED 表示共享映射
+    fb_base = (unsigned char*)mmap(NULL, screen_size * g_ipages, PROT_READ | PROT_WRITE, MAP_SHARED, fd_fb, 0);
+    if(fb_base == (unsigned char *) -1 && g_ipages > 1)
+    {
+        //两页映射失败，退回单页
+        g_ipages = 1;
+        fb_base = (unsigned char*)mmap(NULL, screen_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_fb, 0);
+    }
+    g_imapsize = screen_size * g_ipages;
+    // 6. 映射失败判断（mmap 返回 (void*)-1 表示失败）
     if(fb_base == (unsigned char *) -1)
     {
         printf("can't mmap\n");
         return -1;
     }
+
+    // 7. 双缓冲：当前显示页由 yoffset 决定，另一页作为隐藏页，先让两页内容一致
+    if(g_ipages > 1)
+    {
+        g_ibackpage = (var.yoffset >= var.yres) ? 0 : 1;
+        memcpy(fb_base + g_ibackpage * screen_size, fb_base + (1 - g_ibackpage) * screen_size, screen_size);
+    }
+    else
+    {
+        g_ibackpage = 0;
+    }
+    g_iprevcnt = g_icurcnt = 0;
     return 0;
 }
 
+/*
+判断能否双缓冲
+虚拟分辨率的高度至少是两屏时可以翻页；不够时用 FBIOPUT_VSCREENINFO 申请，驱动拒绝则只用一页
+返回值：页数（1 或 2）
+*/
+static int fbdetectpages(void)
+{
+    struct fb_var_screeninfo t_var;
+
+    if(var.yres_virtual >= 2 * var.yres && var.xres_virtual == var.xres)
+        return 2;
+
+    t_var = var;
+    t_var.xres_virtual = var.xres;
+    t_var.yres_virtual = 2 * var.yres;
+    t_var.yoffset = 0;
+    if(ioctl(fd_fb, FBIOPUT_VSCREENINFO, &t_var) == 0 &&
+       ioctl(fd_fb, FBIOGET_VSCREENINFO, &t_var) == 0 &&
+       t_var.yres_virtual >= 2 * var.yres && t_var.xres_virtual == var.xres &&
+       t_var.xres == var.xres && t_var.yres == var.yres && t_var.bits_per_pixel == var.bits_per_pixel)
+    {
+        var = t_var;
+        return 2;
+    }
+    printf("fb: yres_virtual %d, no page flipping\n", var.yres_virtual);
+    return 1;
+}
+
 /*
 设备退出清理
 */
 static int fbdeviceexit(void)
 {
-    munmap(fb_base, screen_size);// 解除内存映射，释放用户空间映射的帧缓冲内存
+    //翻页时退出前切回第0页，避免其他程序看到的是隐藏页
+    if(g_ipages > 1 && var.yoffset != 0)
+    {
+        memcpy(fb_base, fb_base + var.yoffset / var.yres * screen_size, screen_size);
+        var.yoffset = 0;
+        ioctl(fd_fb, FBIOPAN_DISPLAY, &var);
+    }
+    munmap(fb_base, g_imapsize);// 解除内存映射，释放用户空间映射的帧缓冲内存
     close(fd_fb);// 关闭帧缓冲设备文件描述符
     return 0;
 }
 
+/*
+根据 var 中红/蓝分量的位置判断像素格式
+*/
+static int fbgetpixfmt(void)
+{
+    switch (var.bits_per_pixel)
+    {
+        case 8:
+            return PIXFMT_8;
+        case 16:
+            if(var.red.offset == 11)
+                return PIXFMT_RGB565;
+            if(var.blue.offset == 11)
+                return PIXFMT_BGR565;
+            break;
+        case 32:
+            if(var.red.offset == 16)
+                return PIXFMT_XRGB8888;
+            if(var.red.offset == 0)
+                return PIXFMT_XBGR8888;
+            break;
+    }
+    return PIXFMT_UNKNOWN;// 由上层按 bpp 取默认格式
+}
+
 /*
 将屏幕X和Y方向分辨率（像素），每个像素的位数,映射到用户空间的帧缓冲内存首地址存入显示缓冲区结构体指针中
 输入参数：显示缓冲区结构体指针
@@ -92,19 +194,112 @@ static int fbgetbuffer(pdispbuff ptdispbuff)
     ptdispbuff->ixres = var.xres;
     ptdispbuff->iyres = var.yres;
     ptdispbuff->ibpp  = var.bits_per_pixel;
-    ptdispbuff->buff  = fb_base;
+    ptdispbuff->buff  = (char *)fb_base + (g_ipages > 1 ? (1 - g_ibackpage) : 0) * screen_size;// 当前显示页
+    ptdispbuff->iline_bytes = line_width;
+    ptdispbuff->ipixfmt = fbgetpixfmt();
     return 0;
 
 }
 
 
 /*
-刷新区域和要刷新的内容（未实现）
-输入参数：显示区域结构体指针，缓冲区结构体指针
-flushregion 可能啥都不做（因为内存映射后写缓冲区直接显示）
+把后台缓冲区中的一个区域逐行拷贝到指定页，每行一次 memcpy
+输入参数：显示区域结构体指针（已被裁剪到屏幕范围内），后台缓冲区结构体指针，页序号
+*/
+static void fbcopyregion(p_region ptregion, pdispbuff ptdispbuff, int ipage)
+{
+    int y;
+    int src_line_width = dispbuff_linebytes(ptdispbuff);
+    int row_bytes = ptregion->width * pixel_width;
+    unsigned char *src = (unsigned char *)ptdispbuff->buff + ptregion->y * src_line_width + ptregion->x * pixel_width;
+    unsigned char *dst = fb_base + ipage * screen_size + ptregion->y * line_width + ptregion->x * pixel_width;
+
+    for(y = 0; y < ptregion->height; y++)
+    {
+        memcpy(dst, src, row_bytes);
+        src += src_line_width;
+        dst += line_width;
+    }
+}
+
+/*
+刷新区域
+单页时直接拷贝到显示页；双缓冲时拷贝到隐藏页并记录下来，翻页由 fbpresentframe 完成
+输入参数：显示区域结构体指针（已被裁剪到屏幕范围内），后台缓冲区结构体指针
 */
 static int fbflushregion(p_region ptregion, pdispbuff ptdispbuff)
 { 
+    region *pt_last;
+    int x_max, y_max;
+
+    fbcopyregion(ptregion, ptdispbuff, g_ibackpage);
+    if(g_ipages == 1)
+        return 0;
+
+    if(g_icurcnt < FB_FRAME_REGION_MAX)
+    {
+        g_atcurregions[g_icurcnt++] = *ptregion;
+        return 0;
+    }
+    //记录满了：合并到最后一个区域的外接矩形
+    pt_last = &g_atcurregions[FB_FRAME_REGION_MAX - 1];
+    x_max = pt_last->x + pt_last->width;
+    y_max = pt_last->y + pt_last->height;
+    if(ptregion->x + ptregion->width > x_max)
+        x_max = ptregion->x + ptregion->width;
+    if(ptregion->y + ptregion->height > y_max)
+        y_max = ptregion->y + ptregion->height;
+    if(ptregion->x < pt_last->x)
+        pt_last->x = ptregion->x;
+    if(ptregion->y < pt_last->y)
+        pt_last->y = ptregion->y;
+    pt_last->width  = x_max - pt_last->x;
+    pt_last->height = y_max - pt_last->y;
+    return 0;
+}
+
+/*
+结束一帧：翻页
+先把上一帧刷到另一页的区域补到隐藏页（两页同步），再等待垂直同步并用 FBIOPAN_DISPLAY 显示隐藏页。
+驱动不支持翻页时退回单页模式：把这一帧补到第0页并一直显示第0页。
+输入参数：后台缓冲区结构体指针
+*/
+static int fbpresentframe(pdispbuff ptdispbuff)
+{
+    int i;
+    int dummy = 0;
+    region t_full;
+
+    if(g_ipages == 1 || g_icurcnt == 0)
+        return 0;
+
+    for(i = 0; i < g_iprevcnt; i++)
+        fbcopyregion(&g_atprevregions[i], ptdispbuff, g_ibackpage);
+
+    if(g_iwaitvsync && ioctl(fd_fb, FBIO_WAITFORVSYNC, &dummy))
+        g_iwaitvsync = 0;// 驱动不支持，以后不再等待
+
+    var.xoffset = 0;
+    var.yoffset = g_ibackpage * var.yres;
+    if(ioctl(fd_fb, FBIOPAN_DISPLAY, &var))
+    {
+        printf("fb: FBIOPAN_DISPLAY failed, no page flipping\n");
+        g_ipages = 1;
+        var.yoffset = 0;
+        ioctl(fd_fb, FBIOPAN_DISPLAY, &var);
+        g_ibackpage = 0;
+        t_full.x = t_full.y = 0;
+        t_full.width  = var.xres;
+        t_full.height = var.yres;
+        fbcopyregion(&t_full, ptdispbuff, 0);
+        g_iprevcnt = g_icurcnt = 0;
+        return -1;
+    }
+
+    g_ibackpage = 1 - g_ibackpage;
+    memcpy(g_atprevregions, g_atcurregions, g_icurcnt * sizeof(region));
+    g_iprevcnt = g_icurcnt;
+    g_icurcnt = 0;
     return 0;
 }
 
@@ -118,6 +313,7 @@ static dispopr g_tframebufferopr = {
     .deviceexit = fbdeviceexit,
     .getbuffer = fbgetbuffer,
     .flushregion = fbflushregion,
+    .presentframe = fbpresentframe,
 };
 
 //  @1.2 // 将帧缓冲设备接口注册到管理器   
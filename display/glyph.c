@@ -0,0 +1,130 @@
+/*
+字形位图绘制（属于显示管理层的绘制后端）
+drawfontbitmap 以前在内层循环里对每个像素判断是否超出屏幕再调用 putpixel。
+这里先把字形矩形与屏幕、裁剪区域各求一次交集，然后逐行找出连续的“有像素”段，直接写入目标行。
+支持两种字形位图：8 位灰度（覆盖度非 0 即画）和 1 位单色（FT_LOAD_TARGET_MONO，高位在前）。
+*/
+
+#include <stdio.h>
+
+#include <disp_manager.h>
+#include <font_manager.h>
+
+/*
+把一段连续像素写成同一颜色
+输入参数：行首地址，段起点（像素），段长度，像素字节数，已转换的颜色
+pixel_width 在各格式的包装函数里是常量，编译器会把 switch 去掉
+*/
+static inline void put_run(unsigned char *row, int x, int n, int pixel_width, unsigned int color)
+{
+    switch (pixel_width)
+    {
+        case 1:
+        {
+            unsigned char *p = row + x;
+            while(n-- > 0)
+                *p++ = color;
+            break;
+        }
+        case 2:
+        {
+            unsigned short *p = (unsigned short *)row + x;
+            while(n-- > 0)
+                *p++ = color;
+            break;
+        }
+        case 4:
+        {
+            unsigned int *p = (unsigned int *)row + x;
+            while(n-- > 0)
+                *p++ = color;
+            break;
+        }
+    }
+}
+
+/*
+字形绘制的公共部分：逐行找出连续的有像素段
+输入参数：显示缓冲区指针，位图数据结构体指针，目标区域（已裁剪），原生颜色，像素字节数
+*/
+static inline void glyphblit_rows(pdispbuff ptdispbuff, p_fontbitmap pt_fontbitmap, p_region pt_region,
+                                  unsigned int color, int pixel_width)
+{
+    int x0 = pt_fontbitmap->t_region.x;
+    int y0 = pt_fontbitmap->t_region.y;
+    int y = pt_region->y;
+    int y_max = pt_region->y + pt_region->height;
+    int line_width = dispbuff_linebytes(ptdispbuff);
+    int pitch = pt_fontbitmap->i_pitch;
+    int p, p_begin, p_end, start;
+    unsigned char *src, *row;
+
+    //旧的字体模块没有填 i_pitch，灰度位图按宽度计算
+    if(pitch == 0 && pt_fontbitmap->i_pixelmode == FONT_PIXEL_MODE_GRAY)
+        pitch = pt_fontbitmap->t_region.width;
+
+    src = pt_fontbitmap->puc_buffer + (y - y0) * pitch;
+    row = (unsigned char *)ptdispbuff->buff + y * line_width;
+    p_begin = pt_region->x - x0;
+    p_end = p_begin + pt_region->width;
+
+    for(; y < y_max; y++, src += pitch, row += line_width)
+    {
+        p = p_begin;
+        if(pt_fontbitmap->i_pixelmode == FONT_PIXEL_MODE_MONO)
+        {
+            while(p < p_end)
+            {
+                //整字节为0时一次跳过8个像素
+                if(!(p & 7) && src[p >> 3] == 0)
+                {
+                    p += 8;
+                    continue;
+                }
+                if(!(src[p >> 3] & (0x80 >> (p & 7))))
+                {
+                    p++;
+                    continue;
+                }
+                start = p;
+                while(p < p_end && (src[p >> 3] & (0x80 >> (p & 7))))
+                    p++;
+                put_run(row, x0 + start, p - start, pixel_width, color);
+            }
+        }
+        else
+        {
+            while(p < p_end)
+            {
+                if(!src[p])
+                {
+                    p++;
+                    continue;
+                }
+                start = p;
+                while(p < p_end && src[p])
+                    p++;
+                put_run(row, x0 + start, p - start, pixel_width, color);
+            }
+        }
+    }
+}
+
+/*
+各像素格式的字形绘制
+输入参数：显示缓冲区指针，位图数据结构体指针，目标区域（已裁剪），原生颜色
+*/
+void glyphblit8(pdispbuff ptdispbuff, p_fontbitmap pt_fontbitmap, p_region pt_region, unsigned int color)
+{
+    glyphblit_rows(ptdispbuff, pt_fontbitmap, pt_region, color, 1);
+}
+
+void glyphblit16(pdispbuff ptdispbuff, p_fontbitmap pt_fontbitmap, p_region pt_region, unsigned int color)
+{
+    glyphblit_rows(ptdispbuff, pt_fontbitmap, pt_region, color, 2);
+}
+
+void glyphblit32(pdispbuff ptdispbuff, p_fontbitmap pt_fontbitmap, p_region pt_region, unsigned int color)
+{
+    glyphblit_rows(ptdispbuff, pt_fontbitmap, pt_region, color, 4);
+}
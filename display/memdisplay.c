@@ -0,0 +1,255 @@
+/*
+无头显示设备（headless），属于底层驱动/硬件抽象层，与 framebuffer.c 并列
+没有 /dev/fb0 的编译服务器上也要能跑绘制流程和性能测试，所以提供一个名为 "mem" 的 dispopr：
+“显存”是一块 memfd 共享内存，分辨率和 bpp 可以在初始化前用 memdisplay_setmode 配置；
+共享内存开头是 memdisp_header，外部查看程序通过 /proc/<pid>/fd/<fd> 只读映射同一块内存，
+根据 frame_seq 的变化取新帧；也可以用 memdisplay_dumpppm 把当前画面保存为 PPM 图片。
+*/
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <disp_manager.h>
+
+#define MEMDISP_DEFAULT_XRES 1024
+#define MEMDISP_DEFAULT_YRES 600
+#define MEMDISP_DEFAULT_BPP  16
+
+static int g_ixres = MEMDISP_DEFAULT_XRES;
+static int g_iyres = MEMDISP_DEFAULT_YRES;
+static int g_ibpp  = MEMDISP_DEFAULT_BPP;
+
+static int g_ifd = -1;                      // 共享内存文件描述符
+static int g_imapsize;                      // 映射总大小（头 + 像素）
+static unsigned char *g_pucmem;             // 映射首地址
+static p_memdisp_header g_ptheader;         // 共享内存头
+static unsigned char *g_pucpixels;          // 像素区首地址
+static unsigned int line_width;             // 每行的字节数
+static unsigned int pixel_width;            // 每个像素的字节数
+
+/*
+设置无头显示设备的分辨率和像素位数，必须在 initdefaultdisplay 之前调用
+输入参数：X 分辨率，Y 分辨率，每个像素的位数（8/16/32）
+*/
+int memdisplay_setmode(int ixres, int iyres, int ibpp)
+{
+    if(ixres <= 0 || iyres <= 0 || (ibpp != 8 && ibpp != 16 && ibpp != 32))
+        return -1;
+    if(g_pucmem)
+        return -1;// 已经初始化，不能再改
+    g_ixres = ixres;
+    g_iyres = iyres;
+    g_ibpp  = ibpp;
+    return 0;
+}
+
+/*
+创建匿名共享内存：优先 memfd_create，内核/C库不支持时用 shm_open 并立即 unlink
+*/
+static int memdisplay_createfd(void)
+{
+    int fd = -1;
+    char name[64];
+
+#ifdef SYS_memfd_create
+    fd = syscall(SYS_memfd_create, "mass-display", 0);
+#endif
+    if(fd < 0)
+    {
+        snprintf(name, sizeof(name), "/mass-display-%d", getpid());
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if(fd >= 0)
+            shm_unlink(name);
+    }
+    return fd;
+}
+
+/*
+设备初始化：创建共享内存并映射，填写共享内存头
+*/
+static int memdeviceinit(void)
+{
+    pixel_width = g_ibpp / 8;
+    line_width  = g_ixres * pixel_width;
+    g_imapsize  = sizeof(memdisp_header) + line_width * g_iyres;
+
+    g_ifd = memdisplay_createfd();
+    if(g_ifd < 0)
+    {
+        printf("can't create display memfd\n");
+        return -1;
+    }
+    if(ftruncate(g_ifd, g_imapsize))
+    {
+        printf("can't resize display memfd\n");
+        close(g_ifd);
+        g_ifd = -1;
+        return -1;
+    }
+    g_pucmem = (unsigned char *)mmap(NULL, g_imapsize, PROT_READ | PROT_WRITE, MAP_SHARED, g_ifd, 0);
+    if(g_pucmem == (unsigned char *) -1)
+    {
+        printf("can't mmap display memfd\n");
+        g_pucmem = NULL;
+        close(g_ifd);
+        g_ifd = -1;
+        return -1;
+    }
+
+    g_ptheader = (p_memdisp_header)g_pucmem;
+    g_pucpixels = g_pucmem + sizeof(memdisp_header);
+    memset(g_ptheader, 0, sizeof(memdisp_header));
+    g_ptheader->magic      = MEMDISP_MAGIC;
+    g_ptheader->xres       = g_ixres;
+    g_ptheader->yres       = g_iyres;
+    g_ptheader->bpp        = g_ibpp;
+    g_ptheader->line_bytes = line_width;
+    g_ptheader->offset     = sizeof(memdisp_header);
+
+    printf("mem display %dx%d %dbpp: /proc/%d/fd/%d\n", g_ixres, g_iyres, g_ibpp, getpid(), g_ifd);
+    return 0;
+}
+
+/*
+设备退出清理
+*/
+static int memdeviceexit(void)
+{
+    if(g_pucmem)
+        munmap(g_pucmem, g_imapsize);
+    if(g_ifd >= 0)
+        close(g_ifd);
+    g_pucmem = NULL;
+    g_ifd = -1;
+    return 0;
+}
+
+/*
+返回分辨率、像素位数和像素区首地址
+输入参数：显示缓冲区结构体指针
+*/
+static int memgetbuffer(pdispbuff ptdispbuff)
+{
+    ptdispbuff->ixres = g_ixres;
+    ptdispbuff->iyres = g_iyres;
+    ptdispbuff->ibpp  = g_ibpp;
+    ptdispbuff->buff  = (char *)g_pucpixels;
+    ptdispbuff->iline_bytes = line_width;
+    ptdispbuff->ipixfmt = PIXFMT_UNKNOWN;// 按 bpp 取默认格式：8 位、RGB565、XRGB8888
+    return 0;
+}
+
+/*
+刷新区域：把后台缓冲区中的区域逐行拷贝到共享内存
+输入参数：显示区域结构体指针（已被裁剪到屏幕范围内），后台缓冲区结构体指针
+*/
+static int memflushregion(p_region ptregion, pdispbuff ptdispbuff)
+{
+    int y;
+    int src_line_width = dispbuff_linebytes(ptdispbuff);
+    int row_bytes = ptregion->width * pixel_width;
+    unsigned char *src = (unsigned char *)ptdispbuff->buff + ptregion->y * src_line_width + ptregion->x * pixel_width;
+    unsigned char *dst = g_pucpixels + ptregion->y * line_width + ptregion->x * pixel_width;
+
+    for(y = 0; y < ptregion->height; y++)
+    {
+        memcpy(dst, src, row_bytes);
+        src += src_line_width;
+        dst += line_width;
+    }
+    return 0;
+}
+
+/*
+一帧结束：帧序号加一，外部查看程序据此判断有新画面
+*/
+static int mempresentframe(pdispbuff ptdispbuff)
+{
+    __sync_synchronize();// 先让像素写入可见，再更新帧序号
+    g_ptheader->frame_seq++;
+    return 0;
+}
+
+/*
+获得共享内存的文件描述符，供同进程的查看/测试代码使用
+*/
+int memdisplay_getfd(void)
+{
+    return g_ifd;
+}
+
+/*
+把当前画面保存为 PPM（P6，RGB 各8位）图片
+8 位按灰度处理，16 位按 RGB565，32 位按 XRGB8888
+输入参数：文件路径
+*/
+int memdisplay_dumpppm(char *path)
+{
+    FILE *fp;
+    int x, y;
+    unsigned char rgb[3];
+    unsigned char *row;
+    unsigned int pixel;
+
+    if(!g_pucmem)
+        return -1;
+    fp = fopen(path, "wb");
+    if(!fp)
+    {
+        printf("can not open file %s\n", path);
+        return -1;
+    }
+
+    fprintf(fp, "P6\n%d %d\n255\n", g_ixres, g_iyres);
+    for(y = 0; y < g_iyres; y++)
+    {
+        row = g_pucpixels + y * line_width;
+        for(x = 0; x < g_ixres; x++)
+        {
+            switch (g_ibpp)
+            {
+                case 8:
+                    rgb[0] = rgb[1] = rgb[2] = row[x];
+                    break;
+                case 16:
+                    pixel = ((unsigned short *)row)[x];
+                    rgb[0] = ((pixel >> 11) & 0x1F) << 3;
+                    rgb[1] = ((pixel >> 5) & 0x3F) << 2;
+                    rgb[2] = (pixel & 0x1F) << 3;
+                    break;
+                default:
+                    pixel = ((unsigned int *)row)[x];
+                    rgb[0] = (pixel >> 16) & 0xFF;
+                    rgb[1] = (pixel >> 8) & 0xFF;
+                    rgb[2] = pixel & 0xFF;
+                    break;
+            }
+            fwrite(rgb, 1, 3, fp);
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+/*
+用 dispopr 结构体封装的无头显示设备的操作接口
+*/
+static dispopr g_tmemdisplayopr = {
+    .name = "mem",
+    .deviceinit = memdeviceinit,
+    .deviceexit = memdeviceexit,
+    .getbuffer = memgetbuffer,
+    .flushregion = memflushregion,
+    .presentframe = mempresentframe,
+};
+
+// 将无头显示设备接口注册到管理器
+void memdisplay_register(void)
+{
+    registerdisplay(&g_tmemdisplayopr);
+}
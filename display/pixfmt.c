@@ -0,0 +1,146 @@
+/*
+像素格式操作表（属于显示管理层）
+以前 putpixel 对每个像素 switch (ibpp)、重新做 RGB565 转换。现在每种像素格式一组函数：
+颜色转换（mapcolor）、画点、水平线、矩形填充、字形绘制、字形混合、像素块拷贝；
+initdefaultdisplay 根据设备报告的格式选定一次，之后的绘制直接调用，颜色也只在入口转换一次。
+BGR 格式与 RGB 格式只有颜色转换不同，逐像素的函数是共用的。
+*/
+
+#include <stdio.h>
+
+#include <disp_manager.h>
+
+static unsigned int mapcolor_8(unsigned int dwcolor)
+{
+    return dwcolor & 0xFF;
+}
+
+static unsigned int mapcolor_rgb565(unsigned int dwcolor)
+{
+    unsigned int red   = (dwcolor >> 16) & 0xFF;
+    unsigned int green = (dwcolor >> 8) & 0xFF;
+    unsigned int blue  = (dwcolor >> 0) & 0xFF;
+    return ((red >> 3) << 11) | ((green >> 2) << 5) | (blue >> 3);
+}
+
+static unsigned int mapcolor_bgr565(unsigned int dwcolor)
+{
+    unsigned int red   = (dwcolor >> 16) & 0xFF;
+    unsigned int green = (dwcolor >> 8) & 0xFF;
+    unsigned int blue  = (dwcolor >> 0) & 0xFF;
+    return ((blue >> 3) << 11) | ((green >> 2) << 5) | (red >> 3);
+}
+
+static unsigned int mapcolor_xrgb8888(unsigned int dwcolor)
+{
+    return dwcolor & 0xFFFFFF;
+}
+
+static unsigned int mapcolor_xbgr8888(unsigned int dwcolor)
+{
+    return ((dwcolor & 0xFF) << 16) | (dwcolor & 0xFF00) | ((dwcolor >> 16) & 0xFF);
+}
+
+/*
+像素格式操作表，下标为 PIXFMT_xxx
+8 位缓冲区不能按分量混合，glyphblend 用 glyphblit 代替
+*/
+const pixelopr g_at_pixelopr[PIXFMT_NUM] = {
+    [PIXFMT_8] = {
+        .name = "8", .ipixfmt = PIXFMT_8, .ibpp = 8,
+        .mapcolor = mapcolor_8, .put = put8, .hline = hline8, .fillrect = fillrect8,
+        .glyphblit = glyphblit8, .glyphblend = glyphblit8, .blitcopy = blitcopy_rows,
+    },
+    [PIXFMT_RGB565] = {
+        .name = "rgb565", .ipixfmt = PIXFMT_RGB565, .ibpp = 16,
+        .mapcolor = mapcolor_rgb565, .put = put16, .hline = hline16, .fillrect = fillrect16,
+        .glyphblit = glyphblit16, .glyphblend = glyphblend16, .blitcopy = blitcopy_rows,
+    },
+    [PIXFMT_BGR565] = {
+        .name = "bgr565", .ipixfmt = PIXFMT_BGR565, .ibpp = 16,
+        .mapcolor = mapcolor_bgr565, .put = put16, .hline = hline16, .fillrect = fillrect16,
+        .glyphblit = glyphblit16, .glyphblend = glyphblend16, .blitcopy = blitcopy_rows,
+    },
+    [PIXFMT_XRGB8888] = {
+        .name = "xrgb8888", .ipixfmt = PIXFMT_XRGB8888, .ibpp = 32,
+        .mapcolor = mapcolor_xrgb8888, .put = put32, .hline = hline32, .fillrect = fillrect32,
+        .glyphblit = glyphblit32, .glyphblend = glyphblend32, .blitcopy = blitcopy_rows,
+    },
+    [PIXFMT_XBGR8888] = {
+        .name = "xbgr8888", .ipixfmt = PIXFMT_XBGR8888, .ibpp = 32,
+        .mapcolor = mapcolor_xbgr8888, .put = put32, .hline = hline32, .fillrect = fillrect32,
+        .glyphblit = glyphblit32, .glyphblend = glyphblend32, .blitcopy = blitcopy_rows,
+    },
+};
+
+/*
+根据缓冲区的像素格式选择操作表
+设备没有报告格式时按 bpp 取默认格式（8 位、RGB565、XRGB8888）
+输入参数：显示缓冲区指针
+返回值：操作表指针，不支持的格式返回 NULL
+*/
+p_pixelopr getpixelopr(pdispbuff ptdispbuff)
+{
+    int ipixfmt = ptdispbuff->ipixfmt;
+
+    if(ipixfmt <= PIXFMT_UNKNOWN || ipixfmt >= PIXFMT_NUM)
+    {
+        switch (ptdispbuff->ibpp)
+        {
+            case 8:  ipixfmt = PIXFMT_8;        break;
+            case 16: ipixfmt = PIXFMT_RGB565;   break;
+            case 32: ipixfmt = PIXFMT_XRGB8888; break;
+            default:
+            {
+                printf("Unsupported pixel format: %d bits per pixel\n", ptdispbuff->ibpp);
+                return NULL;
+            }
+        }
+    }
+    if(g_at_pixelopr[ipixfmt].ibpp != ptdispbuff->ibpp)
+    {
+        printf("Pixel format %s does not match %d bits per pixel\n", g_at_pixelopr[ipixfmt].name, ptdispbuff->ibpp);
+        return NULL;
+    }
+    return (p_pixelopr)&g_at_pixelopr[ipixfmt];
+}
+
+/*
+把区域裁剪到缓冲区范围和裁剪区域内
+输入参数：显示缓冲区指针，待裁剪区域，裁剪区域（可为NULL，只裁剪到缓冲区）
+输出参数：裁剪结果
+返回值：1 结果非空；0 完全在范围外
+*/
+int clip_region(pdispbuff ptdispbuff, p_region pt_in, p_region pt_clip, p_region pt_out)
+{
+    int x = pt_in->x;
+    int y = pt_in->y;
+    int x_max = x + pt_in->width;
+    int y_max = y + pt_in->height;
+
+    if(x < 0)
+        x = 0;
+    if(y < 0)
+        y = 0;
+    if(x_max > ptdispbuff->ixres)
+        x_max = ptdispbuff->ixres;
+    if(y_max > ptdispbuff->iyres)
+        y_max = ptdispbuff->iyres;
+    if(pt_clip)
+    {
+        if(x < pt_clip->x)
+            x = pt_clip->x;
+        if(y < pt_clip->y)
+            y = pt_clip->y;
+        if(x_max > pt_clip->x + pt_clip->width)
+            x_max = pt_clip->x + pt_clip->width;
+        if(y_max > pt_clip->y + pt_clip->height)
+            y_max = pt_clip->y + pt_clip->height;
+    }
+
+    pt_out->x = x;
+    pt_out->y = y;
+    pt_out->width  = (x_max > x) ? x_max - x : 0;
+    pt_out->height = (y_max > y) ? y_max - y : 0;
+    return pt_out->width > 0 && pt_out->height > 0;
+}
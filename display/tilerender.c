@@ -0,0 +1,168 @@
+/*
+条带并行渲染（属于显示管理层）
+整页重绘（启动时 generate_buttons、配置重载、切换页面）以前只用一个核，面板用的四核 SoC 其余三个核闲着。
+这里维护一个小的工作线程池：屏幕按水平条带划分，调用者和工作线程按块（几个条带）领取任务，
+每个块只写自己那几行，互不重叠，所以绘制本身不需要加锁；
+块用原子计数器动态领取，文字密集的条带耗时长也不会让某个线程一直拖着。
+线程在第一次使用时创建，之后常驻，等待下一帧。
+*/
+
+#include <pthread.h>
+#include <unistd.h>
+#include <stdio.h>
+
+#include <disp_manager.h>
+
+#define TILE_THREADS_MAX 8 // 线程数上限（含调用者）
+
+static pthread_mutex_t g_tMutex  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_tStartVar = PTHREAD_COND_INITIALIZER;// 有新任务
+static pthread_cond_t  g_tDoneVar  = PTHREAD_COND_INITIALIZER;// 工作线程完成
+
+static int g_ithreads = 0;          // 设置的线程数（含调用者），0 表示按 CPU 核数
+static int g_istarted = 0;          // 已创建的工作线程数
+static unsigned int g_igeneration;  // 任务代数，每次 tilerender_run 加一
+static int g_irunning;              // 本次任务还没完成的工作线程数
+static int g_iworkers;              // 本次任务参与的工作线程数
+
+//本次任务
+static tile_func g_pf_tile;
+static void *g_p_arg;
+static int g_inbands;
+static int g_ichunk;
+static volatile int g_inext;        // 下一个待领取的条带
+
+/*
+领取并执行条带块，直到全部领完
+*/
+static void tile_work(void)
+{
+    int b;
+
+    while(1)
+    {
+        b = __sync_fetch_and_add(&g_inext, g_ichunk);
+        if(b >= g_inbands)
+            break;
+        g_pf_tile(b, b + g_ichunk < g_inbands ? b + g_ichunk : g_inbands, g_p_arg);
+    }
+}
+
+/*
+工作线程：等待新任务，执行，然后通知调用者
+输入参数：线程序号（1 开始，0 是调用者）
+*/
+static void *tile_thread_func(void *data)
+{
+    int index = (int)(long)data;
+    unsigned int seen = 0;
+
+    while(1)
+    {
+        pthread_mutex_lock(&g_tMutex);
+        while(g_igeneration == seen)
+            pthread_cond_wait(&g_tStartVar, &g_tMutex);
+        seen = g_igeneration;
+        if(index >= g_iworkers + 1)
+        {
+            //本次不需要这么多线程
+            pthread_mutex_unlock(&g_tMutex);
+            continue;
+        }
+        pthread_mutex_unlock(&g_tMutex);
+
+        tile_work();
+
+        pthread_mutex_lock(&g_tMutex);
+        if(--g_irunning == 0)
+            pthread_cond_signal(&g_tDoneVar);
+        pthread_mutex_unlock(&g_tMutex);
+    }
+    return NULL;
+}
+
+/*
+设置渲染线程数（含调用者）
+输入参数：线程数，0 表示按在线的 CPU 核数，1 表示只在调用者线程中渲染
+*/
+int tilerender_setthreads(int ithreads)
+{
+    if(ithreads < 0)
+        return -1;
+    g_ithreads = ithreads > TILE_THREADS_MAX ? TILE_THREADS_MAX : ithreads;
+    return 0;
+}
+
+/*
+获得实际使用的渲染线程数（含调用者）
+*/
+int tilerender_getthreads(void)
+{
+    long ncpu;
+
+    if(g_ithreads)
+        return g_ithreads;
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if(ncpu < 1)
+        ncpu = 1;
+    return ncpu > TILE_THREADS_MAX ? TILE_THREADS_MAX : (int)ncpu;
+}
+
+/*
+把 nbands 个条带按 ichunk 个一块分给线程池执行，返回时全部执行完
+线程数为1或条带块数只有一个时直接在调用者线程中执行
+输入参数：条带数，每块的条带数，条带处理函数（处理 [b_begin, b_end)），参数
+返回值：实际参与的线程数
+*/
+int tilerender_run(int nbands, int ichunk, tile_func pf_tile, void *p_arg)
+{
+    int ithreads = tilerender_getthreads();
+    int nchunks;
+    pthread_t tid;
+
+    if(ichunk < 1)
+        ichunk = 1;
+    nchunks = (nbands + ichunk - 1) / ichunk;
+    if(ithreads > nchunks)
+        ithreads = nchunks;
+    if(ithreads <= 1)
+    {
+        pf_tile(0, nbands, p_arg);
+        return 1;
+    }
+
+    pthread_mutex_lock(&g_tMutex);
+    //按需创建工作线程，创建失败就用已有的线程
+    while(g_istarted < ithreads - 1)
+    {
+        if(pthread_create(&tid, NULL, tile_thread_func, (void *)(long)(g_istarted + 1)))
+        {
+            printf("can't create tile render thread\n");
+            break;
+        }
+        pthread_detach(tid);
+        g_istarted++;
+    }
+    if(ithreads > g_istarted + 1)
+        ithreads = g_istarted + 1;
+
+    g_pf_tile = pf_tile;
+    g_p_arg = p_arg;
+    g_inbands = nbands;
+    g_ichunk = ichunk;
+    g_inext = 0;
+    g_iworkers = ithreads - 1;
+    g_irunning = g_iworkers;
+    g_igeneration++;
+    pthread_cond_broadcast(&g_tStartVar);
+    pthread_mutex_unlock(&g_tMutex);
+
+    //调用者也参与渲染
+    tile_work();
+
+    pthread_mutex_lock(&g_tMutex);
+    while(g_irunning > 0)
+        pthread_cond_wait(&g_tDoneVar, &g_tMutex);
+    pthread_mutex_unlock(&g_tMutex);
+    return ithreads;
+}
@@ -0,0 +1,406 @@
+/*
+预渲染字形图集字体引擎（属于字体库实现层）
+以前每次启动都要 FT_Init_FreeType、FT_New_Face，再从 TTF 逐个光栅化所有标签，慢速 eMMC 的板子上明显拖慢开机，运行时还离不开 libfreetype。
+这里用 tools/mkatlas 离线生成的图集文件（格式见 font_atlas.h）：初始化时只 mmap 一次文件并校验，
+getfontbitmap 二分查找字符后直接返回映射内存里的位图，getstring_regioncar 用图集里的偏移和前进距离拼外框，都不分配内存。
+图集中没有的字符、没有的字号或位图格式不一致时，交给 "freetype" 引擎处理（第一次需要时才用 newface 打开图集记录的字体文件）。
+映射的图集只读，字号和位图格式由调用者通过 fontstate 传入，几个线程可以同时取字形。
+*/
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <font_manager.h>
+#include <font_atlas.h>
+
+static unsigned char *g_puc_atlas = NULL;  //映射的图集文件
+static unsigned long g_i_atlassize;
+static p_fontatlas_header g_pt_header;
+static int *g_pi_sizes;
+static p_fontatlas_units g_pt_units;
+static p_fontatlas_glyph g_pt_glyphs;
+static unsigned char *g_puc_bitmaps;
+
+//回退用的 FreeType 引擎和它打开的字体
+static p_fontopr g_pt_fallback = NULL;
+static void *g_p_fallbackface = NULL;
+static int g_i_fallback_state = 0;   //0 未初始化，1 可用，-1 初始化失败
+static pthread_mutex_t g_t_fallbackmutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+检查图集文件头和各段是否都在文件范围内，避免损坏的文件导致越界访问
+*/
+static int atlas_check(void)
+{
+    p_fontatlas_header pt_header = (p_fontatlas_header)g_puc_atlas;
+    unsigned long long end;
+    unsigned int i, n;
+
+    if(g_i_atlassize < sizeof(fontatlas_header) || pt_header->magic != FONTATLAS_MAGIC ||
+       pt_header->version != FONTATLAS_VERSION || pt_header->file_size != g_i_atlassize)
+        return -1;
+    if(pt_header->units_per_em == 0 ||
+       (pt_header->pixelmode != FONT_PIXEL_MODE_GRAY && pt_header->pixelmode != FONT_PIXEL_MODE_MONO))
+        return -1;
+    if((pt_header->sizes_offset | pt_header->units_offset | pt_header->glyphs_offset | pt_header->bitmaps_offset) &
+       (FONTATLAS_ALIGN - 1))
+        return -1;
+    if(pt_header->sizes_offset + (unsigned long long)pt_header->nsizes * sizeof(int) > g_i_atlassize ||
+       pt_header->units_offset + (unsigned long long)pt_header->ncodes * sizeof(fontatlas_units) > g_i_atlassize ||
+       pt_header->glyphs_offset + (unsigned long long)pt_header->nsizes * pt_header->ncodes * sizeof(fontatlas_glyph) > g_i_atlassize ||
+       pt_header->bitmaps_offset > g_i_atlassize)
+        return -1;
+    if(pt_header->fontpath_offset &&
+       (pt_header->fontpath_offset >= g_i_atlassize ||
+        !memchr(g_puc_atlas + pt_header->fontpath_offset, 0, g_i_atlassize - pt_header->fontpath_offset)))
+        return -1;
+
+    //每个位图都要在文件范围内
+    n = pt_header->nsizes * pt_header->ncodes;
+    for(i = 0; i < n; i++)
+    {
+        p_fontatlas_glyph pt_glyph = (p_fontatlas_glyph)(g_puc_atlas + pt_header->glyphs_offset) + i;
+        end = (unsigned long long)pt_header->bitmaps_offset + pt_glyph->bitmap_offset +
+              (unsigned long long)pt_glyph->pitch * pt_glyph->height;
+        if(end > g_i_atlassize)
+            return -1;
+        if(pt_glyph->height && (pt_header->pixelmode == FONT_PIXEL_MODE_GRAY ?
+           pt_glyph->pitch < pt_glyph->width : pt_glyph->pitch * 8 < pt_glyph->width))
+            return -1;
+    }
+    return 0;
+}
+
+/*
+设备初始化，映射图集文件
+输入参数:图集文件路径（如 "/etc/gui/font.atlas"）
+*/
+static int atlas_fontinit(char *afinename)
+{
+    struct stat t_stat;
+    unsigned char *puc_atlas;
+    int fd;
+
+    fd = open(afinename, O_RDONLY);
+    if(fd < 0)
+    {
+        printf("can not open atlas %s\n", afinename);
+        return -1;
+    }
+    if(fstat(fd, &t_stat) || t_stat.st_size < (off_t)sizeof(fontatlas_header))
+    {
+        printf("bad atlas %s\n", afinename);
+        close(fd);
+        return -1;
+    }
+    //只读、私有映射：图集的页只在第一次访问时从存储读入，多个进程共享页缓存
+    puc_atlas = mmap(NULL, t_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(puc_atlas == MAP_FAILED)
+    {
+        printf("can't mmap atlas\n");
+        return -1;
+    }
+
+    if(g_puc_atlas)
+        munmap(g_puc_atlas, g_i_atlassize);
+    g_puc_atlas = puc_atlas;
+    g_i_atlassize = t_stat.st_size;
+    if(atlas_check())
+    {
+        printf("bad atlas %s\n", afinename);
+        munmap(g_puc_atlas, g_i_atlassize);
+        g_puc_atlas = NULL;
+        return -1;
+    }
+
+    g_pt_header   = (p_fontatlas_header)g_puc_atlas;
+    g_pi_sizes    = (int *)(g_puc_atlas + g_pt_header->sizes_offset);
+    g_pt_units    = (p_fontatlas_units)(g_puc_atlas + g_pt_header->units_offset);
+    g_pt_glyphs   = (p_fontatlas_glyph)(g_puc_atlas + g_pt_header->glyphs_offset);
+    g_puc_bitmaps = g_puc_atlas + g_pt_header->bitmaps_offset;
+    g_i_fallback_state = 0;
+    return 0;
+}
+
+/*
+获得可用的回退引擎，第一次调用时打开图集记录的字体文件（几个线程同时第一次调用时只打开一次）
+输入参数：存放回退字体状态的指针，字号和位图格式从 pt_state 复制
+返回值：回退引擎，没有时返回 NULL
+*/
+static p_fontopr atlas_fallback(p_fontstate pt_state, p_fontstate pt_fallbackstate)
+{
+    int i_state = __atomic_load_n(&g_i_fallback_state, __ATOMIC_ACQUIRE);
+
+    if(i_state == 0)
+    {
+        pthread_mutex_lock(&g_t_fallbackmutex);
+        i_state = g_i_fallback_state;
+        if(i_state == 0)
+        {
+            i_state = -1;
+            g_pt_fallback = getfontopr("freetype");
+            if(g_pt_fallback && g_pt_fallback->newface &&
+               g_pt_header->fontpath_offset)
+            {
+                g_p_fallbackface = g_pt_fallback->newface((char *)g_puc_atlas + g_pt_header->fontpath_offset);
+                if(g_p_fallbackface)
+                    i_state = 1;
+            }
+            __atomic_store_n(&g_i_fallback_state, i_state, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&g_t_fallbackmutex);
+    }
+    if(i_state < 0)
+        return NULL;
+    pt_fallbackstate->p_engineface = g_p_fallbackface;
+    pt_fallbackstate->i_fontsize = pt_state ? pt_state->i_fontsize : 0;
+    pt_fallbackstate->i_pixelmode = pt_state ? pt_state->i_pixelmode : FONT_PIXEL_MODE_GRAY;
+    return g_pt_fallback;
+}
+
+/*
+查找字号对应的字形表
+输入参数：字体大小
+返回值：这个字号的字形表，图集中没有这个字号时返回 NULL
+*/
+static p_fontatlas_glyph atlas_glyphs(int ifontsize)
+{
+    int lo = 0, hi = (int)g_pt_header->nsizes - 1, mid;
+
+    while(lo <= hi)
+    {
+        mid = (lo + hi) / 2;
+        if(g_pi_sizes[mid] == ifontsize)
+            return g_pt_glyphs + (unsigned long)mid * g_pt_header->ncodes;
+        if(g_pi_sizes[mid] < ifontsize)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return NULL;
+}
+
+/*
+在图集中查找字符
+输入参数：字符编码
+返回值：字符在 units/glyphs 表中的下标，没有时返回 -1
+*/
+static int atlas_findcode(unsigned int dwcode)
+{
+    int lo = 0, hi = (int)g_pt_header->ncodes - 1, mid;
+
+    while(lo <= hi)
+    {
+        mid = (lo + hi) / 2;
+        if(g_pt_units[mid].code == dwcode)
+            return mid;
+        if(g_pt_units[mid].code < dwcode)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return -1;
+}
+
+/*
+图集或回退字体中是否有这个字符（字体管理层按顺序找后备字体时用）
+参数：字体对象（图集只有一个，忽略），字符的 Unicode 编码
+*/
+static int atlas_hascode(void *p_engineface, unsigned int dwcode)
+{
+    fontstate t_fallbackstate;
+    p_fontopr pt_fallback;
+
+    if(atlas_findcode(dwcode) >= 0)
+        return 1;
+    pt_fallback = atlas_fallback(NULL, &t_fallbackstate);
+    return pt_fallback && (!pt_fallback->hascode || pt_fallback->hascode(t_fallbackstate.p_engineface, dwcode));
+}
+
+/*
+把字号调整为图集中不超过它的最大字号，求出的字号都能直接从图集取字形
+参数：字体大小
+返回值：调整后的字号，图集中没有更小的字号时原样返回
+*/
+static int atlas_snapsize(int ifontsize)
+{
+    int i;
+
+    for(i = (int)g_pt_header->nsizes - 1; i >= 0; i--)
+        if(g_pi_sizes[i] <= ifontsize)
+            return g_pi_sizes[i];
+    return ifontsize;
+}
+
+/*
+获得字符位图
+图集中有这个字号时位图直接指向映射的图集文件，在下一次初始化图集之前一直有效；
+字号不在图集中，或位图格式与图集生成时不同（生成图集时用 -m 得到单色图集）时交给回退引擎
+输入参数：字体状态，字符的 Unicode 编码，位图数据结构体指针（i_cur_originx/y 为基点）
+*/
+static int atlas_getfontbitmap_r(p_fontstate pt_state, unsigned int dwcode, p_fontbitmap pt_fontbitmap)
+{
+    p_fontatlas_glyph pt_glyphs = atlas_glyphs(pt_state->i_fontsize);
+    p_fontatlas_glyph pt_glyph;
+    fontstate t_fallbackstate;
+    p_fontopr pt_fallback;
+    int index;
+
+    index = (pt_glyphs && pt_state->i_pixelmode == (int)g_pt_header->pixelmode) ? atlas_findcode(dwcode) : -1;
+    if(index < 0)
+    {
+        pt_fallback = atlas_fallback(pt_state, &t_fallbackstate);
+        return pt_fallback ? pt_fallback->getfontbitmap_r(&t_fallbackstate, dwcode, pt_fontbitmap) : -1;
+    }
+
+    pt_glyph = &pt_glyphs[index];
+    pt_fontbitmap->puc_buffer      = g_puc_bitmaps + pt_glyph->bitmap_offset;
+    pt_fontbitmap->i_pitch         = pt_glyph->pitch;
+    pt_fontbitmap->i_pixelmode     = g_pt_header->pixelmode;
+    pt_fontbitmap->t_region.x      = pt_fontbitmap->i_cur_originx + pt_glyph->left;
+    pt_fontbitmap->t_region.y      = pt_fontbitmap->i_cur_originy + pt_glyph->top;
+    pt_fontbitmap->t_region.width  = pt_glyph->width;
+    pt_fontbitmap->t_region.height = pt_glyph->height;
+    pt_fontbitmap->i_next_originx  = pt_fontbitmap->i_cur_originx + pt_glyph->advance;
+    pt_fontbitmap->i_next_originy  = pt_fontbitmap->i_cur_originy;
+    return 0;
+}
+
+/*
+获得字符串的外框，单位为像素
+字符串按 UTF-8 解码，用图集中每个字形位图的位置和前进距离拼出外框，有字符不在图集中时整串交给回退引擎
+图集不保存字距调整表，没有字距调整
+x 为外框左边相对起始基点的偏移，y 为外框上边在基线以上的高度
+输入参数：字体状态，待计算的字符串指针，存储字符串外框的区域指针，存储整串前进距离（像素）的指针（可为NULL）
+*/
+static int atlas_getstring_regioncar_r(p_fontstate pt_state, char *str, p_region_cartesian pt_regioncar, int *pi_advance)
+{
+    p_fontatlas_glyph pt_glyphs = atlas_glyphs(pt_state->i_fontsize);
+    p_fontatlas_glyph pt_glyph;
+    fontstate t_fallbackstate;
+    p_fontopr pt_fallback;
+    int pen_x = 0;
+    int x_min = 0x7FFFFFFF, y_min = 0x7FFFFFFF, x_max = -0x7FFFFFFF, y_max = -0x7FFFFFFF;
+    unsigned int dwcode;
+    int index, len;
+    char *p;
+
+    for(p = str; (len = utf8_getcode(p, &dwcode)) > 0; p += len)
+    {
+        index = pt_glyphs ? atlas_findcode(dwcode) : -1;
+        if(index < 0)
+        {
+            pt_fallback = atlas_fallback(pt_state, &t_fallbackstate);
+            return pt_fallback ? pt_fallback->getstring_regioncar_r(&t_fallbackstate, str, pt_regioncar, pi_advance) : -1;
+        }
+        pt_glyph = &pt_glyphs[index];
+        //空格等没有位图的字符只前进，不参与外框
+        if(pt_glyph->width && pt_glyph->height)
+        {
+            if(pen_x + pt_glyph->left < x_min)
+                x_min = pen_x + pt_glyph->left;
+            if(pen_x + pt_glyph->left + pt_glyph->width > x_max)
+                x_max = pen_x + pt_glyph->left + pt_glyph->width;
+            if(-pt_glyph->top > y_max)
+                y_max = -pt_glyph->top;
+            if(-pt_glyph->top - pt_glyph->height < y_min)
+                y_min = -pt_glyph->top - pt_glyph->height;
+        }
+        pen_x += pt_glyph->advance;
+    }
+
+    if(pi_advance)
+        *pi_advance = pen_x;
+    if(x_min > x_max)
+    {
+        pt_regioncar->x = pt_regioncar->y = 0;
+        pt_regioncar->width = pt_regioncar->height = 0;
+        return 0;
+    }
+    pt_regioncar->x = x_min;
+    pt_regioncar->y = y_max;
+    pt_regioncar->width = x_max - x_min;
+    pt_regioncar->height = y_max - y_min;
+    return 0;
+}
+
+/*
+获得字符串在字体设计单位下的外框，直接读图集的度量表
+输入参数：字体状态（不用字号），待计算的字符串指针，存储外框的区域指针（设计单位，y 为基线以上的高度），每 EM 的设计单位数，
+          存储整串前进距离（设计单位）的指针（可为NULL）
+*/
+static int atlas_getstring_unitsbox_r(p_fontstate pt_state, char *str, p_region_cartesian pt_regioncar, int *pi_unitsperem,
+                                      int *pi_advance)
+{
+    p_fontatlas_units pt_units;
+    fontstate t_fallbackstate;
+    p_fontopr pt_fallback;
+    long pen_x = 0;
+    long x_min = 0x7FFFFFFF, y_min = 0x7FFFFFFF, x_max = -0x7FFFFFFF, y_max = -0x7FFFFFFF;
+    unsigned int dwcode;
+    int index, len;
+    char *p;
+
+    for(p = str; (len = utf8_getcode(p, &dwcode)) > 0; p += len)
+    {
+        index = atlas_findcode(dwcode);
+        if(index < 0)
+        {
+            pt_fallback = atlas_fallback(pt_state, &t_fallbackstate);
+            return (pt_fallback && pt_fallback->getstring_unitsbox_r) ?
+                   pt_fallback->getstring_unitsbox_r(&t_fallbackstate, str, pt_regioncar, pi_unitsperem, pi_advance) : -1;
+        }
+        pt_units = &g_pt_units[index];
+        if(pt_units->width && pt_units->height)
+        {
+            if(pen_x + pt_units->x_min < x_min)
+                x_min = pen_x + pt_units->x_min;
+            if(pen_x + pt_units->x_min + pt_units->width > x_max)
+                x_max = pen_x + pt_units->x_min + pt_units->width;
+            if(pt_units->y_max > y_max)
+                y_max = pt_units->y_max;
+            if(pt_units->y_max - pt_units->height < y_min)
+                y_min = pt_units->y_max - pt_units->height;
+        }
+        pen_x += pt_units->advance;
+    }
+
+    *pi_unitsperem = g_pt_header->units_per_em;
+    if(pi_advance)
+        *pi_advance = pen_x;
+    if(x_min > x_max)
+    {
+        pt_regioncar->x = pt_regioncar->y = 0;
+        pt_regioncar->width = pt_regioncar->height = 0;
+        return 0;
+    }
+    pt_regioncar->x = x_min;
+    pt_regioncar->y = y_max;
+    pt_regioncar->width = x_max - x_min;
+    pt_regioncar->height = y_max - y_min;
+    return 0;
+}
+
+static fontopr g_t_atlasopr =
+{
+    .name = "atlas",
+    .fontinit = atlas_fontinit,//映射图集文件
+    .snapsize = atlas_snapsize,//字号对齐到图集中有的字号
+    .hascode = atlas_hascode,//图集或回退字体中是否有这个字符
+    .i_nocache = 1,//位图已在映射内存中，不需要再拷贝进字形缓存
+    .getfontbitmap_r = atlas_getfontbitmap_r,//获取字符位图（指向映射内存）
+    .getstring_regioncar_r = atlas_getstring_regioncar_r,//获取字符串外框
+    .getstring_unitsbox_r = atlas_getstring_unitsbox_r,//获取字符串的设计单位外框
+};
+
+void atlasregister(void)
+{
+    registerfont(&g_t_atlasopr);
+}
@@ -17,6 +17,12 @@
 
 
 #include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 #include <font_manager.h>
 #include <common.h>
@@ -26,11 +32,226 @@ static p_fontopr g_pt_fonts = NULL;
 //记录当前激活的字体引擎，所有字体操作（如设置大小、获取位图）都通过它完成。
 static p_fontopr g_pt_defaultfontopr = NULL;
 
+/*
+字形缓存
+百分比之类的文字每秒要刷新上百次，以前每次 getfontbitmap 都让 FreeType 重新光栅化同样的字形。
+这里按（字体引擎、字体文件、大小、位图格式、编码）缓存位图拷贝、相对基点的偏移和前进距离，
+缓存的字形与位置无关，基点在取出时才加上；所有注册的字体引擎共用一个缓存。
+总字节数超过预算时按最近使用时间批量淘汰到预算的 3/4，命中时只更新时间戳。
+几个线程共用：查找只持有读锁，插入和淘汰持有写锁；取到的项由本线程引用着，引用期间不会被淘汰
+*/
+#define GLYPHCACHE_BUCKETS 1024 //哈希桶数，必须是2的幂
+#define GLYPHCACHE_DEFAULT_BUDGET (256 * 1024) //默认内存预算，字节
+
+typedef struct glyphcache_entry{
+    p_fontopr pt_fontopr;       //键：字体引擎
+    unsigned int i_faceid;      //键：selectandinitfont 的序号（区分字体文件）
+    int i_fontsize;             //键：字体大小
+    int i_rendermode;           //键：请求的位图格式
+    unsigned int dwcode;        //键：字符编码
+    int i_left;                 //位图左边缘相对基点的偏移
+    int i_top;                  //位图上边缘相对基点的偏移（屏幕坐标，向下为正）
+    int i_width;
+    int i_height;
+    int i_pitch;
+    int i_pixelmode;            //位图实际的像素格式
+    int i_advancex;             //到下一个基点的距离
+    int i_advancey;
+    int i_refs;                 //正在使用这个位图的线程数，不为0时不淘汰
+    unsigned long long i_stamp; //最近一次使用的时间戳（64位，长时间运行不会回绕）
+    unsigned int i_bytes;       //本项占用的字节数
+    struct glyphcache_entry *pt_next;
+    unsigned char auc_bitmap[]; //位图拷贝
+}glyphcache_entry,*p_glyphcache_entry;
+
+/*
+字符串外框缓存
+居中一个标签要先量出字符串的外框，同一个按钮名字在同一个大小下反复测量，结果不变；
+按（字体引擎、字体文件、大小、字符串）直接映射缓存，冲突时覆盖，命中只需一次哈希和一次字符串比较
+*/
+#define EXTENTCACHE_SIZE   256 //缓存项数，必须是2的幂
+#define EXTENTCACHE_STRMAX 48  //能缓存的字符串最大长度（含结尾的0）
+
+typedef struct extentcache_entry{
+    p_fontopr pt_fontopr;
+    unsigned int i_faceid;
+    int i_fontsize;
+    unsigned int i_hash;
+    region_cartesian t_regioncar;
+    char ac_str[EXTENTCACHE_STRMAX];
+}extentcache_entry,*p_extentcache_entry;
+
+/*
+字号求解缓存
+按（字体引擎、字体文件、字符串、区域宽高）记住“能放进区域的最大字号”
+4 路组相联：一页几百个按钮时直接映射会有不少冲突，冲突的两项会反复互相覆盖；组满时轮流替换
+*/
+#define FONTFIT_CACHE_SETS  256 //组数，必须是2的幂
+#define FONTFIT_CACHE_WAYS  4   //每组的项数
+#define FONTFIT_MIN_SIZE    4   //求解的最小字号
+#define FONTFIT_MAX_SIZE    512 //求解的最大字号
+#define FONTFIT_HINT_MARGIN 2   //按比例缩放的外框与微调后的实际外框每个方向最多差的像素数
+
+typedef struct fontfit_entry{
+    p_fontopr pt_fontopr;
+    unsigned int i_faceid;
+    int i_width;
+    int i_height;
+    unsigned int i_hash;
+    int i_fontsize;
+    char ac_str[EXTENTCACHE_STRMAX];
+}fontfit_entry,*p_fontfit_entry;
+
+/*
+排版结果缓存
+标签每次重绘都要解码 UTF-8、逐个字符求前进距离和字距调整、再测量外框，同一个标签在同一个字号下结果不变；
+按（字体引擎、字体文件、大小、位图格式、字符串）直接映射缓存排好版的 textrun，冲突时覆盖。
+textrun 带引用计数：被覆盖时如果还有线程在用，等它用完才释放
+*/
+#define TEXTRUN_CACHE_SIZE 256 //缓存项数，必须是2的幂
+
+typedef struct textrun_entry{
+    p_fontopr pt_fontopr;
+    unsigned int i_faceid;
+    int i_fontsize;
+    int i_rendermode;
+    unsigned int i_hash;
+    p_textrun pt_run;           //NULL 表示空项
+    char ac_str[EXTENTCACHE_STRMAX];
+}textrun_entry,*p_textrun_entry;
+
+/*
+后备字体链
+一个字体文件覆盖不了所有字符（名字里中文、拉丁文、符号混在一起），addfallbackfont 按顺序在主字体后面追加后备字体；
+每个字符用链上第一个有它的字体，都没有时用主字体（显示缺字符号）。
+字符属于哪个字体记在查找表里，之后不再逐个字体查询：BMP 按 256 个字符一页直接映射，页在第一次用到时分配；
+BMP 以外的字符用一个小的直接映射表（编码和字体序号放在一个 64 位数里整体读写），冲突时重新查询。
+几个线程可能同时填表，查到的结果都一样，用原子读写即可
+*/
+#define FONTCHAIN_MAX 8           //字体链最多的字体数（含主字体）
+#define FONTCHAIN_ASTRAL_SIZE 64  //BMP 以外字符的查找表项数，必须是2的幂
+
+typedef struct fontface{
+    p_fontopr pt_fontopr;
+    void *p_engineface;         //引擎 newface 打开的字体对象，NULL 表示引擎 fontinit 打开的
+    unsigned int i_faceid;      //字形缓存的键
+}fontface,*p_fontface;
+
+static fontface g_at_faces[FONTCHAIN_MAX];//0 是主字体，之后是后备字体
+static int g_i_nfallbacks = 0;
+static unsigned char *g_apuc_facemap[256];//BMP 字符所属字体序号+1，0 表示还没查过
+static unsigned long long g_al_astralmap[FONTCHAIN_ASTRAL_SIZE];//编码<<8 | 字体序号+1，0 表示空项
+static unsigned int g_i_faceserial = 0;//字体对象的序号，每打开一个字体加一
+
+static p_glyphcache_entry g_apt_glyphcache[GLYPHCACHE_BUCKETS];
+static extentcache_entry g_at_extentcache[EXTENTCACHE_SIZE];
+static textrun_entry g_at_textruncache[TEXTRUN_CACHE_SIZE];
+static fontfit_entry g_at_fontfitcache[FONTFIT_CACHE_SETS][FONTFIT_CACHE_WAYS];
+static unsigned char g_auc_fontfitvictim[FONTFIT_CACHE_SETS];//每组下一个被替换的项
+static glyphcachestat g_t_glyphcachestat = {.budget = GLYPHCACHE_DEFAULT_BUDGET};
+static unsigned long long g_i_stamp = 0;
+static unsigned int g_i_faceid = 0;
+static int g_i_rendermode = FONT_PIXEL_MODE_GRAY;
+
+/*
+线程安全
+界面线程、后台预热线程和并行重绘的线程同时取字形、测量和排版：
+g_t_configlock   读写锁，保护字体配置（主字体、字体链、位图格式、缓存预算）；取字形、测量时持有读锁，改配置时持有写锁
+g_t_metricsmutex 互斥锁，保护外框缓存、字号求解缓存和排版结果缓存；只在查找和填入缓存项时短暂持有，
+                 测量、排版、求字号（要调用字体引擎）时不持有，各线程各自的字体库实例可以同时工作；
+                 放开锁算完之后重新加锁，先检查缓存项是否已被别的线程填入，再决定是否写入
+g_t_glyphlock    读写锁，保护字形缓存的哈希表；查找持有读锁，插入和淘汰持有写锁，字体引擎光栅化时不持有
+字体引擎是可重入的（*_r），调用引擎不需要锁
+加锁顺序：configlock → metricsmutex → glyphlock
+当前字号是每个线程各自的，随调用显式传下去；返回给调用者的缓存字形和排版结果由本线程引用着，本线程下一次获取之前一直有效
+*/
+#define FONT_DEFAULT_SIZE 12 //线程第一次使用时的字号
+
+typedef struct fontthread{
+    int i_fontsize;                 //本线程的当前字号
+    p_glyphcache_entry pt_glyph;    //本线程最近一次取到的缓存字形
+    p_textrun pt_run;               //本线程最近一次取到的排版结果
+}fontthread,*p_fontthread;
+
+static pthread_rwlock_t g_t_configlock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t g_t_metricsmutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t g_t_glyphlock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_key_t g_t_threadkey;
+static pthread_once_t g_t_fontonce = PTHREAD_ONCE_INIT;
+
+/*
+后台预热
+parse_configfile 之后就知道所有会出现的文字；这里在低优先级的后台线程里把它们在指定字号下的字形提前放进缓存。
+只预热字形，不测量外框也不排版：外框和排版缓存的锁界面线程也要用，不能让只在空闲时运行的线程去占
+界面线程不等预热：还没预热到的字形照常现场生成。缓存用到淘汰线（预算的 3/4）后不再预热，不会挤掉正在用的字形
+*/
+typedef struct prewarm_item{
+    int i_fontsize;
+    struct prewarm_item *pt_next;
+    char ac_str[];
+}prewarm_item,*p_prewarm_item;
+
+static pthread_mutex_t g_t_prewarmmutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_t_prewarmvar = PTHREAD_COND_INITIALIZER;
+static p_prewarm_item g_pt_prewarmhead = NULL;
+static p_prewarm_item g_pt_prewarmtail = NULL;
+static int g_i_prewarmstarted = 0;
+
+/*
+释放一个排版结果的引用，最后一个引用释放时释放内存
+*/
+static void textrun_release(p_textrun pt_run)
+{
+    if(pt_run && __atomic_sub_fetch(&pt_run->i_refs, 1, __ATOMIC_ACQ_REL) == 0)
+        free(pt_run);
+}
+
+/*
+线程退出时放开它引用的字形和排版结果
+*/
+static void fontthread_free(void *data)
+{
+    p_fontthread pt_thread = data;
+
+    if(pt_thread->pt_glyph)
+        __atomic_sub_fetch(&pt_thread->pt_glyph->i_refs, 1, __ATOMIC_RELEASE);
+    textrun_release(pt_thread->pt_run);
+    free(pt_thread);
+}
+
+static void font_once(void)
+{
+    pthread_key_create(&g_t_threadkey, fontthread_free);
+}
+
+/*
+获得本线程的字体状态，第一次调用时创建
+返回值：线程状态，内存不够时返回 NULL
+*/
+static p_fontthread fontthread_get(void)
+{
+    p_fontthread pt_thread;
+
+    pthread_once(&g_t_fontonce, font_once);
+    pt_thread = pthread_getspecific(g_t_threadkey);
+    if(!pt_thread)
+    {
+        pt_thread = calloc(1, sizeof(fontthread));
+        if(!pt_thread)
+            return NULL;
+        pt_thread->i_fontsize = FONT_DEFAULT_SIZE;
+        pthread_setspecific(g_t_threadkey, pt_thread);
+    }
+    return pt_thread;
+}
+
 //注册FreeType结构体1
 void font_system_register(void)
 {
     extern void freetyperegister();
-    freetyperegister();  
+    extern void atlasregister();
+    freetyperegister();
+    atlasregister();
 }
 
 //注册FreeType结构体1.2
@@ -43,52 +264,1281 @@ void registerfont(p_fontopr  pt_fontopr)
 
 
 /*
-字库选择,并初始化字体引擎
-输入参数：要选择的字体引擎名称（如 "freetype"），字体文件路径（如 "./simhei.ttf"）
+按名称查找已注册的字体引擎
+输入参数：字体引擎名称（如 "freetype"）
+返回值：字体引擎，没有注册时返回 NULL
 */
-int selectandinitfont(char *a_fontoprname ,char *a_fontfilename)
+p_fontopr getfontopr(char *a_fontoprname)
 {
     p_fontopr pt_tmp = g_pt_fonts;
-    int error;
     while(pt_tmp)
     {
         if(strcmp(pt_tmp->name , a_fontoprname) == 0)
-            break;
+            return pt_tmp;
         pt_tmp = pt_tmp->pt_next;
     }
+    return NULL;
+}
+
+/*
+填写调用字体引擎用的字体状态
+*/
+static void fontface_state(p_fontface pt_face, int i_fontsize, p_fontstate pt_state)
+{
+    pt_state->p_engineface = pt_face->p_engineface;
+    pt_state->i_fontsize = i_fontsize;
+    pt_state->i_pixelmode = g_i_rendermode;
+}
+
+/*
+字体是否有这个字符
+输入参数：字体，字符编码
+*/
+static int fontface_hascode(p_fontface pt_face, unsigned int dwcode)
+{
+    p_fontopr pt_fontopr = pt_face->pt_fontopr;
+
+    if(!pt_fontopr->hascode)
+        return 1;
+    return pt_fontopr->hascode(pt_face->p_engineface, dwcode);
+}
+
+/*
+让字体引擎按传入的字体和字号生成字形，位图在本线程下一次调用引擎之前有效
+输入参数：字体，字号，字符编码，位图数据结构体指针
+*/
+static int fontface_getfontbitmap(p_fontface pt_face, int i_fontsize, unsigned int dwcode, p_fontbitmap pt_fontbitmap)
+{
+    fontstate t_state;
+
+    fontface_state(pt_face, i_fontsize, &t_state);
+    return pt_face->pt_fontopr->getfontbitmap_r(&t_state, dwcode, pt_fontbitmap);
+}
+
+/*
+用字体引擎测量字符串的外框（只用度量，不渲染）
+输入参数：字体，字号，字符串，存储外框的区域指针，存储前进距离的指针（可为NULL）
+*/
+static int fontface_regioncar(p_fontface pt_face, int i_fontsize, char *str, p_region_cartesian pt_regioncar, int *pi_advance)
+{
+    fontstate t_state;
+
+    fontface_state(pt_face, i_fontsize, &t_state);
+    return pt_face->pt_fontopr->getstring_regioncar_r(&t_state, str, pt_regioncar, pi_advance);
+}
+
+/*
+获得字符串的设计单位外框，引擎不提供时返回 -1
+输入参数：字体，字符串，存储外框的区域指针，每 EM 的设计单位数，存储前进距离的指针（可为NULL）
+*/
+static int fontface_unitsbox(p_fontface pt_face, char *str, p_region_cartesian pt_regioncar, int *pi_unitsperem, int *pi_advance)
+{
+    p_fontopr pt_fontopr = pt_face->pt_fontopr;
+    fontstate t_state;
+
+    if(!pt_fontopr->getstring_unitsbox_r)
+        return -1;
+    fontface_state(pt_face, 0, &t_state);
+    return pt_fontopr->getstring_unitsbox_r(&t_state, str, pt_regioncar, pi_unitsperem, pi_advance);
+}
+
+/*
+两个字符之间的字距调整，引擎不提供时为0
+输入参数：字体，字号，前一个字符和后一个字符的编码
+*/
+static int fontface_kerning(p_fontface pt_face, int i_fontsize, unsigned int dwleft, unsigned int dwright)
+{
+    p_fontopr pt_fontopr = pt_face->pt_fontopr;
+    fontstate t_state;
+
+    if(!pt_fontopr->getkerning_r)
+        return 0;
+    fontface_state(pt_face, i_fontsize, &t_state);
+    return pt_fontopr->getkerning_r(&t_state, dwleft, dwright);
+}
+
+/*
+清空字符所属字体的查找表（字体链变化后重新查询，调用者持有配置写锁）
+*/
+static void fontchain_clearmap(void)
+{
+    int i;
+
+    for(i = 0; i < 256; i++)
+        if(g_apuc_facemap[i])
+            memset(g_apuc_facemap[i], 0, 256);
+    memset(g_al_astralmap, 0, sizeof(g_al_astralmap));
+}
+
+/*
+去掉所有后备字体（换主字体时）
+引擎的字体对象与 fontinit 打开的一样不释放
+*/
+static void fontchain_reset(void)
+{
+    memset(&g_at_faces[1], 0, sizeof(fontface) * (FONTCHAIN_MAX - 1));
+    g_i_nfallbacks = 0;
+    fontchain_clearmap();
+}
+
+/*
+字库选择,并初始化字体引擎
+输入参数：要选择的字体引擎名称（如 "freetype"、"atlas"），字体文件路径（如 "./simhei.ttf"、"./font.atlas"）
+*/
+static int selectandinitfont_nolock(char *a_fontoprname ,char *a_fontfilename)
+{
+    p_fontopr pt_tmp = getfontopr(a_fontoprname);
+    p_fontface pt_face = &g_at_faces[0];
     if(!pt_tmp)
         return -1;
     g_pt_defaultfontopr =pt_tmp;
+    g_i_faceid = ++g_i_faceserial;//换了字体文件，旧的缓存项不会再命中，之后被淘汰
+    fontchain_reset();
+    memset(pt_face, 0, sizeof(fontface));
+    pt_face->pt_fontopr = pt_tmp;
+    pt_face->i_faceid = g_i_faceid;
+
+    return pt_tmp->fontinit(a_fontfilename);
+}
+
+/*
+在主字体后面追加一个后备字体，主字体和已有的后备字体都没有的字符从它取
+同一个引擎打开多个字体文件需要引擎支持 newface；不支持的引擎只能在链上出现一次
+输入参数：字体引擎名称（如 "freetype"），字体文件路径（如 "./wqy-microhei.ttc"）
+*/
+static int addfallbackfont_nolock(char *a_fontoprname ,char *a_fontfilename)
+{
+    p_fontopr pt_tmp = getfontopr(a_fontoprname);
+    p_fontface pt_face;
+    int i;
+
+    if(!pt_tmp || !g_pt_defaultfontopr || g_i_nfallbacks >= FONTCHAIN_MAX - 1)
+        return -1;
+    pt_face = &g_at_faces[g_i_nfallbacks + 1];
+    memset(pt_face, 0, sizeof(fontface));
+    if(pt_tmp->newface)
+    {
+        pt_face->p_engineface = pt_tmp->newface(a_fontfilename);
+        if(!pt_face->p_engineface)
+            return -1;
+    }
+    else
+    {
+        for(i = 0; i <= g_i_nfallbacks; i++)
+            if(g_at_faces[i].pt_fontopr == pt_tmp)
+                return -1;
+        if(pt_tmp->fontinit(a_fontfilename))
+            return -1;
+    }
+    pt_face->pt_fontopr = pt_tmp;
+    pt_face->i_faceid = ++g_i_faceserial;
+    g_i_nfallbacks++;
+
+    //之前没找到的字符可能在新字体里，外框和字号求解的结果也可能变了
+    fontchain_clearmap();
+    g_i_faceid = ++g_i_faceserial;
+    g_at_faces[0].i_faceid = g_i_faceid;
+    return 0;
+}
+
+/*
+按链的顺序找第一个有这个字符的字体
+返回值：字体序号，0 是主字体；都没有时也返回 0
+*/
+static int fontchain_find(unsigned int dwcode)
+{
+    int i;
+
+    for(i = 0; i <= g_i_nfallbacks; i++)
+        if(fontface_hascode(&g_at_faces[i], dwcode))
+            return i;
+    return 0;
+}
+
+/*
+字符属于字体链上的哪个字体，先查查找表
+输入参数：字符编码
+返回值：字体序号，0 是主字体
+*/
+static int fontchain_resolve(unsigned int dwcode)
+{
+    unsigned char *puc_page, *puc_expected = NULL;
+    unsigned long long *pl_astral, l_astral;
+    int i_face;
+
+    if(g_i_nfallbacks == 0)
+        return 0;
+    if(dwcode < 0x10000)
+    {
+        puc_page = __atomic_load_n(&g_apuc_facemap[dwcode >> 8], __ATOMIC_ACQUIRE);
+        if(!puc_page)
+        {
+            puc_page = calloc(256, 1);
+            if(!puc_page)
+                return fontchain_find(dwcode);
+            //别的线程可能同时分配了这一页，用先放进去的
+            if(!__atomic_compare_exchange_n(&g_apuc_facemap[dwcode >> 8], &puc_expected, puc_page,
+                                            0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                free(puc_page);
+                puc_page = puc_expected;
+            }
+        }
+        i_face = __atomic_load_n(&puc_page[dwcode & 0xFF], __ATOMIC_RELAXED);
+        if(!i_face)
+        {
+            i_face = fontchain_find(dwcode) + 1;
+            __atomic_store_n(&puc_page[dwcode & 0xFF], i_face, __ATOMIC_RELAXED);
+        }
+        return i_face - 1;
+    }
+    pl_astral = &g_al_astralmap[(dwcode * 0x9E3779B1u >> 16) & (FONTCHAIN_ASTRAL_SIZE - 1)];
+    l_astral = __atomic_load_n(pl_astral, __ATOMIC_RELAXED);
+    if(!l_astral || (l_astral >> 8) != dwcode)
+    {
+        l_astral = (unsigned long long)dwcode << 8 | (fontchain_find(dwcode) + 1);
+        __atomic_store_n(pl_astral, l_astral, __ATOMIC_RELAXED);
+    }
+    return (int)(l_astral & 0xFF) - 1;
+}
+
+/*
+从字符串开头取出一段属于同一个字体的字符
+输入参数：字符串，存放字体序号的指针
+返回值：这段字符的字节数，到字符串结尾时返回0
+*/
+static int fontchain_nextrun(char *str, int *pi_face)
+{
+    unsigned int dwcode;
+    int n, len;
+
+    n = utf8_getcode(str, &dwcode);
+    if(n == 0)
+        return 0;
+    *pi_face = fontchain_resolve(dwcode);
+    while((len = utf8_getcode(str + n, &dwcode)) > 0 && fontchain_resolve(dwcode) == *pi_face)
+        n += len;
+    return n;
+}
+
+//按 i_to/i_from 缩放，i_roundup 为0时向下取整，否则向上取整
+static long long fontchain_scale(long long v, int i_to, int i_from, int i_roundup)
+{
+    long long q;
+
+    v *= i_to;
+    q = v / i_from;
+    if(v % i_from && (v > 0) == (i_roundup != 0))
+        q += i_roundup ? 1 : -1;
+    return q;
+}
+
+/*
+只用度量测量字符串在字体链上的外框，不取字形、不光栅化
+字符串按所属字体分成几段，每段交给自己的字体测量，各段按前进距离依次排开，外框取并集；
+pi_unitsperem 为 NULL 时按字号测像素外框，否则测设计单位外框，各段按自己字体的 units_per_EM 换算到第一段字体的设计单位
+输入参数：字号（测设计单位外框时不用），字符串，存储外框的区域指针，存储每 EM 的设计单位数的指针
+返回值：0 成功，-1 有字体不能测量（如不提供设计单位外框）
+*/
+static int fontchain_measure(int i_fontsize, char *str, p_region_cartesian pt_regioncar, int *pi_unitsperem)
+{
+    char ac_buf[EXTENTCACHE_STRMAX], *pc_run = ac_buf;
+    region_cartesian t_box;
+    long long l_pen = 0;
+    long long x_min = 0x7FFFFFFF, y_min = 0x7FFFFFFF, x_max = -0x7FFFFFFF, y_max = -0x7FFFFFFF;
+    int i_face, i_unitsperem = 0, i_runupem = 1, i_advance = 0;
+    int n, len, error = 0;
+
+    if(g_i_nfallbacks == 0)
+        return pi_unitsperem ? fontface_unitsbox(&g_at_faces[0], str, pt_regioncar, pi_unitsperem, NULL) :
+                               fontface_regioncar(&g_at_faces[0], i_fontsize, str, pt_regioncar, NULL);
+    len = strlen(str);
+    if(len >= (int)sizeof(ac_buf))
+    {
+        pc_run = malloc(len + 1);
+        if(!pc_run)
+            return -1;
+    }
+    for(; (n = fontchain_nextrun(str, &i_face)) > 0; str += n)
+    {
+        memcpy(pc_run, str, n);
+        pc_run[n] = '\0';
+        if(pi_unitsperem)
+            error = fontface_unitsbox(&g_at_faces[i_face], pc_run, &t_box, &i_runupem, &i_advance);
+        else
+            error = fontface_regioncar(&g_at_faces[i_face], i_fontsize, pc_run, &t_box, &i_advance);
+        if(error || i_runupem <= 0)
+        {
+            error = -1;
+            break;
+        }
+        if(!i_unitsperem)
+            i_unitsperem = i_runupem;
+        //空格等没有轮廓的段只前进，不参与外框
+        if(t_box.width && t_box.height)
+        {
+            if(l_pen + fontchain_scale(t_box.x, i_unitsperem, i_runupem, 0) < x_min)
+                x_min = l_pen + fontchain_scale(t_box.x, i_unitsperem, i_runupem, 0);
+            if(l_pen + fontchain_scale(t_box.x + t_box.width, i_unitsperem, i_runupem, 1) > x_max)
+                x_max = l_pen + fontchain_scale(t_box.x + t_box.width, i_unitsperem, i_runupem, 1);
+            if(fontchain_scale(t_box.y, i_unitsperem, i_runupem, 1) > y_max)
+                y_max = fontchain_scale(t_box.y, i_unitsperem, i_runupem, 1);
+            if(fontchain_scale(t_box.y - t_box.height, i_unitsperem, i_runupem, 0) < y_min)
+                y_min = fontchain_scale(t_box.y - t_box.height, i_unitsperem, i_runupem, 0);
+        }
+        l_pen += fontchain_scale(i_advance, i_unitsperem, i_runupem, 0);
+    }
+    if(pc_run != ac_buf)
+        free(pc_run);
+    if(error)
+        return -1;
+
+    if(pi_unitsperem)
+        *pi_unitsperem = i_unitsperem ? i_unitsperem : 1;
+    if(x_min > x_max)
+    {
+        pt_regioncar->x = pt_regioncar->y = 0;
+        pt_regioncar->width = pt_regioncar->height = 0;
+        return 0;
+    }
+    pt_regioncar->x = x_min;
+    pt_regioncar->y = y_max;
+    pt_regioncar->width = x_max - x_min;
+    pt_regioncar->height = y_max - y_min;
+    return 0;
+}
+
+/*
+设置本线程的字体大小
+输入参数：线程状态，字体大小
+*/
+static int setfontsize_nolock(p_fontthread pt_thread, int i_fontsize)
+{
+    if(i_fontsize <= 0)
+        return -1;
+    pt_thread->i_fontsize = i_fontsize;
+    return 0;
+}
+
+//字形缓存的哈希值
+static unsigned int glyphcache_hash(p_fontopr pt_fontopr, unsigned int i_faceid, int i_fontsize, unsigned int dwcode)
+{
+    unsigned int h = dwcode * 0x9E3779B1u;
+    h ^= (unsigned int)i_fontsize * 0x85EBCA6Bu;
+    h ^= (i_faceid << 1 | g_i_rendermode) * 0xC2B2AE35u;
+    h ^= (unsigned int)(unsigned long)pt_fontopr >> 4;
+    return (h ^ (h >> 16)) & (GLYPHCACHE_BUCKETS - 1);
+}
+
+/*
+在缓存中查找字体在指定大小、当前格式下的字形（调用者持有字形缓存的读锁或写锁）
+输入参数：字体引擎，字体序号，字号，字符编码
+返回值：缓存项，没有时返回 NULL
+*/
+static p_glyphcache_entry glyphcache_lookup(p_fontopr pt_fontopr, unsigned int i_faceid, int i_fontsize, unsigned int dwcode)
+{
+    p_glyphcache_entry pt_entry = g_apt_glyphcache[glyphcache_hash(pt_fontopr, i_faceid, i_fontsize, dwcode)];
+
+    while(pt_entry)
+    {
+        if(pt_entry->dwcode == dwcode && pt_entry->i_fontsize == i_fontsize &&
+           pt_entry->pt_fontopr == pt_fontopr && pt_entry->i_faceid == i_faceid &&
+           pt_entry->i_rendermode == g_i_rendermode)
+            return pt_entry;
+        pt_entry = pt_entry->pt_next;
+    }
+    return NULL;
+}
+
+/*
+本线程改为引用这个缓存项，放开之前引用的（调用者持有字形缓存的锁，被引用的项不会在这期间被淘汰）
+输入参数：线程状态，缓存项
+*/
+static void glyphcache_pin(p_fontthread pt_thread, p_glyphcache_entry pt_entry)
+{
+    __atomic_add_fetch(&pt_entry->i_refs, 1, __ATOMIC_RELAXED);
+    if(pt_thread->pt_glyph)
+        __atomic_sub_fetch(&pt_thread->pt_glyph->i_refs, 1, __ATOMIC_RELEASE);
+    pt_thread->pt_glyph = pt_entry;
+}
+
+//按时间戳排序用
+static int glyphcache_cmpstamp(const void *a, const void *b)
+{
+    unsigned long long sa = (*(p_glyphcache_entry *)a)->i_stamp;
+    unsigned long long sb = (*(p_glyphcache_entry *)b)->i_stamp;
+    return (sa > sb) - (sa < sb);
+}
+
+/*
+批量淘汰最久没用的缓存项，直到总字节数不超过 i_target（调用者持有字形缓存的写锁）
+有线程引用着的项不淘汰
+输入参数：目标字节数
+*/
+static void glyphcache_evict(unsigned long i_target)
+{
+    p_glyphcache_entry *ppt_entries, *ppt_link, pt_entry;
+    unsigned int i, n = 0;
+    unsigned long long i_threshold;
+    unsigned long i_bytes = g_t_glyphcachestat.bytes;
+
+    if(i_bytes <= i_target || g_t_glyphcachestat.entries == 0)
+        return;
+    ppt_entries = malloc(g_t_glyphcachestat.entries * sizeof(p_glyphcache_entry));
+    if(!ppt_entries)
+        return;
+
+    //按时间戳排序，从最旧的开始累计，找出要淘汰的时间戳上限
+    for(i = 0; i < GLYPHCACHE_BUCKETS; i++)
+        for(pt_entry = g_apt_glyphcache[i]; pt_entry; pt_entry = pt_entry->pt_next)
+            if(!__atomic_load_n(&pt_entry->i_refs, __ATOMIC_ACQUIRE))
+                ppt_entries[n++] = pt_entry;
+    if(n == 0)
+    {
+        free(ppt_entries);
+        return;
+    }
+    qsort(ppt_entries, n, sizeof(p_glyphcache_entry), glyphcache_cmpstamp);
+    for(i = 0; i < n && i_bytes > i_target; i++)
+        i_bytes -= ppt_entries[i]->i_bytes;
+    i_threshold = ppt_entries[i - 1]->i_stamp;
+    free(ppt_entries);
+
+    //删除时间戳不大于上限的项
+    for(i = 0; i < GLYPHCACHE_BUCKETS; i++)
+    {
+        ppt_link = &g_apt_glyphcache[i];
+        while((pt_entry = *ppt_link))
+        {
+            if(pt_entry->i_stamp <= i_threshold && !__atomic_load_n(&pt_entry->i_refs, __ATOMIC_ACQUIRE))
+            {
+                *ppt_link = pt_entry->pt_next;
+                g_t_glyphcachestat.bytes -= pt_entry->i_bytes;
+                g_t_glyphcachestat.entries--;
+                g_t_glyphcachestat.evictions++;
+                free(pt_entry);
+            }
+            else
+                ppt_link = &pt_entry->pt_next;
+        }
+    }
+}
+
+/*
+把字体引擎刚生成的字形放入缓存（调用者持有字形缓存的写锁）
+位图和前进距离都换算成相对基点的值，取出时再加上新的基点
+输入参数：字体引擎，字体序号，字号，字符编码，字体引擎填好的位图数据结构体指针
+返回值：新的缓存项，不缓存时返回 NULL
+*/
+static p_glyphcache_entry glyphcache_insert(p_fontopr pt_fontopr, unsigned int i_faceid, int i_fontsize,
+                                            unsigned int dwcode, p_fontbitmap pt_fontbitmap)
+{
+    p_glyphcache_entry pt_entry;
+    unsigned int i_bmpbytes;
+    unsigned int i_bytes;
+    unsigned int i_hash;
+    int pitch = pt_fontbitmap->i_pitch;
+
+    if(pitch == 0 && pt_fontbitmap->i_pixelmode == FONT_PIXEL_MODE_GRAY)
+        pitch = pt_fontbitmap->t_region.width;
+    if(pitch < 0)
+        return NULL;//自下而上存放的位图不缓存
+    i_bmpbytes = pitch * pt_fontbitmap->t_region.height;
+    i_bytes = sizeof(glyphcache_entry) + i_bmpbytes;
+    if(i_bytes > g_t_glyphcachestat.budget / 4)
+        return NULL;//预算太小或字形太大，不值得缓存
+    if(g_t_glyphcachestat.bytes + i_bytes > g_t_glyphcachestat.budget)
+        glyphcache_evict(g_t_glyphcachestat.budget * 3 / 4);
+
+    pt_entry = malloc(i_bytes);
+    if(!pt_entry)
+        return NULL;
+    pt_entry->pt_fontopr   = pt_fontopr;
+    pt_entry->i_faceid     = i_faceid;
+    pt_entry->i_fontsize   = i_fontsize;
+    pt_entry->i_rendermode = g_i_rendermode;
+    pt_entry->dwcode       = dwcode;
+    pt_entry->i_left       = pt_fontbitmap->t_region.x - pt_fontbitmap->i_cur_originx;
+    pt_entry->i_top        = pt_fontbitmap->t_region.y - pt_fontbitmap->i_cur_originy;
+    pt_entry->i_width      = pt_fontbitmap->t_region.width;
+    pt_entry->i_height     = pt_fontbitmap->t_region.height;
+    pt_entry->i_pitch      = pitch;
+    pt_entry->i_pixelmode  = pt_fontbitmap->i_pixelmode;
+    pt_entry->i_advancex   = pt_fontbitmap->i_next_originx - pt_fontbitmap->i_cur_originx;
+    pt_entry->i_advancey   = pt_fontbitmap->i_next_originy - pt_fontbitmap->i_cur_originy;
+    pt_entry->i_refs       = 0;
+    pt_entry->i_stamp      = __atomic_add_fetch(&g_i_stamp, 1, __ATOMIC_RELAXED);
+    pt_entry->i_bytes      = i_bytes;
+    if(i_bmpbytes)
+        memcpy(pt_entry->auc_bitmap, pt_fontbitmap->puc_buffer, i_bmpbytes);
+
+    i_hash = glyphcache_hash(pt_fontopr, i_faceid, i_fontsize, dwcode);
+    pt_entry->pt_next = g_apt_glyphcache[i_hash];
+    g_apt_glyphcache[i_hash] = pt_entry;
+    g_t_glyphcachestat.bytes += i_bytes;
+    g_t_glyphcachestat.entries++;
+    return pt_entry;
+}
+
+/*
+得到字符位图（调用者持有配置读锁）
+有后备字体时先确定字符属于字体链上的哪个字体；
+再查字形缓存，命中时直接用缓存的位图，按 fontbitmap 中的基点算出位置；
+没有命中时交给字体引擎生成（不持有字形缓存的锁，几个线程可以同时光栅化），再放入缓存
+返回的 puc_buffer 只保证在本线程下一次调用 getfontbitmap 之前有效
+输入参数:线程状态，字符的 Unicode 编码，位图数据结构体指针，是否由字体引擎现场生成（可为NULL）
+*/
+static int fontbitmap_get(p_fontthread pt_thread, unsigned int dwcode, p_fontbitmap pt_fontbitmap, int *pi_rendered)
+{
+    p_glyphcache_entry pt_entry = NULL;
+    p_fontface pt_face;
+    int i_fontsize = pt_thread->i_fontsize;
+    int error;
+
+    if(!g_pt_defaultfontopr)
+        return -1;
+    pt_face = &g_at_faces[fontchain_resolve(dwcode)];
+    if(pt_face->pt_fontopr->i_nocache)
+        return fontface_getfontbitmap(pt_face, i_fontsize, dwcode, pt_fontbitmap);
+
+    pthread_rwlock_rdlock(&g_t_glyphlock);
+    if(g_t_glyphcachestat.budget)
+        pt_entry = glyphcache_lookup(pt_face->pt_fontopr, pt_face->i_faceid, i_fontsize, dwcode);
+    if(pt_entry)
+    {
+        glyphcache_pin(pt_thread, pt_entry);
+        __atomic_store_n(&pt_entry->i_stamp, __atomic_add_fetch(&g_i_stamp, 1, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+        __atomic_add_fetch(&g_t_glyphcachestat.hits, 1, __ATOMIC_RELAXED);
+    }
+    else
+        __atomic_add_fetch(&g_t_glyphcachestat.misses, 1, __ATOMIC_RELAXED);
+    pthread_rwlock_unlock(&g_t_glyphlock);
+
+    if(!pt_entry)
+    {
+        error = fontface_getfontbitmap(pt_face, i_fontsize, dwcode, pt_fontbitmap);
+        if(error)
+            return error;
+        if(pi_rendered)
+            *pi_rendered = 1;
+        if(!g_t_glyphcachestat.budget)
+            return 0;
+        pthread_rwlock_wrlock(&g_t_glyphlock);
+        //别的线程可能刚把同一个字形放进去
+        pt_entry = glyphcache_lookup(pt_face->pt_fontopr, pt_face->i_faceid, i_fontsize, dwcode);
+        if(!pt_entry)
+            pt_entry = glyphcache_insert(pt_face->pt_fontopr, pt_face->i_faceid, i_fontsize, dwcode, pt_fontbitmap);
+        if(pt_entry)
+            glyphcache_pin(pt_thread, pt_entry);
+        pthread_rwlock_unlock(&g_t_glyphlock);
+        if(!pt_entry)
+            return 0;//没有缓存，位图留在字体引擎里
+    }
 
-    error = pt_tmp->fontinit(a_fontfilename);   
+    pt_fontbitmap->t_region.x      = pt_fontbitmap->i_cur_originx + pt_entry->i_left;
+    pt_fontbitmap->t_region.y      = pt_fontbitmap->i_cur_originy + pt_entry->i_top;
+    pt_fontbitmap->t_region.width  = pt_entry->i_width;
+    pt_fontbitmap->t_region.height = pt_entry->i_height;
+    pt_fontbitmap->i_pitch         = pt_entry->i_pitch;
+    pt_fontbitmap->i_pixelmode     = pt_entry->i_pixelmode;
+    pt_fontbitmap->puc_buffer      = pt_entry->auc_bitmap;
+    pt_fontbitmap->i_next_originx  = pt_fontbitmap->i_cur_originx + pt_entry->i_advancex;
+    pt_fontbitmap->i_next_originy  = pt_fontbitmap->i_cur_originy + pt_entry->i_advancey;
+    return 0;
+}
+
+static int getfontbitmap_nolock(p_fontthread pt_thread, unsigned int dwcode ,p_fontbitmap pt_fontbitmap)
+{
+    return fontbitmap_get(pt_thread, dwcode, pt_fontbitmap, NULL);
+}
+
+/*
+设置字形缓存的内存预算（调用者持有配置写锁）
+输入参数：字节数，0 表示关闭缓存并释放所有没有线程引用的缓存项
+*/
+static int setglyphcachebudget_nolock(unsigned long i_budget)
+{
+    pthread_rwlock_wrlock(&g_t_glyphlock);
+    g_t_glyphcachestat.budget = i_budget;
+    glyphcache_evict(i_budget);
+    pthread_rwlock_unlock(&g_t_glyphlock);
+    return 0;
+}
+
+/*
+获取字形缓存统计（调用者持有配置读锁）
+命中、未命中和预热计数由各个线程原子地增加，逐项读取
+输入参数：统计结构体指针
+*/
+static int getglyphcachestat_nolock(p_glyphcachestat pt_glyphcachestat)
+{
+    pthread_mutex_lock(&g_t_metricsmutex);
+    pthread_rwlock_rdlock(&g_t_glyphlock);
+    pt_glyphcachestat->hits          = __atomic_load_n(&g_t_glyphcachestat.hits, __ATOMIC_RELAXED);
+    pt_glyphcachestat->misses        = __atomic_load_n(&g_t_glyphcachestat.misses, __ATOMIC_RELAXED);
+    pt_glyphcachestat->prewarmed     = __atomic_load_n(&g_t_glyphcachestat.prewarmed, __ATOMIC_RELAXED);
+    pt_glyphcachestat->evictions     = g_t_glyphcachestat.evictions;
+    pt_glyphcachestat->entries       = g_t_glyphcachestat.entries;
+    pt_glyphcachestat->bytes         = g_t_glyphcachestat.bytes;
+    pt_glyphcachestat->budget        = g_t_glyphcachestat.budget;
+    pt_glyphcachestat->extent_hits   = g_t_glyphcachestat.extent_hits;
+    pt_glyphcachestat->extent_misses = g_t_glyphcachestat.extent_misses;
+    pt_glyphcachestat->run_hits      = g_t_glyphcachestat.run_hits;
+    pt_glyphcachestat->run_misses    = g_t_glyphcachestat.run_misses;
+    pthread_rwlock_unlock(&g_t_glyphlock);
+    pthread_mutex_unlock(&g_t_metricsmutex);
+    return 0;
+}
+
+/*
+设置字符位图的像素格式（调用者持有配置写锁）
+单色位图每个像素只占一位，绘制时读取的字形数据只有灰度位图的 1/8
+格式在每次调用字体引擎时传入，主字体和后备字体都用同样的格式
+输入参数：FONT_PIXEL_MODE_GRAY 或 FONT_PIXEL_MODE_MONO
+*/
+static int setfontrendermode_nolock(int i_pixelmode)
+{
+    if(i_pixelmode != FONT_PIXEL_MODE_GRAY && i_pixelmode != FONT_PIXEL_MODE_MONO)
+        return -1;
+    g_i_rendermode = i_pixelmode;
+    return 0;
+}
+
+/*
+测量字符串的外框
+只用字体引擎的度量，不取字形、不光栅化；有后备字体时按所属字体分段测量
+*/
+static int measure_string(p_fontthread pt_thread, char *str, p_region_cartesian pt_regioncar)
+{
+    return fontchain_measure(pt_thread->i_fontsize, str, pt_regioncar, NULL);
+}
+
+/*
+外框缓存项是否是这个字符串在当前字体和字号下的外框（调用者持有缓存锁）
+*/
+static int extentcache_match(p_extentcache_entry pt_entry, unsigned int h, int i_fontsize, char *str)
+{
+    return pt_entry->i_hash == h && pt_entry->i_fontsize == i_fontsize && pt_entry->i_faceid == g_i_faceid &&
+           pt_entry->pt_fontopr == g_pt_defaultfontopr && strcmp(pt_entry->ac_str, str) == 0;
+}
+
+/*
+获得字符串的外框（调用者持有配置读锁）
+存放在在pt_regioncar中，单位为像素
+先查外框缓存，没有命中时再测量
+输入参数：线程状态，待计算的字符串指针，存储字符串外框的区域指针（笛卡尔坐标系显示区域）
+*/
+static int getstring_regioncar_nolock(p_fontthread pt_thread, char *str , p_region_cartesian pt_regioncar)
+{
+    p_extentcache_entry pt_entry;
+    unsigned int h = 2166136261u;
+    int i_fontsize = pt_thread->i_fontsize;
+    int len, error;
+
+    if(!g_pt_defaultfontopr)
+        return -1;
+    //FNV-1a 哈希，顺便得到长度；太长的字符串不缓存
+    for(len = 0; str[len]; len++)
+        h = (h ^ (unsigned char)str[len]) * 16777619u;
+    if(len >= EXTENTCACHE_STRMAX || !g_t_glyphcachestat.budget)
+        return measure_string(pt_thread, str, pt_regioncar);
+
+    h ^= (unsigned int)i_fontsize * 0x9E3779B1u ^ g_i_faceid * 0x85EBCA6Bu;
+    pt_entry = &g_at_extentcache[(h ^ (h >> 16)) & (EXTENTCACHE_SIZE - 1)];
+    pthread_mutex_lock(&g_t_metricsmutex);
+    if(extentcache_match(pt_entry, h, i_fontsize, str))
+    {
+        g_t_glyphcachestat.extent_hits++;
+        *pt_regioncar = pt_entry->t_regioncar;
+        pthread_mutex_unlock(&g_t_metricsmutex);
+        return 0;
+    }
+    g_t_glyphcachestat.extent_misses++;
+    pthread_mutex_unlock(&g_t_metricsmutex);
+
+    //测量要调用字体引擎，不持有缓存锁
+    error = measure_string(pt_thread, str, pt_regioncar);
+    if(error)
+        return error;
+    pthread_mutex_lock(&g_t_metricsmutex);
+    //测量期间别的线程可能已经填入了同一个字符串；否则直接映射，冲突时覆盖旧项
+    if(!extentcache_match(pt_entry, h, i_fontsize, str))
+    {
+        pt_entry->pt_fontopr  = g_pt_defaultfontopr;
+        pt_entry->i_faceid    = g_i_faceid;
+        pt_entry->i_fontsize  = i_fontsize;
+        pt_entry->i_hash      = h;
+        pt_entry->t_regioncar = *pt_regioncar;
+        memcpy(pt_entry->ac_str, str, len + 1);
+    }
+    pthread_mutex_unlock(&g_t_metricsmutex);
+    return 0;
+}
+
+/*
+从 UTF-8 字符串中取出一个字符
+非法或不完整的字节序列按单字节（Latin-1）处理，以前按字节存放的单字节文字照样能显示
+输入参数：字符串指针，存放 Unicode 编码的指针
+返回值：这个字符占用的字节数，到字符串结尾时返回0
+*/
+int utf8_getcode(char *str, unsigned int *pdwcode)
+{
+    unsigned char *puc = (unsigned char *)str;
+    unsigned int code;
+    int n, i;
+
+    *pdwcode = puc[0];
+    if(puc[0] < 0x80)
+        return puc[0] ? 1 : 0;
+    if((puc[0] & 0xE0) == 0xC0)      { code = puc[0] & 0x1F; n = 2; }
+    else if((puc[0] & 0xF0) == 0xE0) { code = puc[0] & 0x0F; n = 3; }
+    else if((puc[0] & 0xF8) == 0xF0) { code = puc[0] & 0x07; n = 4; }
+    else
+        return 1;
+    //后续字节必须是 10xxxxxx，遇到结尾的0也会在这里停下
+    for(i = 1; i < n; i++)
+    {
+        if((puc[i] & 0xC0) != 0x80)
+            return 1;
+        code = (code << 6) | (puc[i] & 0x3F);
+    }
+    //过长编码和超出 Unicode 范围的不认
+    if((n == 2 && code < 0x80) || (n == 3 && code < 0x800) || (n == 4 && (code < 0x10000 || code > 0x10FFFF)))
+        return 1;
+    *pdwcode = code;
+    return n;
+}
+
+/*
+按当前字体和本线程的字号排版一行文字
+每个字符的基点 = 上一个字符的基点 + 前进距离 + 字距调整（只在两个字符来自同一个字体时，与分段测量一致）；
+外框用 getstring_regioncar 测量（只用度量），与不排版直接测量的结果相同
+输入参数：线程状态，字符串
+返回值：新分配的排版结果（引用计数为0），失败时返回 NULL
+*/
+static p_textrun textrun_layout(p_fontthread pt_thread, char *str)
+{
+    fontbitmap t_fontbitmap;
+    p_textrun pt_run;
+    unsigned int dwcode, dwprev = 0;
+    int i_count = 0, i_pen = 0, len;
+    int iface, iprevface = -1;
+    char *p;
+
+    for(p = str; (len = utf8_getcode(p, &dwcode)) > 0; p += len)
+        i_count++;
+    pt_run = malloc(sizeof(textrun) + i_count * sizeof(textglyph));
+    if(!pt_run)
+        return NULL;
+    pt_run->i_refs = 0;
+
+    pt_run->i_count = 0;
+    for(p = str; (len = utf8_getcode(p, &dwcode)) > 0; p += len)
+    {
+        iface = fontchain_resolve(dwcode);
+        if(dwprev && iface == iprevface)
+            i_pen += fontface_kerning(&g_at_faces[iface], pt_thread->i_fontsize, dwprev, dwcode);
+        //前进距离从字形取（字形缓存命中后不再经过字体引擎），接下来绘制时正好命中
+        t_fontbitmap.i_cur_originx = i_pen;
+        t_fontbitmap.i_cur_originy = 0;
+        if(getfontbitmap_nolock(pt_thread, dwcode, &t_fontbitmap))
+        {
+            free(pt_run);
+            return NULL;
+        }
+        pt_run->at_glyphs[pt_run->i_count].dwcode = dwcode;
+        pt_run->at_glyphs[pt_run->i_count].i_x = i_pen;
+        pt_run->i_count++;
+        i_pen = t_fontbitmap.i_next_originx;
+        dwprev = dwcode;
+        iprevface = iface;
+    }
+    if(getstring_regioncar_nolock(pt_thread, str, &pt_run->t_extent))
+    {
+        free(pt_run);
+        return NULL;
+    }
+    return pt_run;
+}
+
+/*
+排版结果缓存项是否是这一行文字在当前字体、字号和位图格式下的结果（调用者持有缓存锁）
+*/
+static int textruncache_match(p_textrun_entry pt_entry, unsigned int h, int i_fontsize, char *str)
+{
+    return pt_entry->pt_run && pt_entry->i_hash == h && pt_entry->i_fontsize == i_fontsize &&
+           pt_entry->i_faceid == g_i_faceid && pt_entry->i_rendermode == g_i_rendermode &&
+           pt_entry->pt_fontopr == g_pt_defaultfontopr && strcmp(pt_entry->ac_str, str) == 0;
+}
+
+/*
+获得排好版的一行文字，并为调用者增加一个引用（用完调用 textrun_release）
+先查排版结果缓存，没有命中时按当前字体和本线程的字号排版；字符串或字号变化后才会重新排版
+输入参数：线程状态，UTF-8 字符串
+返回值：排好版的一行文字，失败时返回 NULL
+*/
+static p_textrun textrun_get(p_fontthread pt_thread, char *str)
+{
+    p_textrun_entry pt_entry;
+    p_textrun pt_run, pt_old;
+    unsigned int h = 2166136261u;
+    int i_fontsize = pt_thread->i_fontsize;
+    int len;
+
+    for(len = 0; str[len]; len++)
+        h = (h ^ (unsigned char)str[len]) * 16777619u;
+    if(len >= EXTENTCACHE_STRMAX || !g_t_glyphcachestat.budget)
+    {
+        //不能缓存的字符串：只有调用者引用，用完就释放
+        pt_run = textrun_layout(pt_thread, str);
+        if(pt_run)
+            pt_run->i_refs = 1;
+        return pt_run;
+    }
+
+    h ^= (unsigned int)i_fontsize * 0x9E3779B1u ^ (g_i_faceid << 1 | g_i_rendermode) * 0x85EBCA6Bu;
+    pt_entry = &g_at_textruncache[(h ^ (h >> 16)) & (TEXTRUN_CACHE_SIZE - 1)];
+    pthread_mutex_lock(&g_t_metricsmutex);
+    if(textruncache_match(pt_entry, h, i_fontsize, str))
+    {
+        g_t_glyphcachestat.run_hits++;
+        pt_run = pt_entry->pt_run;
+        __atomic_add_fetch(&pt_run->i_refs, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&g_t_metricsmutex);
+        return pt_run;
+    }
+    g_t_glyphcachestat.run_misses++;
+    pthread_mutex_unlock(&g_t_metricsmutex);
+
+    //排版要取字形（未命中时光栅化），不持有缓存锁
+    pt_run = textrun_layout(pt_thread, str);
+    if(!pt_run)
+        return NULL;
+    pthread_mutex_lock(&g_t_metricsmutex);
+    if(textruncache_match(pt_entry, h, i_fontsize, str))
+    {
+        //排版期间别的线程已经填入了同一行文字：用缓存中的，丢掉自己的
+        free(pt_run);
+        pt_run = pt_entry->pt_run;
+        __atomic_add_fetch(&pt_run->i_refs, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&g_t_metricsmutex);
+        return pt_run;
+    }
+    pt_run->i_refs = 2;//缓存和调用者各一个
+    pt_old = pt_entry->pt_run;
+    pt_entry->pt_run       = pt_run;
+    pt_entry->pt_fontopr   = g_pt_defaultfontopr;
+    pt_entry->i_faceid     = g_i_faceid;
+    pt_entry->i_fontsize   = i_fontsize;
+    pt_entry->i_rendermode = g_i_rendermode;
+    pt_entry->i_hash       = h;
+    memcpy(pt_entry->ac_str, str, len + 1);
+    pthread_mutex_unlock(&g_t_metricsmutex);
+    //被覆盖的旧结果可能还有线程在用，最后一个引用放开时才释放
+    textrun_release(pt_old);
+    return pt_run;
+}
+
+/*
+获得排好版的一行文字（调用者持有配置读锁）
+返回的 textrun 由本线程引用着，在本线程下一次调用 gettextrun 之前有效
+输入参数：线程状态，UTF-8 字符串
+返回值：排好版的一行文字，失败时返回 NULL
+*/
+static p_textrun gettextrun_nolock(p_fontthread pt_thread, char *str)
+{
+    p_textrun pt_run;
+
+    if(!g_pt_defaultfontopr)
+        return NULL;
+    pt_run = textrun_get(pt_thread, str);
+    if(!pt_run)
+        return NULL;
+    textrun_release(pt_thread->pt_run);
+    pt_thread->pt_run = pt_run;
+    return pt_run;
+}
+
+/*
+字号是否能放进区域：设计单位外框按 字号/units_per_EM 缩放，再加上微调可能多出的像素
+*/
+static int fontfit_fits(p_region_cartesian pt_units, int i_unitsperem, int i_size, int i_width, int i_height)
+{
+    long long w = ((long long)pt_units->width  * i_size + i_unitsperem - 1) / i_unitsperem + FONTFIT_HINT_MARGIN;
+    long long h = ((long long)pt_units->height * i_size + i_unitsperem - 1) / i_unitsperem + FONTFIT_HINT_MARGIN;
+    return w <= i_width && h <= i_height;
+}
+
+/*
+求字号：二分查找能放进区域的最大字号
+字体链上的字体都提供设计单位外框时只做整数运算；否则逐个字号只用度量测量（不取字形，之后恢复本线程原来的字号）
+引擎只能直接提供某些字号（如图集）时，再向下对齐到这些字号
+输入参数：线程状态，字符串，区域宽度，区域高度
+返回值：字号，至少为 FONTFIT_MIN_SIZE
+*/
+static int fontfit_solve(p_fontthread pt_thread, char *str, int i_width, int i_height)
+{
+    region_cartesian t_units, t_regioncar;
+    int i_unitsperem;
+    int lo = FONTFIT_MIN_SIZE, hi = FONTFIT_MAX_SIZE, mid;
+    int i_oldsize = pt_thread->i_fontsize;
+    int use_units;
+
+    if(!str[0])
+        return i_height < FONTFIT_MIN_SIZE ? FONTFIT_MIN_SIZE : (i_height > FONTFIT_MAX_SIZE ? FONTFIT_MAX_SIZE : i_height);
+
+    //有后备字体时各段的设计单位外框换算到同一个 units_per_EM 后合并
+    use_units = !fontchain_measure(0, str, &t_units, &i_unitsperem);
+
+    //不变式：lo 能放下（或已是最小字号），hi+1 放不下
+    while(lo < hi)
+    {
+        mid = (lo + hi + 1) / 2;
+        if(use_units)
+        {
+            if(fontfit_fits(&t_units, i_unitsperem, mid, i_width, i_height))
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        else
+        {
+            setfontsize_nolock(pt_thread, mid);
+            if(!getstring_regioncar_nolock(pt_thread, str, &t_regioncar) &&
+               t_regioncar.width <= i_width && t_regioncar.height <= i_height)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+    }
+    pt_thread->i_fontsize = i_oldsize;
+    if(g_pt_defaultfontopr->snapsize)
+        lo = g_pt_defaultfontopr->snapsize(lo);
+    return lo;
+}
+
+/*
+在字号求解缓存的一组中查找（调用者持有缓存锁）
+返回值：找到的项，没有时返回 NULL
+*/
+static p_fontfit_entry fontfitcache_find(p_fontfit_entry pt_set, unsigned int h, int i_width, int i_height, char *str)
+{
+    int i;
+
+    for(i = 0; i < FONTFIT_CACHE_WAYS; i++)
+    {
+        if(pt_set[i].i_hash == h && pt_set[i].i_width == i_width && pt_set[i].i_height == i_height &&
+           pt_set[i].i_faceid == g_i_faceid && pt_set[i].pt_fontopr == g_pt_defaultfontopr &&
+           strcmp(pt_set[i].ac_str, str) == 0)
+            return &pt_set[i];
+    }
+    return NULL;
+}
+
+/*
+获得能把字符串放进区域的最大字号（调用者持有配置读锁）
+结果按（字符串、区域宽高）缓存，几百个按钮布局一次只需要微秒级
+输入参数：线程状态，字符串，区域宽度，区域高度（调用者可以先按美观需要缩小区域）
+返回值：字号
+*/
+static int getfontsize_forregion_nolock(p_fontthread pt_thread, char *str, int i_width, int i_height)
+{
+    p_fontfit_entry pt_set, pt_entry;
+    unsigned int h = 2166136261u;
+    unsigned int i_set;
+    int len, i_fontsize;
+
+    if(!g_pt_defaultfontopr)
+        return -1;
+    for(len = 0; str[len]; len++)
+        h = (h ^ (unsigned char)str[len]) * 16777619u;
+    if(len >= EXTENTCACHE_STRMAX)
+        return fontfit_solve(pt_thread, str, i_width, i_height);
+
+    h ^= (unsigned int)i_width * 0x9E3779B1u ^ (unsigned int)i_height * 0x85EBCA6Bu ^ g_i_faceid * 0xC2B2AE35u;
+    i_set = (h ^ (h >> 16)) & (FONTFIT_CACHE_SETS - 1);
+    pt_set = g_at_fontfitcache[i_set];
+    pthread_mutex_lock(&g_t_metricsmutex);
+    pt_entry = fontfitcache_find(pt_set, h, i_width, i_height, str);
+    if(pt_entry)
+    {
+        i_fontsize = pt_entry->i_fontsize;
+        pthread_mutex_unlock(&g_t_metricsmutex);
+        return i_fontsize;
+    }
+    pthread_mutex_unlock(&g_t_metricsmutex);
+
+    //求解要测量外框（调用字体引擎），不持有缓存锁
+    i_fontsize = fontfit_solve(pt_thread, str, i_width, i_height);
+    pthread_mutex_lock(&g_t_metricsmutex);
+    //求解期间别的线程可能已经填入了同一项，不再占用另一路
+    if(fontfitcache_find(pt_set, h, i_width, i_height, str))
+    {
+        pthread_mutex_unlock(&g_t_metricsmutex);
+        return i_fontsize;
+    }
+    pt_entry = &pt_set[g_auc_fontfitvictim[i_set]];
+    g_auc_fontfitvictim[i_set] = (g_auc_fontfitvictim[i_set] + 1) % FONTFIT_CACHE_WAYS;
+    pt_entry->pt_fontopr = g_pt_defaultfontopr;
+    pt_entry->i_faceid   = g_i_faceid;
+    pt_entry->i_width    = i_width;
+    pt_entry->i_height   = i_height;
+    pt_entry->i_hash     = h;
+    pt_entry->i_fontsize = i_fontsize;
+    memcpy(pt_entry->ac_str, str, len + 1);
+    pthread_mutex_unlock(&g_t_metricsmutex);
+    return i_fontsize;
+}
+
+/*
+在指定字号下预热一个字形（调用者持有配置读锁）
+预热线程有自己的当前字号，不影响界面线程
+输入参数：线程状态，字符编码，字号
+返回值：0 成功，-1 缓存已到淘汰线或失败
+*/
+static int prewarm_glyph(p_fontthread pt_thread, unsigned int dwcode, int i_fontsize)
+{
+    fontbitmap t_fontbitmap;
+    int i_rendered = 0;
+    int i_full;
+    int error;
+
+    if(!g_pt_defaultfontopr || !g_t_glyphcachestat.budget)
+        return -1;
+    pthread_rwlock_rdlock(&g_t_glyphlock);
+    i_full = g_t_glyphcachestat.bytes >= g_t_glyphcachestat.budget * 3 / 4;
+    pthread_rwlock_unlock(&g_t_glyphlock);
+    if(i_full)
+        return -1;
+    setfontsize_nolock(pt_thread, i_fontsize);
+    t_fontbitmap.i_cur_originx = 0;
+    t_fontbitmap.i_cur_originy = 0;
+    error = fontbitmap_get(pt_thread, dwcode, &t_fontbitmap, &i_rendered);
+    if(!error && i_rendered)
+        __atomic_add_fetch(&g_t_glyphcachestat.prewarmed, 1, __ATOMIC_RELAXED);
     return error;
-} 
+}
 
 /*
-设置字体大小
-输入参数：字体大小
+预热一个字符串：逐个字形预热，每个字形之间放开配置读锁，改配置不用等整个字符串
+界面线程取字形不等预热线程：只有都没命中的同一个字形插入缓存时才短暂互斥
 */
-int setfontsize(int i_fontsize)
+static void prewarm_string(p_fontthread pt_thread, char *str, int i_fontsize)
+{
+    unsigned int dwcode;
+    int len, error = 0;
+    char *p;
+
+    for(p = str; !error && (len = utf8_getcode(p, &dwcode)) > 0; p += len)
+    {
+        pthread_rwlock_rdlock(&g_t_configlock);
+        error = prewarm_glyph(pt_thread, dwcode, i_fontsize);
+        pthread_rwlock_unlock(&g_t_configlock);
+        sched_yield();
+    }
+}
+
+/*
+预热线程：取出队列中的字符串逐个预热，队列空时等待
+调度策略设为 SCHED_IDLE（不支持时 nice 19），只用其他线程不用的 CPU 时间
+*/
+static void *prewarm_thread_func(void *data)
+{
+    struct sched_param t_param = {0};
+    p_prewarm_item pt_item;
+    p_fontthread pt_thread;
+
+#ifdef SCHED_IDLE
+    if(pthread_setschedparam(pthread_self(), SCHED_IDLE, &t_param))
+#endif
+        setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+    (void)t_param;
+
+    while(1)
+    {
+        pthread_mutex_lock(&g_t_prewarmmutex);
+        while(!g_pt_prewarmhead)
+            pthread_cond_wait(&g_t_prewarmvar, &g_t_prewarmmutex);
+        pt_item = g_pt_prewarmhead;
+        g_pt_prewarmhead = pt_item->pt_next;
+        if(!g_pt_prewarmhead)
+            g_pt_prewarmtail = NULL;
+        pthread_mutex_unlock(&g_t_prewarmmutex);
+
+        pt_thread = fontthread_get();
+        if(pt_thread)
+            prewarm_string(pt_thread, pt_item->ac_str, pt_item->i_fontsize);
+        free(pt_item);
+    }
+    return NULL;
+}
+
+/*
+把一个字符串交给后台线程预热，立即返回
+第一次调用时创建预热线程
+输入参数：UTF-8 字符串（会被复制），字号
+*/
+int prewarmfont(char *str, int i_fontsize)
 {
-    return  g_pt_defaultfontopr->setfontsize(i_fontsize);
+    p_prewarm_item pt_item;
+    pthread_t tid;
+    int len = strlen(str);
+
+    if(i_fontsize <= 0 || len == 0)
+        return -1;
+    pt_item = malloc(sizeof(prewarm_item) + len + 1);
+    if(!pt_item)
+        return -1;
+    pt_item->i_fontsize = i_fontsize;
+    pt_item->pt_next = NULL;
+    memcpy(pt_item->ac_str, str, len + 1);
+
+    pthread_mutex_lock(&g_t_prewarmmutex);
+    if(!g_i_prewarmstarted)
+    {
+        if(pthread_create(&tid, NULL, prewarm_thread_func, NULL))
+        {
+            pthread_mutex_unlock(&g_t_prewarmmutex);
+            free(pt_item);
+            return -1;
+        }
+        pthread_detach(tid);
+        g_i_prewarmstarted = 1;
+    }
+    if(g_pt_prewarmtail)
+        g_pt_prewarmtail->pt_next = pt_item;
+    else
+        g_pt_prewarmhead = pt_item;
+    g_pt_prewarmtail = pt_item;
+    pthread_cond_signal(&g_t_prewarmvar);
+    pthread_mutex_unlock(&g_t_prewarmmutex);
+    return 0;
 }
 
 /*
-得到字符位图
-输入参数:字符的 Unicode 编码（如 0x4E2D 表示 “中”），位图数据结构体指针
+对外接口
+改配置的接口持有配置写锁；取字形、测量、排版的接口持有配置读锁，几个线程可以同时进行；
+设置字号只改本线程的状态，不加锁
 */
+int selectandinitfont(char *a_fontoprname ,char *a_fontfilename)
+{
+    int ret;
+    pthread_once(&g_t_fontonce, font_once);
+    pthread_rwlock_wrlock(&g_t_configlock);
+    ret = selectandinitfont_nolock(a_fontoprname, a_fontfilename);
+    pthread_rwlock_unlock(&g_t_configlock);
+    return ret;
+}
+
+int addfallbackfont(char *a_fontoprname ,char *a_fontfilename)
+{
+    int ret;
+    pthread_once(&g_t_fontonce, font_once);
+    pthread_rwlock_wrlock(&g_t_configlock);
+    ret = addfallbackfont_nolock(a_fontoprname, a_fontfilename);
+    pthread_rwlock_unlock(&g_t_configlock);
+    return ret;
+}
+
+int setfontsize(int i_fontsize)
+{
+    p_fontthread pt_thread = fontthread_get();
+
+    return pt_thread ? setfontsize_nolock(pt_thread, i_fontsize) : -1;
+}
+
 int getfontbitmap(unsigned int dwcode ,p_fontbitmap pt_fontbitmap)
 {
-    return g_pt_defaultfontopr->getfontbitmap(dwcode,pt_fontbitmap);
+    p_fontthread pt_thread = fontthread_get();
+    int ret;
+
+    if(!pt_thread)
+        return -1;
+    pthread_rwlock_rdlock(&g_t_configlock);
+    ret = getfontbitmap_nolock(pt_thread, dwcode, pt_fontbitmap);
+    pthread_rwlock_unlock(&g_t_configlock);
+    return ret;
+}
+
+int setglyphcachebudget(unsigned long i_budget)
+{
+    int ret;
+    pthread_rwlock_wrlock(&g_t_configlock);
+    ret = setglyphcachebudget_nolock(i_budget);
+    pthread_rwlock_unlock(&g_t_configlock);
+    return ret;
+}
+
+int getglyphcachestat(p_glyphcachestat pt_glyphcachestat)
+{
+    int ret;
+    pthread_once(&g_t_fontonce, font_once);
+    pthread_rwlock_rdlock(&g_t_configlock);
+    ret = getglyphcachestat_nolock(pt_glyphcachestat);
+    pthread_rwlock_unlock(&g_t_configlock);
+    return ret;
 }
 
 /*
-获得字符串的外框
-存放在在pt_regioncar中
-输入参数：待计算的字符串指针，存储字符串外框的区域指针（笛卡尔坐标系显示区域）
+获取字体引擎的内存统计（如 FreeType 内存池的分配次数、峰值）
+不需要配置锁：引擎自己保证统计可以在任何线程读取
+输入参数：字体引擎名称，统计结构体指针
+返回值：引擎不存在或不提供内存统计时返回 -1
 */
+int getfontmemstat(char *a_fontoprname, p_fontmemstat pt_fontmemstat)
+{
+    p_fontopr pt_fontopr = getfontopr(a_fontoprname);
+
+    if(!pt_fontopr || !pt_fontopr->getmemstat)
+        return -1;
+    return pt_fontopr->getmemstat(pt_fontmemstat);
+}
+
+int setfontrendermode(int i_pixelmode)
+{
+    int ret = -1;
+    pthread_rwlock_wrlock(&g_t_configlock);
+    if(g_pt_defaultfontopr)
+        ret = setfontrendermode_nolock(i_pixelmode);
+    pthread_rwlock_unlock(&g_t_configlock);
+    return ret;
+}
+
 int getstring_regioncar(char *str , p_region_cartesian pt_regioncar)
 {
-    return g_pt_defaultfontopr->getstring_regioncar(str, pt_regioncar);
+    p_fontthread pt_thread = fontthread_get();
+    int ret;
+
+    if(!pt_thread)
+        return -1;
+    pthread_rwlock_rdlock(&g_t_configlock);
+    ret = getstring_regioncar_nolock(pt_thread, str, pt_regioncar);
+    pthread_rwlock_unlock(&g_t_configlock);
+    return ret;
 }
 
+p_textrun gettextrun(char *str)
+{
+    p_fontthread pt_thread = fontthread_get();
+    p_textrun ret;
+
+    if(!pt_thread)
+        return NULL;
+    pthread_rwlock_rdlock(&g_t_configlock);
+    ret = gettextrun_nolock(pt_thread, str);
+    pthread_rwlock_unlock(&g_t_configlock);
+    return ret;
+}
+
+int getfontsize_forregion(char *str, int i_width, int i_height)
+{
+    p_fontthread pt_thread = fontthread_get();
+    int ret;
+
+    if(!pt_thread)
+        return -1;
+    pthread_rwlock_rdlock(&g_t_configlock);
+    ret = getfontsize_forregion_nolock(pt_thread, str, i_width, i_height);
+    pthread_rwlock_unlock(&g_t_configlock);
+    return ret;
+}
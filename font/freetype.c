@@ -2,14 +2,14 @@
 结合项目架构，该文件属于字体库实现层也就是底层驱动/硬件抽象层，该文件是FreeType 字体库的封装实现
 核心目标是 “将 FreeType 库的复杂操作抽象为标准化接口”，供上层字体管理系统使用，具体设计思路体现在 3 个方面：
 1. 封装 FreeType 细节，简化上层使用
-FreeType 库函数复杂（如 FT_Init_FreeType、FT_Load_Char 等），本模块通过 freetype_fontinit、freetype_getfontbitmap 等函数封装，上层无需了解 FreeType 内部机制；
+FreeType 库函数复杂（如 FT_Init_FreeType、FT_Load_Char 等），本模块通过 freetype_fontinit、freetype_getfontbitmap_r 等函数封装，上层无需了解 FreeType 内部机制；
 处理单位转换（1/64 像素 → 像素）和坐标系差异（FreeType y 轴向上 → 屏幕 y 轴向下），避免上层重复处理。
 2. 实现字体管理抽象层接口，支持多字体库兼容
 通过 g_t_freetypeopr 结构体实现 fontopr 接口，与其他字体库（如 ASCII 点阵字体）保持统一，上层可通过 “名称选择” 动态切换字体库；
 提供完整的字体操作流程（初始化→设置大小→获取位图→计算字符串外框），满足上层文本显示的所有需求。
 3. 支持文本布局，为上层排版提供基础
-freetype_getstring_regioncar 计算字符串外框，支持居中、换行等排版功能；
-freetype_getfontbitmap 生成字符位图数据。
+freetype_getstring_regioncar_r 计算字符串外框，支持居中、换行等排版功能；
+freetype_getfontbitmap_r 生成字符位图数据。
 
 
 */
@@ -24,6 +24,8 @@ freetype_getfontbitmap 生成字符位图数据。
 #include <fcntl.h>      // 文件操作（打开字体文件用 O_RDONLY 等标志）
 #include <stdio.h>      // 标准输入输出（调试打印错误信息）
 #include <string.h>     // 字符串操作（strlen 计算字符串长度）
+#include <stdlib.h>     // 内存分配（线程实例、字号对象表）
+#include <pthread.h>    // 线程实例（pthread_key）
 #include <math.h>       // 数学运算（未显式用，为坐标计算兜底）
 #include <wchar.h>      // 宽字符支持（处理 Unicode 编码）
 #include <sys/ioctl.h>  // I/O 控制（未显式用，为设备交互兜底）
@@ -31,98 +33,302 @@ freetype_getfontbitmap 生成字符位图数据。
 #include <ft2build.h>   // FreeType 库编译配置（必须放在 FT_FREETYPE_H 前）
 #include FT_FREETYPE_H  // FreeType 核心头文件（字体加载、渲染等函数）
 #include FT_GLYPH_H     // FreeType 字形操作（获取字符边界框等）
+#include FT_SIZES_H     // FreeType 多字号对象（FT_New_Size、FT_Activate_Size）
+#include FT_MODULE_H    // 自定义内存分配器（FT_New_Library、FT_Add_Default_Modules）
 
 #include <font_manager.h>
+#include <ft_memory.h>
 
 
 
-//freetype库应用：定义静态全局变量g_tface，后续生成的FT_Face对象表示字体文件的核心结构
-//g_tface包含字体的所有信息
-static FT_Face g_tface;
+/*
+线程实例
+FreeType 的 FT_Library、FT_Face 和字形槽都不能被几个线程同时使用，以前只有一个全局的当前字体，所有文字只能在一个线程里光栅化。
+这里字体文件只记录路径（所有线程共用，打开后不再改变），每个线程第一次用到时各自 FT_Init_FreeType、FT_New_Face；
+字号、位图格式都由调用者通过 fontstate 显式传入，每个线程为每个字体按像素大小缓存 FT_Size，缩放只在创建时计算一次。
+每个线程的库用 FT_New_Library 创建，带一个自己的 FT_Memory（ft_memory.c 的池），渲染时 FreeType 的临时内存不再走 malloc/free。
+fontinit/newface 由字体管理层在改配置时调用（此时没有线程在渲染），fontinit 之后各线程的实例在下一次使用时重建。
+*/
+#define FT_FACE_MAX 16   //字体文件数上限：0 号是 fontinit 打开的主字体，其余是 newface 打开的后备字体
+#define FT_SIZE_MAX 512  //每个线程每个字体缓存字号对象的最大像素大小，更大的字号用 face 自带的字号对象
 
-static int g_iDefaultFontSize = 12;//初始字体大小
+typedef struct ftface
+{
+    int i_index;    //在 g_at_faces 中的序号，也是线程实例中 FT_Face 的序号
+    char *pc_path;  //字体文件路径，NULL 表示空项
+}ftface,*p_ftface;
+
+typedef struct ftthread
+{
+    unsigned int i_generation;          //建立实例时的 fontinit 次数
+    FT_Memory t_memory;                 //本线程库的内存分配器
+    FT_Library t_library;
+    FT_Face at_faces[FT_FACE_MAX];      //本线程打开的字体，第一次用到时打开
+    FT_Size at_defaultsize[FT_FACE_MAX];//face 自带的字号对象
+    FT_Size *apt_sizes[FT_FACE_MAX];    //每个字体的字号对象表，下标为像素大小
+}ftthread,*p_ftthread;
+
+static ftface g_at_faces[FT_FACE_MAX];
+static unsigned int g_i_generation = 0;
+static pthread_mutex_t g_t_facemutex = PTHREAD_MUTEX_INITIALIZER;//保护 g_at_faces 的增加
+static pthread_key_t g_t_threadkey;
+static pthread_once_t g_t_threadonce = PTHREAD_ONCE_INIT;
 
 /*
-设备初始化，得到face对象g_tface，并设置初始字体大小
-输入参数:字体文件路径（如 "/usr/share/fonts/simhei.ttf"）
+释放线程实例（线程退出或 fontinit 之后重建时）
+FT_Done_Library 会一起释放这个库打开的 face 和字号对象，之后再释放它的内存池
 */
-static int freetype_fontinit(char *afinename)
+static void ftthread_clear(p_ftthread pt_thread)
 {
-    FT_library   library;//freetype库应用：定义freetype库实例句柄
-    int error;
-    //1、freetype库应用：初始化 freetype 库
-    error = FT_Init_FreeType(&library);
-    if(error)
+    int i;
+
+    if(pt_thread->t_library)
+        FT_Done_Library(pt_thread->t_library);
+    ftmemory_done(pt_thread->t_memory);
+    for(i = 0; i < FT_FACE_MAX; i++)
+        free(pt_thread->apt_sizes[i]);
+    memset(pt_thread, 0, sizeof(ftthread));
+}
+
+/*
+用本线程自己的内存池创建库，相当于带自定义分配器的 FT_Init_FreeType
+返回值：成功返回0
+*/
+static int ftthread_newlibrary(p_ftthread pt_thread)
+{
+    if(!pt_thread->t_memory)
+        pt_thread->t_memory = ftmemory_new();
+    if(!pt_thread->t_memory || FT_New_Library(pt_thread->t_memory, &pt_thread->t_library))
     {
-        printf("FT_Init_FreeType err\n");
+        printf("FT_New_Library err\n");
+        pt_thread->t_library = NULL;
         return -1;
     }
-    
-    //2、freetype库应用：加载字体文件，得到一个face
-    //参数：library（库实例）、afinename（字体文件路径）、0（字体索引，多字体文件用）、
-    //&g_tface（输出face对象）
-    error = FT_New_Face(library,afinename,0,&g_tface);
-    if(error)
+    FT_Add_Default_Modules(pt_thread->t_library);
+    FT_Set_Default_Properties(pt_thread->t_library);
+    return 0;
+}
+
+static void ftthread_free(void *data)
+{
+    ftthread_clear(data);
+    free(data);
+}
+
+static void ftthread_keyinit(void)
+{
+    pthread_key_create(&g_t_threadkey, ftthread_free);
+}
+
+/*
+获得本线程的字体对象，并激活指定字号
+输入参数：字体序号，像素大小（0 表示不改变字号，只用设计单位或 cmap 时）
+返回值：FT_Face，字体打不开时返回 NULL
+*/
+static FT_Face ftthread_face(int i_index, int i_fontsize)
+{
+    p_ftthread pt_thread;
+    FT_Face t_face;
+    FT_Size *pt_size;
+
+    pthread_once(&g_t_threadonce, ftthread_keyinit);
+    pt_thread = pthread_getspecific(g_t_threadkey);
+    if(!pt_thread)
+    {
+        pt_thread = calloc(1, sizeof(ftthread));
+        if(!pt_thread)
+            return NULL;
+        pthread_setspecific(g_t_threadkey, pt_thread);
+        pt_thread->i_generation = g_i_generation;
+    }
+    if(pt_thread->i_generation != g_i_generation)
+    {
+        ftthread_clear(pt_thread);
+        pt_thread->i_generation = g_i_generation;
+    }
+    if(!pt_thread->t_library && ftthread_newlibrary(pt_thread))
+        return NULL;
+
+    t_face = pt_thread->at_faces[i_index];
+    if(!t_face)
+    {
+        if(!g_at_faces[i_index].pc_path)
+            return NULL;
+        if(FT_New_Face(pt_thread->t_library, g_at_faces[i_index].pc_path, 0, &t_face))
+        {
+            printf("FT_New_Face err\n");
+            return NULL;
+        }
+        pt_thread->at_faces[i_index] = t_face;
+        pt_thread->at_defaultsize[i_index] = t_face->size;
+    }
+
+    if(i_fontsize <= 0)
+        return t_face;
+    if(i_fontsize > FT_SIZE_MAX)
+    {
+        FT_Activate_Size(pt_thread->at_defaultsize[i_index]);
+        if(t_face->size->metrics.x_ppem != i_fontsize)
+            FT_Set_Pixel_Sizes(t_face, i_fontsize, 0);
+        return t_face;
+    }
+    if(!pt_thread->apt_sizes[i_index])
     {
-        printf("FT_New_Face err\n");
+        pt_thread->apt_sizes[i_index] = calloc(FT_SIZE_MAX + 1, sizeof(FT_Size));
+        if(!pt_thread->apt_sizes[i_index])
+            return NULL;
+    }
+    pt_size = &pt_thread->apt_sizes[i_index][i_fontsize];
+    if(!*pt_size)
+    {
+        //第一次用到这个字号：创建字号对象并计算缩放
+        if(FT_New_Size(t_face, pt_size))
+        {
+            *pt_size = NULL;
+            return NULL;
+        }
+        FT_Activate_Size(*pt_size);
+        FT_Set_Pixel_Sizes(t_face, i_fontsize, 0);
+    }
+    else if(t_face->size != *pt_size)
+        FT_Activate_Size(*pt_size);
+    return t_face;
+}
+
+//fontstate 中的字体对象对应的序号
+static int freetype_faceindex(p_fontstate pt_state)
+{
+    return pt_state->p_engineface ? ((p_ftface)pt_state->p_engineface)->i_index : 0;
+}
+
+/*
+设备初始化，记录主字体文件，并在当前线程打开一次检查能否使用
+其他线程的实例在下一次使用时按新字体重建
+输入参数:字体文件路径（如 "/usr/share/fonts/simhei.ttf"）
+*/
+static int freetype_fontinit(char *afinename)
+{
+    char *pc_path = strdup(afinename);
+
+    if(!pc_path)
+        return -1;
+    pthread_mutex_lock(&g_t_facemutex);
+    free(g_at_faces[0].pc_path);
+    g_at_faces[0].i_index = 0;
+    g_at_faces[0].pc_path = pc_path;
+    g_i_generation++;
+    pthread_mutex_unlock(&g_t_facemutex);
+
+    if(!ftthread_face(0, 0))
+    {
+        pthread_mutex_lock(&g_t_facemutex);
+        free(g_at_faces[0].pc_path);
+        g_at_faces[0].pc_path = NULL;
+        pthread_mutex_unlock(&g_t_facemutex);
         return -1;
     }
-    //设置字体大小
-    // 参数：face对象、宽度（像素）、高度（0表示与宽度等比例）
-    FT_Set_Pixel_Sizes(g_tface,g_iDefaultFontSize,0);
     return 0;
 }
 
 /*
-修改字体大小（长宽相等）
-参数：字体大小
+打开一个后备字体文件，不影响主字体
+同一个文件只占一个序号，重新加载配置时不会把序号用完
+输入参数:字体文件路径
+返回值：字体对象，失败返回 NULL
+*/
+static void *freetype_newface(char *afinename)
+{
+    p_ftface pt_face = NULL;
+    int i;
+
+    pthread_mutex_lock(&g_t_facemutex);
+    for(i = 1; i < FT_FACE_MAX; i++)
+    {
+        if(g_at_faces[i].pc_path && strcmp(g_at_faces[i].pc_path, afinename) == 0)
+        {
+            pt_face = &g_at_faces[i];
+            break;
+        }
+        if(!pt_face && !g_at_faces[i].pc_path)
+            pt_face = &g_at_faces[i];
+    }
+    if(pt_face && !pt_face->pc_path)
+    {
+        pt_face->i_index = pt_face - g_at_faces;
+        pt_face->pc_path = strdup(afinename);
+        if(!pt_face->pc_path)
+            pt_face = NULL;
+    }
+    pthread_mutex_unlock(&g_t_facemutex);
+
+    if(!pt_face || !ftthread_face(pt_face->i_index, 0))
+        return NULL;
+    return pt_face;
+}
+
+/*
+字体是否有这个字符（cmap 中有对应的字形）
+参数：字体对象（NULL 表示主字体），字符的 Unicode 编码
 */
-static int freetype_setfontsize(int ifontsize)
+static int freetype_hascode(void *p_engineface, unsigned int dwcode)
 {
-    FT_Set_Pixel_Sizes(g_tface,ifontsize,0);//freetype库应用：设置字体大小
+    FT_Face t_face = ftthread_face(p_engineface ? ((p_ftface)p_engineface)->i_index : 0, 0);
+
+    return t_face && FT_Get_Char_Index(t_face, dwcode) != 0;
+}
+
+/*
+获得 FreeType 的内存统计（所有线程实例的内存池）
+输入参数：统计结构体指针
+*/
+static int freetype_getmemstat(p_fontmemstat pt_fontmemstat)
+{
+    ftmemory_getstat(pt_fontmemstat);
     return 0;
 }
 
 /*
 字符位图获取函数（字体渲染核心）
 根据字符的 Unicode 编码（dwcode），从fontbitmap结构体中定义的基点开始生成该字符的位图数据，并填充剩余其他数据到fontbitmap结构体中
-输入参数：字符的 Unicode 编码（要显示的字符串，要逐个输入）,上报数据的结构体
+基点直接加到位图偏移上，不再通过 FT_Set_Transform 把笔位置交给 FreeType
+位图在本线程的字形槽中，本线程下一次调用本引擎之前有效
+输入参数：字体状态（字体、字号、位图格式），字符的 Unicode 编码（要显示的字符串，要逐个输入）,上报数据的结构体
 */
-static int freetype_getfontbitmap(unsigned int dwcode,p_fontbitmap pt_fontbitmap)
+static int freetype_getfontbitmap_r(p_fontstate pt_state, unsigned int dwcode, p_fontbitmap pt_fontbitmap)
 {
     int error;
-    FT_Vector   pen; // freetype库应用：笔位置（字符绘制的基点，单位：1/64像素）
-    FT_Glyph    glyph; // freetype库应用：字形对象（未实际使用，可能是预留）
-    FT_GlphSlot slot = g_tface->glyph; // freetype库应用：字形槽：存储当前加载的字符信息
-
-    // 1. 设置笔的初始位置（转换为FreeType的单位：1/64像素）
-    pen.x = pt_fontbitmap->i_cur_originx *64;// x方向基点单位：1/64像素
-    pen.y = pt_fontbitmap->i_cur_originy *64;// y方向基点单位：1/64像素
-
-    // 2. 设置字形变换
-    // 参数：face对象、变换矩阵（0表示无变换）、笔位置（决定字符绘制的起点）
-    FT_Set_Transform(g_tface,0,&pen);
-
-    // 3. 加载字符并渲染为位图
-    //根据 Unicode 编码加载字符，并通过FT_LOAD_RENDER标志直接生成直接生成 8 位灰度位图（存储在slot->bitmap中）。
-    // 参数：face对象、Unicode编码、渲染标志（FT_LOAD_RENDER表示直接生成八位灰度位图）
-    error = FT_Load_Char(g_tface,dwcode,FT_LOAD_RENDER);
+    FT_Int32 load_flags = FT_LOAD_RENDER;
+    FT_Face t_face = ftthread_face(freetype_faceindex(pt_state), pt_state->i_fontsize);
+    FT_GlyphSlot slot; // freetype库应用：字形槽：存储当前加载的字符信息
+
+    if(!t_face)
+        return -1;
+    slot = t_face->glyph;
+    if(pt_state->i_pixelmode == FONT_PIXEL_MODE_MONO)
+        load_flags |= FT_LOAD_TARGET_MONO;
+
+    // 1. 加载字符并渲染为位图
+    //根据 Unicode 编码加载字符，FT_LOAD_RENDER 生成 8 位灰度位图，加上 FT_LOAD_TARGET_MONO 生成 1 位单色位图（存储在slot->bitmap中）。
+    error = FT_Load_Char(t_face,dwcode,load_flags);
     if(error)
     {
         printf("FT_Load_Char err\n");
         return -1;
     }
 
-    // 4. 填充 fontbitmap 结构体（将 FreeType 数据转换为上层通用格式）
+    // 2. 填充 fontbitmap 结构体（将 FreeType 数据转换为上层通用格式）
     pt_fontbitmap->puc_buffer           = slot->bitmap.buffer;// 位图像素数据
-    pt_fontbitmap-> t_region.i_x        = slot->bitmap_left;// 位图相对于基点的x偏移（左移为负）
-    // 位图相对于基点的y偏移（FreeType的y轴向上，需转换为屏幕坐标系）
-    pt_fontbitmap-> t_region.i_y        =pt_fontbitmap->i_next_originy - slot->bitmap_top;//bitmap_top:当前字符的位图上边缘相对于 “笔位置” 的 Y 轴偏移
-    pt_fontbitmap-> t_region.i_width    =slot->bitmap.width; // 位图宽度
-    pt_fontbitmap-> t_region.height     =slot->bitmap.rows;// 位图高度
+    pt_fontbitmap->i_pitch              = slot->bitmap.pitch;// 一行占用的字节数
+    pt_fontbitmap->i_pixelmode          = (slot->bitmap.pixel_mode == FT_PIXEL_MODE_MONO) ?
+                                          FONT_PIXEL_MODE_MONO : FONT_PIXEL_MODE_GRAY;
+    pt_fontbitmap->t_region.x           = pt_fontbitmap->i_cur_originx + slot->bitmap_left;// 位图左边缘 = 基点 + 左偏移
+    // 位图上边缘（FreeType的y轴向上，屏幕y轴向下）:bitmap_top 是位图上边缘相对于基点的 Y 轴偏移
+    pt_fontbitmap->t_region.y           = pt_fontbitmap->i_cur_originy - slot->bitmap_top;
+    pt_fontbitmap->t_region.width       = slot->bitmap.width; // 位图宽度
+    pt_fontbitmap->t_region.height      = slot->bitmap.rows;// 位图高度
     // 计算下一个字符的基点位置（前进距离：当前基点+字符宽度（单位转换为像素）
-    pt_fontbitmap-> i_next_originx      =pt_fontbitmap->i_cur_originx + slot->advance.x /64;//advance.x:“笔位置” 绘制完当前字符后，需要移动的X 轴距离
-    pt_fontbitmap-> i_next_originy      =pt_fontbitmap->i_next_originy;
+    pt_fontbitmap->i_next_originx       = pt_fontbitmap->i_cur_originx + slot->advance.x /64;//advance.x:“笔位置” 绘制完当前字符后，需要移动的X 轴距离
+    pt_fontbitmap->i_next_originy       = pt_fontbitmap->i_cur_originy;
     return 0;
 }
 /*
@@ -144,91 +350,217 @@ typedef struct  FT_Bitmap_
 
 /*
 获得字符串的外框
-存放在在pt_regioncar中
-输入参数：待计算的字符串指针，存储字符串外框的区域指针
+存放在在pt_regioncar中，字符串按 UTF-8 解码，相邻字符之间加上字距调整
+只加载字形的度量（不渲染位图），用 metrics 中的左偏移、上偏移、宽高和前进距离拼出外框，
+单位是 1/64 像素，最后换算成像素：x 为外框左边相对起始基点的偏移，y 为外框上边在基线以上的高度
+输入参数：字体状态，待计算的字符串指针，存储字符串外框的区域指针，存储整串前进距离（像素）的指针（可为NULL）
 */
-static int freetype_getstring_regioncar(char *str , p_region_cartesian pt_regioncar)
+static int freetype_getstring_regioncar_r(p_fontstate pt_state, char *str , p_region_cartesian pt_regioncar, int *pi_advance)
 {
-    int i;
     int error;
-    FT_BBOX bbox;// 整个字符串的边界框（合并所有字符的外框）
-    FT_BBOX glyph_bbox;// 单个字符的边界框
-    FT_Vector pen;// 笔位置（字符绘制的基点，单位：1/64 像素，FreeType 专用单位）
-    FT_Glyph glyph;// 字形对象（用于提取单个字符的边界框）
-    FT_GlyphSlot slot = g_tface->glyph; // freetype库应用：字形槽：存储当前加载的字符信息
-
-    //初始化
-    pen.x = 0;
-    pen.y = 0;
+    FT_Face t_face = ftthread_face(freetype_faceindex(pt_state), pt_state->i_fontsize);
+    FT_Pos pen_x = 0;// 笔位置（字符绘制的基点，单位：1/64 像素，FreeType 专用单位）
+    FT_Pos x_min, y_min, x_max, y_max;// 单个字符的外框
+    FT_BBox bbox;// 整个字符串的边界框（合并所有字符的外框）
+    FT_Glyph_Metrics *metrics;
+    FT_UInt index, prev = 0;
+    FT_Vector delta;
+    unsigned int dwcode;
+    int len;
+    int empty = 1;
+
+    if(!t_face)
+        return -1;
+    metrics = &t_face->glyph->metrics;
+
     //初始化字符串边界框（先设为极大/极小值，后续逐步更新）
-    bbox.xMin =  32767;  // 初始化为 int 类型的“较大值”
-    bbox.yMin =  32767;
-    bbox.xMax = -32768;  // 初始化为 int 类型的“较小值”
-    bbox.yMax = -32768;
-
-    //计算每一个字符的bounding box
-    //先translate，再load char，就可以得到外框
-    for(i = 0; i < strlen(str); i++)
-    {
-        //设置变换矩阵和笔位置
-        FT_Set_Transform(g_tface, 0, &pen);
+    bbox.xMin = bbox.yMin = 0x7FFFFFFF;
+    bbox.xMax = bbox.yMax = -0x7FFFFFFF;
 
-        //加载字符并渲染为位图
-        error = FT_Load_Char(g_tface, str[i], FT_LOAD_RENDER);
+    //逐个 UTF-8 字符
+    for(; (len = utf8_getcode(str, &dwcode)) > 0; str += len)
+    {
+        //与前一个字符之间的字距调整（微调过，整像素）
+        index = FT_Get_Char_Index(t_face, dwcode);
+        if(prev && index && FT_HAS_KERNING(t_face) &&
+           !FT_Get_Kerning(t_face, prev, index, FT_KERNING_DEFAULT, &delta))
+            pen_x += delta.x;
+        prev = index;
+
+        //只加载度量，不渲染
+        error = FT_Load_Glyph(t_face, index, FT_LOAD_DEFAULT);
         if (error)
         {
             printf("FT_Load_Char err\n");
             return -1;
         }
 
-        //从字形槽中提取字形对象（用于获取边界框）
-        error = FT_Get_Glyph(g_tface->glyph, &glyph);
-        if (error)
+        //空格等没有轮廓的字符只前进，不参与外框
+        if(metrics->width && metrics->height)
         {
-            printf("FT_Get_Glyph err\n");
-            return -1;
+            x_min = pen_x + metrics->horiBearingX;
+            x_max = x_min + metrics->width;
+            y_max = metrics->horiBearingY;
+            y_min = y_max - metrics->height;
+            if (x_min < bbox.xMin) 
+                bbox.xMin = x_min;
+            if (y_min < bbox.yMin) 
+                bbox.yMin = y_min;
+            if (x_max > bbox.xMax) 
+                bbox.xMax = x_max;
+            if (y_max > bbox.yMax) 
+                bbox.yMax = y_max;
+            empty = 0;
         }
 
-        //获取单个字符的边界框（FT_GLYPH_BBOX_UNSCALED：使用未缩放的原始坐标
-        FT_Glyph_Get_CBox(glyph, FT_GLYPH_BBOX_UNSCALED, &glyph_bbox);
-
-        //更新外框
-        if (glyph_bbox.xMin < bbox.xMin) 
-            bbox.xMin = glyph_bbox.xMin;
-        if (glyph_bbox.yMin < bbox.yMin) 
-            bbox.yMin = glyph_bbox.yMin;
-        if (glyph_bbox.xMax > bbox.xMax) 
-            bbox.xMax = glyph_bbox.xMax;
-        if (glyph_bbox.yMax > bbox.yMax) 
-            bbox.yMax = glyph_bbox.yMax;
-
-       //前进到下一个字符位置
-       pen.x += slot->advance.x;
-       pen.y += slot->advance.y;
+        //前进到下一个字符位置
+        pen_x += t_face->glyph->advance.x;
+    }
+
+    if(pi_advance)
+        *pi_advance = (pen_x + 32) >> 6;
+    if(empty)
+    {
+        pt_regioncar->x = pt_regioncar->y = 0;
+        pt_regioncar->width = pt_regioncar->height = 0;
+        return 0;
     }
 
+    //1/64 像素换算成像素：左、下边向下取整，右、上边向上取整
+    bbox.xMin = bbox.xMin >> 6;
+    bbox.yMin = bbox.yMin >> 6;
+    bbox.xMax = (bbox.xMax + 63) >> 6;
+    bbox.yMax = (bbox.yMax + 63) >> 6;
+
     pt_regioncar->x = bbox.xMin;
     pt_regioncar->y = bbox.yMax;
-    pt_regioncar->width = bbox.xMax - bbox.xMin + 1;
-    pt_regioncar->height = bbox.yMax - bbox.yMin + 1;
+    pt_regioncar->width = bbox.xMax - bbox.xMin;
+    pt_regioncar->height = bbox.yMax - bbox.yMin;
 
     return 0;
 }
 
 
 
-//注册FreeType结构体1.1
-void freetyperegister(void)
+/*
+获得字符串在字体设计单位下的外框（不缩放、不微调、不渲染）
+外框乘以 像素大小/units_per_EM 就是任意大小下的像素外框，适合找“能放进区域的最大字号”
+输入参数：字体状态（不用字号），待计算的字符串指针，存储外框的区域指针（设计单位，y 为基线以上的高度），每 EM 的设计单位数，
+          存储整串前进距离（设计单位）的指针（可为NULL）
+*/
+static int freetype_getstring_unitsbox_r(p_fontstate pt_state, char *str , p_region_cartesian pt_regioncar, int *pi_unitsperem,
+                                         int *pi_advance)
 {
-    registerfont(&g_t_freetypeopr);
+    int error;
+    FT_Face t_face = ftthread_face(freetype_faceindex(pt_state), 0);
+    FT_Pos pen_x = 0;
+    FT_Pos x_min, y_max;
+    FT_BBox bbox;
+    FT_Glyph_Metrics *metrics;
+    FT_UInt index, prev = 0;
+    FT_Vector delta;
+    unsigned int dwcode;
+    int len;
+    int empty = 1;
+
+    if(!t_face)
+        return -1;
+    metrics = &t_face->glyph->metrics;
+    if(!FT_IS_SCALABLE(t_face) || t_face->units_per_EM == 0)
+        return -1;//点阵字体没有设计单位
+
+    bbox.xMin = bbox.yMin = 0x7FFFFFFF;
+    bbox.xMax = bbox.yMax = -0x7FFFFFFF;
+    for(; (len = utf8_getcode(str, &dwcode)) > 0; str += len)
+    {
+        index = FT_Get_Char_Index(t_face, dwcode);
+        if(prev && index && FT_HAS_KERNING(t_face) &&
+           !FT_Get_Kerning(t_face, prev, index, FT_KERNING_UNSCALED, &delta))
+            pen_x += delta.x;
+        prev = index;
+
+        //FT_LOAD_NO_SCALE：度量和前进距离都是设计单位
+        error = FT_Load_Glyph(t_face, index, FT_LOAD_NO_SCALE);
+        if (error)
+        {
+            printf("FT_Load_Char err\n");
+            return -1;
+        }
+        if(metrics->width && metrics->height)
+        {
+            x_min = pen_x + metrics->horiBearingX;
+            y_max = metrics->horiBearingY;
+            if (x_min < bbox.xMin)
+                bbox.xMin = x_min;
+            if (y_max - metrics->height < bbox.yMin)
+                bbox.yMin = y_max - metrics->height;
+            if (x_min + metrics->width > bbox.xMax)
+                bbox.xMax = x_min + metrics->width;
+            if (y_max > bbox.yMax)
+                bbox.yMax = y_max;
+            empty = 0;
+        }
+        pen_x += t_face->glyph->advance.x;
+    }
+
+    *pi_unitsperem = t_face->units_per_EM;
+    if(pi_advance)
+        *pi_advance = pen_x;
+    if(empty)
+    {
+        pt_regioncar->x = pt_regioncar->y = 0;
+        pt_regioncar->width = pt_regioncar->height = 0;
+        return 0;
+    }
+    pt_regioncar->x = bbox.xMin;
+    pt_regioncar->y = bbox.yMax;
+    pt_regioncar->width = bbox.xMax - bbox.xMin;
+    pt_regioncar->height = bbox.yMax - bbox.yMin;
+    return 0;
+}
+
+
+
+/*
+获得指定字号下两个字符之间的字距调整（如 "AV" 要靠近一些）
+字体没有 kern 表时为0
+输入参数：字体状态，前一个字符和后一个字符的 Unicode 编码
+返回值：加到前一个字符前进距离上的像素数
+*/
+static int freetype_getkerning_r(p_fontstate pt_state, unsigned int dwleft, unsigned int dwright)
+{
+    FT_Vector delta;
+    FT_UInt left, right;
+    FT_Face t_face = ftthread_face(freetype_faceindex(pt_state), pt_state->i_fontsize);
+
+    if(!t_face || !FT_HAS_KERNING(t_face))
+        return 0;
+    left = FT_Get_Char_Index(t_face, dwleft);
+    right = FT_Get_Char_Index(t_face, dwright);
+    if(!left || !right || FT_Get_Kerning(t_face, left, right, FT_KERNING_DEFAULT, &delta))
+        return 0;
+    return delta.x >> 6;
 }
 
+
+
 //配置输入设备结构体
+//只提供可重入接口：字体、字号、位图格式都由字体管理层在每次调用时传入
 static  fontopr g_t_freetypeopr=
 {
     .name ="freetype", 
     .fontinit = freetype_fontinit,//初始化函数
-    .setfontsize  = freetype_setfontsize,//设置字体大小
-    .getfontbitmap = freetype_getfontbitmap,//获取字符位图
-    .getstring_regioncar = freetype_getstring_regioncar,//获取字符串外框
-};
\ No newline at end of file
+    .newface = freetype_newface,//打开后备字体
+    .hascode = freetype_hascode,//字体是否有这个字符
+    .getfontbitmap_r = freetype_getfontbitmap_r,//获取字符位图
+    .getstring_regioncar_r = freetype_getstring_regioncar_r,//获取字符串外框
+    .getstring_unitsbox_r = freetype_getstring_unitsbox_r,//获取字符串的设计单位外框
+    .getkerning_r = freetype_getkerning_r,//字距调整
+    .getmemstat = freetype_getmemstat,//内存统计
+};
+
+//注册FreeType结构体1.1
+void freetyperegister(void)
+{
+    registerfont(&g_t_freetypeopr);
+}
@@ -0,0 +1,272 @@
+/*
+FreeType 的内存分配器（属于字体库实现层）
+FreeType 在 FT_Load_Char、FT_Get_Glyph 等函数里每次都要 malloc/free 轮廓、位图等临时内存，
+板子连续运行几个班次后堆越来越碎，malloc 也是渲染时的热点。
+这里给每个 FT_Library 一个 FT_Memory：
+1. 16 字节到 16KB 的请求按 2 的幂分成尺寸类，从 64KB 的 arena 块中切出，释放后挂到对应尺寸类的空闲链表上反复使用；
+   arena 只增不减，直到这个库被释放（线程退出或换字体），稳定运行后不再向系统要内存
+2. 更大的请求（打开字体时读入的表）直接 malloc
+3. 每个库只被一个线程使用（见 freetype.c 的线程实例），分配和释放都不加锁；
+   统计计数只由所属线程写，ftmemory_getstat 从其他线程按原子方式读
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <ft_memory.h>
+
+#define FTPOOL_MINSHIFT 4                 //最小尺寸类 16 字节
+#define FTPOOL_CLASSES  11                //16 32 64 ... 16K
+#define FTPOOL_MAXSIZE  (1L << (FTPOOL_MINSHIFT + FTPOOL_CLASSES - 1))
+#define FTPOOL_CHUNK    (64 * 1024)       //每次向系统要的 arena 块大小
+
+/*
+每个分配出去的块前面的头，8 字节，保证返回的地址按 8 字节对齐
+分配中记录尺寸类（大块记录大小），空闲时是空闲链表的指针
+*/
+typedef union ftpool_hdr
+{
+    struct
+    {
+        int i_class;            //尺寸类，-1 表示直接 malloc 的大块
+        unsigned int i_size;    //大块的请求大小
+    }t;
+    union ftpool_hdr *pt_next;  //空闲链表
+    double d_align;
+}ftpool_hdr;
+
+typedef struct ftpool_chunk
+{
+    struct ftpool_chunk *pt_next;
+    double d_align;             //块内容按 8 字节对齐
+}ftpool_chunk;
+
+typedef struct ftpool
+{
+    struct FT_MemoryRec_ t_memory;          //交给 FreeType 的接口，user 指向本结构体
+    ftpool_hdr *apt_free[FTPOOL_CLASSES];   //每个尺寸类的空闲链表
+    ftpool_chunk *pt_chunks;                //所有 arena 块
+    unsigned char *puc_cur;                 //当前 arena 块中还没切出的部分
+    unsigned long i_left;
+    fontmemstat t_stat;                     //本库的统计（peak_bytes 是本库的峰值）
+    struct ftpool *pt_prev;
+    struct ftpool *pt_next;
+}ftpool,*p_ftpool;
+
+//所有还在用的分配器，以及已经释放的分配器累计下来的计数
+static p_ftpool g_pt_pools = NULL;
+static fontmemstat g_t_retired;
+static pthread_mutex_t g_t_poolmutex = PTHREAD_MUTEX_INITIALIZER;
+
+//统计计数只有所属线程写，写用原子存储，其他线程读时不会读到撕裂的值
+#define FTPOOL_ADD(field, n) __atomic_store_n(&(field), (field) + (n), __ATOMIC_RELAXED)
+
+/*
+请求大小对应的尺寸类
+返回值：尺寸类，超过最大尺寸类时返回 -1
+*/
+static int ftpool_class(long size)
+{
+    int i_class = 0;
+
+    if(size > FTPOOL_MAXSIZE)
+        return -1;
+    while((1L << (FTPOOL_MINSHIFT + i_class)) < size)
+        i_class++;
+    return i_class;
+}
+
+static void ftpool_addbytes(p_ftpool pt_pool, long size)
+{
+    FTPOOL_ADD(pt_pool->t_stat.allocs, 1);
+    FTPOOL_ADD(pt_pool->t_stat.bytes, size);
+    if(pt_pool->t_stat.bytes > pt_pool->t_stat.peak_bytes)
+        __atomic_store_n(&pt_pool->t_stat.peak_bytes, pt_pool->t_stat.bytes, __ATOMIC_RELAXED);
+}
+
+/*
+FT_Memory 的分配函数
+输入参数：分配器，字节数
+返回值：内存地址，失败返回 NULL（FreeType 自己清零）
+*/
+static void *ftpool_alloc(FT_Memory memory, long size)
+{
+    p_ftpool pt_pool = memory->user;
+    ftpool_hdr *pt_hdr;
+    ftpool_chunk *pt_chunk;
+    unsigned long i_blocksize;
+    int i_class;
+
+    if(size <= 0)
+        size = 1;
+    i_class = ftpool_class(size);
+    if(i_class < 0)
+    {
+        pt_hdr = malloc(sizeof(ftpool_hdr) + size);
+        if(!pt_hdr)
+            return NULL;
+        pt_hdr->t.i_class = -1;
+        pt_hdr->t.i_size = size;
+        FTPOOL_ADD(pt_pool->t_stat.large_allocs, 1);
+        ftpool_addbytes(pt_pool, size);
+        return pt_hdr + 1;
+    }
+
+    pt_hdr = pt_pool->apt_free[i_class];
+    if(pt_hdr)
+        pt_pool->apt_free[i_class] = pt_hdr->pt_next;
+    else
+    {
+        //空闲链表空了，从 arena 切一块；当前 arena 块剩下的不够时再要一块（剩下的零头不再使用）
+        i_blocksize = sizeof(ftpool_hdr) + (1UL << (FTPOOL_MINSHIFT + i_class));
+        if(pt_pool->i_left < i_blocksize)
+        {
+            pt_chunk = malloc(FTPOOL_CHUNK);
+            if(!pt_chunk)
+                return NULL;
+            pt_chunk->pt_next = pt_pool->pt_chunks;
+            pt_pool->pt_chunks = pt_chunk;
+            pt_pool->puc_cur = (unsigned char *)pt_chunk + sizeof(ftpool_chunk);
+            pt_pool->i_left = FTPOOL_CHUNK - sizeof(ftpool_chunk);
+            FTPOOL_ADD(pt_pool->t_stat.arena_bytes, FTPOOL_CHUNK);
+        }
+        pt_hdr = (ftpool_hdr *)pt_pool->puc_cur;
+        pt_pool->puc_cur += i_blocksize;
+        pt_pool->i_left -= i_blocksize;
+    }
+    pt_hdr->t.i_class = i_class;
+    ftpool_addbytes(pt_pool, 1L << (FTPOOL_MINSHIFT + i_class));
+    return pt_hdr + 1;
+}
+
+/*
+FT_Memory 的释放函数：小块挂回空闲链表，大块还给系统
+*/
+static void ftpool_free(FT_Memory memory, void *block)
+{
+    p_ftpool pt_pool = memory->user;
+    ftpool_hdr *pt_hdr;
+    int i_class;
+
+    if(!block)
+        return;
+    pt_hdr = (ftpool_hdr *)block - 1;
+    i_class = pt_hdr->t.i_class;
+    FTPOOL_ADD(pt_pool->t_stat.frees, 1);
+    if(i_class < 0)
+    {
+        FTPOOL_ADD(pt_pool->t_stat.bytes, -(long)pt_hdr->t.i_size);
+        free(pt_hdr);
+        return;
+    }
+    FTPOOL_ADD(pt_pool->t_stat.bytes, -(1L << (FTPOOL_MINSHIFT + i_class)));
+    pt_hdr->pt_next = pt_pool->apt_free[i_class];
+    pt_pool->apt_free[i_class] = pt_hdr;
+}
+
+/*
+FT_Memory 的重新分配函数
+新大小还在同一个尺寸类里时原地返回，否则分配新块并拷贝（FreeType 自己清零增加的部分）
+*/
+static void *ftpool_realloc(FT_Memory memory, long cur_size, long new_size, void *block)
+{
+    ftpool_hdr *pt_hdr;
+    void *pv_new;
+
+    if(!block)
+        return ftpool_alloc(memory, new_size);
+    pt_hdr = (ftpool_hdr *)block - 1;
+    if(pt_hdr->t.i_class >= 0 && new_size > 0 && ftpool_class(new_size) == pt_hdr->t.i_class)
+        return block;
+    pv_new = ftpool_alloc(memory, new_size);
+    if(!pv_new)
+        return NULL;
+    memcpy(pv_new, block, cur_size < new_size ? cur_size : new_size);
+    ftpool_free(memory, block);
+    return pv_new;
+}
+
+/*
+创建一个分配器，交给 FT_New_Library
+返回值：FT_Memory，失败返回 NULL
+*/
+FT_Memory ftmemory_new(void)
+{
+    p_ftpool pt_pool = calloc(1, sizeof(ftpool));
+
+    if(!pt_pool)
+        return NULL;
+    pt_pool->t_memory.user    = pt_pool;
+    pt_pool->t_memory.alloc   = ftpool_alloc;
+    pt_pool->t_memory.free    = ftpool_free;
+    pt_pool->t_memory.realloc = ftpool_realloc;
+
+    pthread_mutex_lock(&g_t_poolmutex);
+    pt_pool->pt_next = g_pt_pools;
+    if(g_pt_pools)
+        g_pt_pools->pt_prev = pt_pool;
+    g_pt_pools = pt_pool;
+    pthread_mutex_unlock(&g_t_poolmutex);
+    return &pt_pool->t_memory;
+}
+
+/*
+释放分配器和它的所有 arena 块（FT_Done_Library 之后调用），计数累计到总的统计中
+输入参数：ftmemory_new 返回的 FT_Memory
+*/
+void ftmemory_done(FT_Memory memory)
+{
+    p_ftpool pt_pool;
+    ftpool_chunk *pt_chunk;
+
+    if(!memory)
+        return;
+    pt_pool = memory->user;
+    pthread_mutex_lock(&g_t_poolmutex);
+    if(pt_pool->pt_prev)
+        pt_pool->pt_prev->pt_next = pt_pool->pt_next;
+    else
+        g_pt_pools = pt_pool->pt_next;
+    if(pt_pool->pt_next)
+        pt_pool->pt_next->pt_prev = pt_pool->pt_prev;
+    g_t_retired.allocs       += pt_pool->t_stat.allocs;
+    g_t_retired.frees        += pt_pool->t_stat.frees;
+    g_t_retired.large_allocs += pt_pool->t_stat.large_allocs;
+    if(pt_pool->t_stat.peak_bytes > g_t_retired.peak_bytes)
+        g_t_retired.peak_bytes = pt_pool->t_stat.peak_bytes;
+    pthread_mutex_unlock(&g_t_poolmutex);
+
+    while((pt_chunk = pt_pool->pt_chunks))
+    {
+        pt_pool->pt_chunks = pt_chunk->pt_next;
+        free(pt_chunk);
+    }
+    free(pt_pool);
+}
+
+/*
+获得所有分配器的统计
+bytes、arena_bytes 是还在用的分配器之和；peak_bytes 是单个库（线程）用过的最大字节数；次数包含已经释放的分配器
+输入参数：统计结构体指针
+*/
+void ftmemory_getstat(p_fontmemstat pt_fontmemstat)
+{
+    p_ftpool pt_pool;
+    unsigned long i_peak;
+
+    pthread_mutex_lock(&g_t_poolmutex);
+    *pt_fontmemstat = g_t_retired;
+    for(pt_pool = g_pt_pools; pt_pool; pt_pool = pt_pool->pt_next)
+    {
+        pt_fontmemstat->allocs       += __atomic_load_n(&pt_pool->t_stat.allocs, __ATOMIC_RELAXED);
+        pt_fontmemstat->frees        += __atomic_load_n(&pt_pool->t_stat.frees, __ATOMIC_RELAXED);
+        pt_fontmemstat->large_allocs += __atomic_load_n(&pt_pool->t_stat.large_allocs, __ATOMIC_RELAXED);
+        pt_fontmemstat->bytes        += __atomic_load_n(&pt_pool->t_stat.bytes, __ATOMIC_RELAXED);
+        pt_fontmemstat->arena_bytes  += __atomic_load_n(&pt_pool->t_stat.arena_bytes, __ATOMIC_RELAXED);
+        i_peak = __atomic_load_n(&pt_pool->t_stat.peak_bytes, __ATOMIC_RELAXED);
+        if(i_peak > pt_fontmemstat->peak_bytes)
+            pt_fontmemstat->peak_bytes = i_peak;
+    }
+    pthread_mutex_unlock(&g_t_poolmutex);
+}
@@ -2,12 +2,30 @@
 #define __disp_mannager_h
 
 #include <common.h>
+#include <font_manager.h>
 
 #ifndef  NULL
 #define NULL (void *) 0
 #endif
 
 
+//文字绘制模式
+#define TEXT_MODE_SOLID 0 //覆盖度非0即画文字颜色（可配合单色位图）
+#define TEXT_MODE_BLEND 1 //按8位覆盖度把文字颜色混合到背景上（抗锯齿）
+
+//像素格式（由设备的 getbuffer 填写，PIXFMT_UNKNOWN 时按 bpp 取默认格式）
+#define PIXFMT_UNKNOWN  0
+#define PIXFMT_8        1 //8位（灰度/调色板索引）
+#define PIXFMT_RGB565   2
+#define PIXFMT_BGR565   3
+#define PIXFMT_XRGB8888 4
+#define PIXFMT_XBGR8888 5
+#define PIXFMT_NUM      6
+
+//编译期固定像素格式：定义为上面某个 PIXFMT_xxx（如 -DDISP_FIXED_PIXFMT=2）后，
+//绘制时直接使用该格式的操作函数，不再经过函数指针，编译器可以内联（配合 -flto）
+//#define DISP_FIXED_PIXFMT PIXFMT_RGB565
+
 /*
 显示缓冲区结构体
 */
@@ -16,8 +34,77 @@ typedef struct dispbuff{
     int iyres;      // Y 方向分辨率（像素数，如 480）
     int ibpp;       // 每个像素的位数（如 32 表示 RGBA8888）
     char * buff;    // 缓冲区首地址（映射到用户空间的帧缓冲内存）
+    int iline_bytes;// 每行的字节数（驱动的 fix.line_length，可能大于 ixres*ibpp/8；为0时按 ixres*ibpp/8）
+    int ipixfmt;    // 像素格式 PIXFMT_xxx
 }dispbuff,*pdispbuff;
 
+//缓冲区每行的字节数
+static inline int dispbuff_linebytes(pdispbuff ptdispbuff)
+{
+    return ptdispbuff->iline_bytes ? ptdispbuff->iline_bytes : ptdispbuff->ixres * ptdispbuff->ibpp / 8;
+}
+
+/*
+像素格式操作结构体
+每种像素格式一组绘制函数，initdefaultdisplay 时根据设备的格式选定一次；
+颜色参数都是已经用 mapcolor 转换好的原生格式，区域参数都是已经裁剪好的
+*/
+typedef struct pixelopr{
+    char *name;
+    int ipixfmt;
+    int ibpp;
+    unsigned int (*mapcolor)(unsigned int dwcolor);// 0xRRGGBB 转换为原生格式
+    void (*put)(pdispbuff ptdispbuff, int x, int y, unsigned int color);// 画点
+    void (*hline)(pdispbuff ptdispbuff, int x, int y, int n, unsigned int color);// 画水平线
+    void (*fillrect)(pdispbuff ptdispbuff, p_region pt_region, unsigned int color);// 填充矩形
+    void (*glyphblit)(pdispbuff ptdispbuff, p_fontbitmap pt_fontbitmap, p_region pt_region, unsigned int color);// 字形：覆盖度非0即画
+    void (*glyphblend)(pdispbuff ptdispbuff, p_fontbitmap pt_fontbitmap, p_region pt_region, unsigned int color);// 字形：按覆盖度混合
+    void (*blitcopy)(pdispbuff ptdispbuff, p_region pt_region, unsigned char *src, int src_pitch);// 拷贝同格式的像素块
+}pixelopr,*p_pixelopr;
+
+/*
+刷新统计结构体
+用来观察脏矩形合并后每帧实际刷到硬件上的字节数
+*/
+typedef struct dispstat{
+    unsigned int frames;                // 已刷新的帧数（flushdisplayregion 调用次数）
+    unsigned int regions_lastframe;     // 上一帧合并后的脏矩形个数
+    unsigned long bytes_lastframe;      // 上一帧刷到硬件上的字节数
+    unsigned long long bytes_total;     // 累计刷到硬件上的字节数
+    unsigned int update_us_lastframe;   // 上一帧刷新（拷贝+翻页）耗时，微秒
+    unsigned int interval_us_lastframe; // 上一帧与再上一帧的间隔，微秒
+}dispstat,*pdispstat;
+
+/*
+显示列表统计结构体
+*/
+typedef struct displiststat{
+    unsigned int frames;                // 已回放的帧数
+    unsigned int cmds_lastframe;        // 上一帧记录的命令数
+    unsigned int culled_lastframe;      // 上一帧被完全覆盖而丢弃的命令数
+    unsigned long arena_bytes_lastframe;// 上一帧拷贝的字形位图/像素块字节数
+    unsigned int replay_us_lastframe;   // 上一帧回放耗时，微秒
+    unsigned int threads_lastframe;     // 上一帧参与回放的线程数
+    unsigned long long cmds_total;      // 累计命令数
+    unsigned long long culled_total;    // 累计丢弃的命令数
+}displiststat,*pdispliststat;
+
+/*
+无头显示设备（"mem"）共享内存开头的头部
+外部查看程序只读映射共享内存后，按这里的信息解析像素，frame_seq 变化表示有新的一帧
+*/
+#define MEMDISP_MAGIC 0x4D444953 // "MDIS"
+typedef struct memdisp_header{
+    unsigned int magic;         // MEMDISP_MAGIC
+    unsigned int xres;          // X 方向分辨率
+    unsigned int yres;          // Y 方向分辨率
+    unsigned int bpp;           // 每个像素的位数
+    unsigned int line_bytes;    // 每行的字节数
+    unsigned int offset;        // 像素数据相对共享内存开头的偏移
+    volatile unsigned int frame_seq; // 帧序号，每刷新一帧加一
+    unsigned int reserved[9];   // 保留，头部共64字节
+}memdisp_header,*p_memdisp_header;
+
 /*
 common.h中有了不用再定义
 //显示区域结构体
@@ -37,6 +124,7 @@ typedef struct dispopr{
     int (*deviceexit)(void);//清理结构体
     int (*getbuffer)(pdispbuff ptdispbuff);//获取帧缓冲区,XY坐标和像素B
     int (*flushregion)(p_region ptregion, pdispbuff ptdispbuff);// 刷新区域：将 buffer 内容刷到 ptregion 描述的区域
+    int (*presentframe)(pdispbuff ptdispbuff);// 一帧的所有区域刷新完后调用（如翻页），可为NULL
     struct dispopr *ptnext;//链表指针，用于挂载多个显示设备（如同时支持LCD、虚拟屏）
 }dispopr,*pdispopr;
 
@@ -46,13 +134,66 @@ void display_system_register(void);
 int selectdefaultdisplay(char *name);
 int initdefaultdisplay(void);
 int putpixel(int x, int y, unsigned int dwcolor);
+unsigned int mapdisplaycolor(unsigned int dwcolor);
+p_pixelopr getdisplaypixelopr(void);
 int flushdisplayregion(p_region ptregion, pdispbuff ptdispbuff);
+void add_dirtyregion(p_region ptregion);
+int getdisplaystat(pdispstat ptdispstat);
 
-int getdisplaybuffer(void);
+pdispbuff getdisplaybuffer(void);
 
 void drawfontbitmap(p_fontbitmap pt_fontbitmap,unsigned int dwcolor);
 void draw_region(p_region pt_region,unsigned int dwcolor);
 void drawtext_inregioncentral(char *name, p_region pt_region, unsigned int dwcolor);
+void draw_pixels(p_region pt_region, unsigned char *src, int src_pitch);
+int settextmode(int i_textmode);
+
+//displist.c：显示列表，begin/end 之间的绘制先记录，end 时去掉被覆盖的命令、按条带回放并只刷新一次
+int displist_begin(void);
+int displist_end(void);
+int displist_recording(void);
+int displist_deferflush(void);
+void displist_addfill(p_region pt_region, unsigned int color);
+void displist_addglyph(p_fontbitmap pt_fontbitmap, p_region pt_region, unsigned int color, int iblend);
+void displist_addblit(p_region pt_region, unsigned char *src, int src_pitch);
+int getdispliststat(pdispliststat ptdispliststat);
+
+//tilerender.c：条带并行渲染的线程池，tile_func 处理 [b_begin, b_end) 条带
+typedef void (*tile_func)(int b_begin, int b_end, void *p_arg);
+int tilerender_setthreads(int ithreads);
+int tilerender_getthreads(void);
+int tilerender_run(int nbands, int ichunk, tile_func pf_tile, void *p_arg);
+
+//memdisplay.c：无头显示设备
+int memdisplay_setmode(int ixres, int iyres, int ibpp);
+int memdisplay_getfd(void);
+int memdisplay_dumpppm(char *path);
+
+//pixfmt.c：像素格式操作表
+extern const pixelopr g_at_pixelopr[PIXFMT_NUM];
+p_pixelopr getpixelopr(pdispbuff ptdispbuff);
+int clip_region(pdispbuff ptdispbuff, p_region pt_in, p_region pt_clip, p_region pt_out);
+
+//fill.c：矩形填充引擎（各像素格式的 put/hline/fillrect/blitcopy）
+void put8(pdispbuff ptdispbuff, int x, int y, unsigned int color);
+void put16(pdispbuff ptdispbuff, int x, int y, unsigned int color);
+void put32(pdispbuff ptdispbuff, int x, int y, unsigned int color);
+void hline8(pdispbuff ptdispbuff, int x, int y, int n, unsigned int color);
+void hline16(pdispbuff ptdispbuff, int x, int y, int n, unsigned int color);
+void hline32(pdispbuff ptdispbuff, int x, int y, int n, unsigned int color);
+void fillrect8(pdispbuff ptdispbuff, p_region pt_region, unsigned int color);
+void fillrect16(pdispbuff ptdispbuff, p_region pt_region, unsigned int color);
+void fillrect32(pdispbuff ptdispbuff, p_region pt_region, unsigned int color);
+void blitcopy_rows(pdispbuff ptdispbuff, p_region pt_region, unsigned char *src, int src_pitch);
+
+//glyph.c：字形位图绘制
+void glyphblit8(pdispbuff ptdispbuff, p_fontbitmap pt_fontbitmap, p_region pt_region, unsigned int color);
+void glyphblit16(pdispbuff ptdispbuff, p_fontbitmap pt_fontbitmap, p_region pt_region, unsigned int color);
+void glyphblit32(pdispbuff ptdispbuff, p_fontbitmap pt_fontbitmap, p_region pt_region, unsigned int color);
+
+//blend.c：抗锯齿文字混合
+void glyphblend16(pdispbuff ptdispbuff, p_fontbitmap pt_fontbitmap, p_region pt_region, unsigned int color);
+void glyphblend32(pdispbuff ptdispbuff, p_fontbitmap pt_fontbitmap, p_region pt_region, unsigned int color);
 
 #endif
 
@@ -0,0 +1,61 @@
+#ifndef __font_atlas_h
+#define __font_atlas_h
+
+/*
+预先渲染的字形图集文件格式（由 tools/mkatlas 离线生成，font/atlas.c 运行时 mmap 使用）
+所有数值按生成机器的字节序存放，各段起点按 8 字节对齐：
+
+    fontatlas_header                    文件头，64 字节
+    int sizes[nsizes]                   字号，升序
+    fontatlas_units units[ncodes]       每个字符的设计单位度量，按编码升序（二分查找的依据）
+    fontatlas_glyph glyphs[nsizes][ncodes] 每个字号下每个字符的位图信息，与 units 同序
+    char fontpath[]                     回退用的字体文件路径（以0结尾），可以没有
+    位图数据                            每个位图起点 8 字节对齐
+*/
+
+#define FONTATLAS_MAGIC   0x534C5441 // "ATLS"
+#define FONTATLAS_VERSION 1
+#define FONTATLAS_ALIGN   8
+
+typedef struct fontatlas_header
+{
+    unsigned int magic;          //FONTATLAS_MAGIC
+    unsigned int version;        //FONTATLAS_VERSION
+    unsigned int nsizes;         //字号数
+    unsigned int ncodes;         //字符数
+    unsigned int pixelmode;      //位图格式：FONT_PIXEL_MODE_GRAY 或 FONT_PIXEL_MODE_MONO
+    unsigned int units_per_em;   //每 EM 的设计单位数
+    unsigned int sizes_offset;   //各段相对文件开头的偏移
+    unsigned int units_offset;
+    unsigned int glyphs_offset;
+    unsigned int fontpath_offset;//0 表示没有回退字体
+    unsigned int bitmaps_offset;
+    unsigned int file_size;      //文件总长度，用于校验
+    unsigned int reserved[4];
+}fontatlas_header,*p_fontatlas_header;
+
+//字符的设计单位度量（与字号无关，字号求解用）
+typedef struct fontatlas_units
+{
+    unsigned int code;           //Unicode 编码
+    short x_min;                 //外框左边相对基点
+    short y_max;                 //外框上边在基线以上的高度
+    unsigned short width;        //外框宽高，没有轮廓的字符（空格）为0
+    unsigned short height;
+    short advance;               //前进距离
+    short reserved;
+}fontatlas_units,*p_fontatlas_units;
+
+//某个字号下一个字符的位图
+typedef struct fontatlas_glyph
+{
+    unsigned int bitmap_offset;  //位图相对 bitmaps_offset 的偏移
+    short left;                  //位图左边缘相对基点的偏移
+    short top;                   //位图上边缘相对基点的偏移（屏幕坐标，向下为正）
+    unsigned short width;
+    unsigned short height;
+    unsigned short pitch;        //位图一行的字节数
+    short advance;               //到下一个基点的距离，像素
+}fontatlas_glyph,*p_fontatlas_glyph;
+
+#endif
@@ -4,6 +4,9 @@
 
 #include <common.h>
 
+//位图的像素格式
+#define FONT_PIXEL_MODE_GRAY 0 //8位灰度，每个像素一个字节（覆盖度 0~255）
+#define FONT_PIXEL_MODE_MONO 1 //单色，每个像素一位，高位在前（FT_LOAD_TARGET_MONO）
 
 
 /*
@@ -17,28 +20,112 @@ typedef struct fontbitmap
     int i_cur_originy;//基点的y
     int i_next_originx;//下一个基点的x
     int i_next_originy;//下一个基点的y
+    int i_pitch;//位图一行占用的字节数
+    int i_pixelmode;//位图像素格式：FONT_PIXEL_MODE_GRAY 或 FONT_PIXEL_MODE_MONO
     unsigned char *puc_buffer; //存储的是字符的位图点阵，而非字符串。 
 }fontbitmap,*p_fontbitmap;
 
-// FreeType结构体，字体操作的标准接口，用于抽象不同字体库（如 FreeType、其他字体引擎）的实现
+/*
+字体状态
+可重入的字体引擎接口（*_r）不保存“当前字体、当前字号”，由调用者每次显式传入，几个线程可以同时调用
+*/
+typedef struct fontstate
+{
+    void *p_engineface; //newface 打开的字体对象，NULL 表示 fontinit 打开的
+    int i_fontsize;     //像素大小
+    int i_pixelmode;    //FONT_PIXEL_MODE_GRAY 或 FONT_PIXEL_MODE_MONO
+}fontstate,*p_fontstate;
+
+/*
+字体引擎内存统计结构体
+长时间运行时 bytes、arena_bytes 应该在预热之后保持不变
+*/
+typedef struct fontmemstat
+{
+    unsigned long long allocs;       //分配次数
+    unsigned long long frees;        //释放次数
+    unsigned long long large_allocs; //超过池的最大尺寸类、直接向系统要的次数
+    unsigned long bytes;             //当前分配出去的字节数
+    unsigned long peak_bytes;        //单个字体库实例用过的最大字节数
+    unsigned long arena_bytes;       //池向系统要的内存，字节
+}fontmemstat,*p_fontmemstat;
+
+/*
+FreeType结构体，字体操作的标准接口，用于抽象不同字体库（如 FreeType、其他字体引擎）的实现
+引擎必须可重入：字体、字号、位图格式都由字体管理层每次调用时通过 fontstate 传入，几个线程可以同时调用；
+getfontbitmap_r 和 getstring_regioncar_r 必须提供
+*/
 typedef struct fontopr
 {
     char *name; 
     int (*fontinit)(char *afinename);//初始化函数
-    int (*setfontsize)(int ifontsize);//设置字体大小
-    int (*getfontbitmap)(unsigned int dwcode,p_fontbitmap pt_fontbitmap);// 获取字符位图
-    int (*getstring_regioncar)(char *str , p_region_cartesian pt_regioncar);// 获取字符串外框
+    int (*snapsize)(int ifontsize);// 把求出的字号调整为引擎能直接提供的字号（可为NULL）
+    void *(*newface)(char *afinename);// 再打开一个字体文件作为后备字体，不改变当前字体（可为NULL，引擎只能打开一个字体文件）
+    int (*hascode)(void *p_engineface, unsigned int dwcode);// 字体是否有这个字符，NULL 表示 fontinit 打开的字体（可为NULL，表示什么字符都有）
+    int i_nocache;// 为1时位图已常驻内存（如映射的图集），不再拷贝进字形缓存
+    int (*getfontbitmap_r)(p_fontstate pt_state, unsigned int dwcode, p_fontbitmap pt_fontbitmap);// 可重入：获取字符位图，位图在本线程下一次调用引擎之前有效
+    int (*getstring_regioncar_r)(p_fontstate pt_state, char *str, p_region_cartesian pt_regioncar, int *pi_advance);// 可重入：获取字符串外框和整串的前进距离（pi_advance 可为NULL）
+    int (*getstring_unitsbox_r)(p_fontstate pt_state, char *str, p_region_cartesian pt_regioncar, int *pi_unitsperem, int *pi_advance);// 可重入：获取字符串的设计单位外框和前进距离（可为NULL）
+    int (*getkerning_r)(p_fontstate pt_state, unsigned int dwleft, unsigned int dwright);// 可重入：字距调整（可为NULL）
+    int (*getmemstat)(p_fontmemstat pt_fontmemstat);// 获取引擎的内存统计（可为NULL）
     struct fontopr *pt_next;
 }fontopr,*p_fontopr;
 
+/*
+字形缓存统计结构体
+*/
+typedef struct glyphcachestat
+{
+    unsigned long long hits;    //命中次数
+    unsigned long long misses;  //未命中次数（交给字体引擎生成）
+    unsigned long long evictions;//被淘汰的缓存项数
+    unsigned int entries;       //当前缓存项数
+    unsigned long bytes;        //当前占用的字节数
+    unsigned long budget;       //内存预算，字节（为0时字形缓存和外框缓存都关闭）
+    unsigned long long extent_hits;  //字符串外框缓存命中次数
+    unsigned long long extent_misses;//字符串外框缓存未命中次数
+    unsigned long long run_hits;     //排版结果缓存命中次数
+    unsigned long long run_misses;   //排版结果缓存未命中次数
+    unsigned long long prewarmed;    //后台预热生成的字形数
+}glyphcachestat,*p_glyphcachestat;
+
+/*
+排好版的一行文字
+由 gettextrun 按当前字体和本线程的当前字号生成：UTF-8 解码后的字符、每个字符的基点相对行首基点的水平偏移（含字距调整）、整行的外框
+同一个标签再次绘制时直接按缓存的位置取字形，不再解码和测量
+*/
+typedef struct textglyph
+{
+    unsigned int dwcode;  //Unicode 编码
+    int i_x;              //基点相对行首基点的水平偏移，像素
+}textglyph,*p_textglyph;
+
+typedef struct textrun
+{
+    region_cartesian t_extent;//整行的外框（与 getstring_regioncar 相同）
+    int i_count;              //字符数
+    int i_refs;               //引用计数（排版结果缓存和正在使用它的线程各一个），字体管理层内部用
+    textglyph at_glyphs[];
+}textrun,*p_textrun;
+
 void registerfont(p_fontopr  pt_fontopr);
 void font_system_register(void);
 
+p_fontopr getfontopr(char *a_fontoprname);
 int selectandinitfont(char *a_fontoprname ,char *a_fontfilename);
+int addfallbackfont(char *a_fontoprname ,char *a_fontfilename);
 int setfontsize(int i_fontsize);
 int getfontbitmap(unsigned int dwcode ,p_fontbitmap pt_fontbitmap);
+int setfontrendermode(int i_pixelmode);
+int setglyphcachebudget(unsigned long i_budget);
+int getglyphcachestat(p_glyphcachestat pt_glyphcachestat);
+int getfontmemstat(char *a_fontoprname, p_fontmemstat pt_fontmemstat);
 
+int utf8_getcode(char *str, unsigned int *pdwcode);
 int getstring_regioncar(char *str , p_region_cartesian pt_regioncar);
+p_textrun gettextrun(char *str);
+int getfontsize_forregion(char *str, int i_width, int i_height);
+int prewarmfont(char *str, int i_fontsize);
 
 
 #endif
@@ -0,0 +1,19 @@
+#ifndef __ft_memory_h
+#define __ft_memory_h
+
+/*
+FreeType 用的内存分配器（font/ft_memory.c）
+每个 FT_Library 一个 FT_Memory，由 freetype.c 的线程实例用 FT_New_Library 创建库时传入
+*/
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_SYSTEM_H
+
+#include <font_manager.h>
+
+FT_Memory ftmemory_new(void);
+void ftmemory_done(FT_Memory memory);
+void ftmemory_getstat(p_fontmemstat pt_fontmemstat);
+
+#endif
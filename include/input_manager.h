@@ -9,24 +9,99 @@
 #define NULL (void *) 0
 #endif
 
-//上报的数据结构
+#define INPUT_PAYLOAD_SIZE 1024 //载荷缓冲区大小（含字符串结尾的 '\0'）
+
+/*
+载荷：网络消息等变长数据
+从输入管理层的池中取得（inputpayload_get），事件里只放指针，进出队列不拷贝数据；
+引用计数为0时还回池中
+*/
+typedef struct inputpayload
+{
+    int i_refs;     //引用计数
+    int i_index;    //在池中的序号，-1 表示池用完时直接分配的
+    int i_len;      //数据长度（不含结尾的 '\0'）
+    int i_size;     //缓冲区大小，INPUT_PAYLOAD_SIZE
+    char ac_data[]; //数据，网络消息以 '\0' 结尾
+}inputpayload,*p_inputpayload;
+
+/*
+上报的数据结构
+只有固定的小头部（64 位系统上 48 字节，一个缓存行以内），触摸事件不再带着 1KB 的字符串进出队列；
+网络消息放在 pt_payload 中，取到事件的一方用完后调用 inputevent_release
+*/
 typedef struct inputevent
 {
-    struct timeval tTime;
-    int i_type;
+    struct timeval tTime;       //时间戳
+    int i_type;                 //INPUT_TYPE_TOUCH、INPUT_TYPE_NET
+    int i_source;               //产生事件的输入设备编号（按注册顺序）
     int i_x;
     int i_y;
     int i_pressure;
-    char str[1024];
+    p_inputpayload pt_payload;  //载荷，没有时为 NULL
 }inputevent,*p_inputevent;
 
-//输入设备的数据结构
+//输入事件队列的统计
+typedef struct inputqueuestat
+{
+    unsigned long long enqueued; //写入队列的事件数
+    unsigned long long dequeued; //被 get_inputevent 取走的事件数
+    unsigned long long dropped;  //队列满时丢弃的事件数
+    unsigned int capacity;       //队列容量（事件个数）
+    unsigned int payloads;       //载荷池的大小
+    unsigned long long payload_mallocs;//载荷池用完时直接分配的次数
+}inputqueuestat,*p_inputqueuestat;
+
+#define NETINPUT_BATCH_MAX 256 //网络输入设备一次 recvmmsg 最多接收的数据报数
+#define NETINPUT_HIST_BUCKETS 9 //批大小分布：第 k 项是大小在 [2^k, 2^(k+1)) 的批数
+
+//网络输入设备的统计（input/netinput.c）
+typedef struct netinputstat
+{
+    unsigned long long batches;     //收到数据的 recvmmsg 次数
+    unsigned long long datagrams;   //收到的数据报数
+    unsigned long long batch_hist[NETINPUT_HIST_BUCKETS];//批大小分布
+    unsigned int max_batch;         //最大的一批
+    unsigned int batch;             //当前设置的批大小
+    unsigned int kernel_drops;      //内核因接收缓冲区满丢弃的数据报数（SO_RXQ_OVFL）
+    int rcvbuf;                     //套接字实际的接收缓冲区大小，字节
+}netinputstat,*p_netinputstat;
+
+//触摸屏后端，settouchscreen 选择
+#define TOUCHSCREEN_TSLIB "tslib" //经过 tslib 的滤波链，一次 ts_read 一个样本（input/touchscreen.c）
+#define TOUCHSCREEN_EVDEV "evdev" //直接批量读取 /dev/input/eventX，不滤波（input/evdevtouch.c）
+
+/*
+触摸屏的统计，两种后端都提供，用来比较每个样本的处理开销：cost_ns / samples
+处理时间包括读设备的系统调用和把原始数据变成样本（tslib 的滤波链，或 evdev 的解析和校准）
+*/
+typedef struct touchscreenstat
+{
+    char *backend;                  //正在使用的后端：TOUCHSCREEN_TSLIB 或 TOUCHSCREEN_EVDEV
+    unsigned long long reads;       //读设备的次数（ts_read 或 read）
+    unsigned long long samples;     //交给输入管理层的样本数
+    unsigned long long cost_ns;     //读取和处理花的总时间，纳秒
+    unsigned long long max_cost_ns; //一次读取和处理的最长时间，纳秒
+    unsigned long long latency_us;  //样本从内核时间戳到交给输入管理层的总延迟，微秒（除以 samples 是平均延迟）
+    unsigned long long drops;       //内核事件缓冲区溢出（SYN_DROPPED）的次数，只有 evdev 后端统计
+}touchscreenstat,*p_touchscreenstat;
+
+/*
+输入设备的数据结构
+提供 get_fd 和 drain_inputevent 的设备由输入管理层的反应器线程用 epoll 统一监听，可读时一次读到没有数据为止；
+只提供阻塞的 get_inputevent 的设备各用一个兼容线程
+*/
 typedef struct inputdevice
 {
     char *name;
     int (*get_inputevent)(p_inputevent pt_inputevent);
     int (*deviceinit)(void);
     int (*deviceexit)(void);
+    int (*get_fd)(void);// 可轮询的文件描述符，deviceinit 之后调用（可为NULL）
+    int (*drain_inputevent)(p_inputevent pt_inputevent);// 非阻塞读取一个事件：0 读到，1 暂时没有数据，-1 设备出错不再监听（可为NULL）
+    int i_source;   //设备编号，注册时分配，填入事件的 i_source
+    int i_errors;   //反应器中 drain_inputevent 连续出错的次数，输入管理层内部用
+    unsigned int i_payloads; //设备一直占着的载荷数（如预先取好的接收缓冲区），建立载荷池时留出
     struct inputdevice *pt_next;
 }inputdevice,*p_inputdevice;
 
@@ -34,5 +109,19 @@ void register_inputdevice(p_inputdevice pt_inputdev);
 void input_system_register(void);
 void input_deviceinit(void);
 int get_inputevent(p_inputevent pt_inputevent);
+int setinputqueuesize(unsigned int i_capacity);
+int getinputqueuestat(p_inputqueuestat pt_inputqueuestat);
+int setinputpayloadpool(unsigned int i_count);
+p_inputpayload inputpayload_get(void);
+void inputpayload_hold(p_inputpayload pt_payload);
+void inputpayload_release(p_inputpayload pt_payload);
+void inputevent_release(p_inputevent pt_inputevent);
+
+int settouchscreen(char *a_backend, char *a_devname);
+int gettouchscreenstat(p_touchscreenstat pt_touchscreenstat);
+int settouchcalibration(int ai_matrix[7]);
+
+int setnetinputbatch(unsigned int i_batch, int i_rcvbuf);
+int getnetinputstat(p_netinputstat pt_netinputstat);
 
 #endif
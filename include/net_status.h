@@ -0,0 +1,58 @@
+#ifndef __net_status_h
+#define __net_status_h
+
+/*
+网络状态消息（input/netstatus.c）
+两种格式放在同一个 UDP 端口：
+1. 文本：一行 "名字 状态"，状态是 ok、cancel 或以数字开头的百分比（如 "57%"），给脚本用
+2. 二进制：一个数据报带多条记录，一次刷新一个工位的所有项目；所有多字节字段都是网络字节序（大端）
+   头部 8 字节：
+     0  魔数 0xA5 0x5A（0xA5 不能作为 UTF-8 的首字节，不会和文本消息混淆）
+     2  版本 NETSTATUS_VERSION
+     3  记录数
+     4  序号（32 位，发送方每个数据报加一，用于排查丢包和乱序）
+   每条记录 4 字节：
+     0  项目序号（16 位，配置文件中的顺序，从 0 开始）
+     2  状态 NETSTATUS_CANCEL / NETSTATUS_OK / NETSTATUS_PERCENT
+     3  百分比 0~100（状态为 NETSTATUS_PERCENT 时有效）
+二进制记录直接在接收缓冲区中解码，不拷贝
+*/
+
+#include <input_manager.h>
+
+#define NETSTATUS_MAGIC0      0xA5
+#define NETSTATUS_MAGIC1      0x5A
+#define NETSTATUS_VERSION     1
+#define NETSTATUS_HEADER_SIZE 8
+#define NETSTATUS_RECORD_SIZE 4
+#define NETSTATUS_RECORD_MAX  255 //记录数只占一个字节
+
+#define NETSTATUS_CANCEL  0
+#define NETSTATUS_OK      1
+#define NETSTATUS_PERCENT 2
+
+//一条状态记录
+typedef struct netstatusrecord
+{
+    int i_item;             //项目序号，文本消息为 -1（用名字找）
+    char *pc_name;          //文本消息的名字，二进制消息为 NULL
+    int i_status;           //NETSTATUS_CANCEL / NETSTATUS_OK / NETSTATUS_PERCENT，不认识的状态为 -1
+    int i_percent;          //百分比
+    char *pc_statustext;    //文本消息中状态的原文（按钮上直接显示），二进制消息为 NULL
+}netstatusrecord,*p_netstatusrecord;
+
+//一个状态消息
+typedef struct netstatusframe
+{
+    int i_binary;                       //1 二进制，0 文本
+    int i_version;                      //二进制消息的版本
+    unsigned int i_seq;                 //二进制消息的序号
+    int i_count;                        //记录数
+    const unsigned char *puc_records;   //二进制记录，指向接收缓冲区
+    netstatusrecord t_text;             //文本消息的唯一一条记录
+}netstatusframe,*p_netstatusframe;
+
+int netstatus_open(p_inputpayload pt_payload, p_netstatusframe pt_frame);
+int netstatus_record(p_netstatusframe pt_frame, int i_index, p_netstatusrecord pt_record);
+
+#endif
@@ -0,0 +1,457 @@
+/*
+该文件是触摸屏的另一个后端：不经过 tslib，直接读取 /dev/input/eventX 的 input_event
+
+和 touchscreen.c 的区别：
+tslib 的 ts_read 一次只交出一个样本，每个样本都要走一遍模块滤波链（去抖、中值、线性校准），
+在电阻屏和电容屏上都带来延迟和 CPU 开销；
+这里一次 read 读入一批 input_event（最多 EVDEV_BATCH 个），在内存中按 EV_SYN/SYN_REPORT 组装成样本，
+用内置的校准矩阵换算坐标，时间戳直接用内核记录的事件时间，不做滤波。
+组装规则：
+多点触摸（有 ABS_MT_SLOT）的设备只跟踪 0 号槽，槽的 ABS_MT_TRACKING_ID 为 -1 时是抬起；
+单点设备按 BTN_TOUCH 判断按下，没有 BTN_TOUCH 时按压力是否大于0判断，两者都没有的设备初始化失败；
+没有压力轴的设备按下时压力报 EVDEV_NOPRESSURE，和 tslib 一样抬起时压力为0。
+内核的事件缓冲区溢出（SYN_DROPPED）时丢掉到下一个 SYN_REPORT 为止的事件，再用 ioctl 读回设备的当前状态。
+校准矩阵：
+格式和 tslib 的 pointercal 相同（a0~a6）：x' = (a2 + a0*x + a1*y) / a6，y' = (a5 + a3*x + a4*y) / a6；
+settouchcalibration 设置，没有设置时读取 TSLIB_CALIBFILE 环境变量指定的文件或 /etc/pointercal，都没有时不换算。
+五、文件所在层级
+和 touchscreen.c 相同，属于输入驱动抽象层：下层是内核的 evdev 接口，上层为输入管理器提供标准的 inputdevice 接口；
+两个后端由 settouchscreen 在启动时选择，只注册一个，处理开销都由 gettouchscreenstat 获取。
+*/
+
+#include <sys/types.h> // 系统基础数据类型
+#include <sys/ioctl.h> // ioctl（EVIOCGBIT、EVIOCGABS、EVIOCGMTSLOTS、EVIOCGKEY）
+#include <linux/input.h>// struct input_event、EV_*、ABS_*、BTN_TOUCH
+
+#include <stdio.h>  // 标准输入输出（printf 调试信息、读取校准文件）
+#include <stdlib.h> // getenv（校准文件路径、设备文件）
+#include <string.h> // memset、memcpy
+#include <unistd.h> // read、close
+#include <fcntl.h>  // open
+#include <errno.h>  // EAGAIN（非阻塞读取时暂时没有数据）
+#include <poll.h>   // 兼容线程阻塞读取时等待设备可读
+#include <time.h>   // clock_gettime（统计处理开销）
+
+#include <input_manager.h>
+
+#define EVDEV_DEFAULT_DEVICE   "/dev/input/event0" // 没有指定设备文件、也没有 TSLIB_TSDEVICE 时使用
+#define EVDEV_DEFAULT_CALIBFILE "/etc/pointercal"  // 没有 TSLIB_CALIBFILE 时读取的校准文件
+#define EVDEV_BATCH 64          // 一次 read 最多读入的 input_event 个数
+#define EVDEV_NOPRESSURE 255    // 没有压力轴的设备按下时报的压力
+
+#define EVDEV_LONGBITS (8 * sizeof(unsigned long))
+#define EVDEV_TESTBIT(bits, n) (((bits)[(n) / EVDEV_LONGBITS] >> ((n) % EVDEV_LONGBITS)) & 1)
+
+//组装好的一个样本
+typedef struct evdevsample
+{
+    int i_x;
+    int i_y;
+    int i_pressure;
+    struct timeval tTime; //SYN_REPORT 的内核时间戳
+}evdevsample,*p_evdevsample;
+
+static int g_i_evdevfd = -1;            //设备文件描述符
+static char *g_pc_evdevdevice = NULL;   //设备文件，NULL 表示 TSLIB_TSDEVICE 或 EVDEV_DEFAULT_DEVICE
+static int g_ai_calib[7] = {1, 0, 0, 0, 1, 0, 1};//校准矩阵，默认不换算
+static int g_i_calibset = 0;            //settouchcalibration 设置过，不再读校准文件
+
+//设备能力，deviceinit 时探测
+static int g_i_mt = 0;          //多点触摸（有 ABS_MT_SLOT），只跟踪 0 号槽
+static int g_i_haspressure = 0; //有压力轴
+static int g_i_hasbtntouch = 0; //有 BTN_TOUCH
+
+//正在组装的样本：两个 SYN_REPORT 之间的事件只更新这里
+static int g_i_rawx, g_i_rawy, g_i_rawpressure;
+static int g_i_btntouch = 0;    //BTN_TOUCH 的值
+static int g_i_slot = 0;        //当前的多点触摸槽
+static int g_i_trackingid = -1; //0 号槽的跟踪编号，-1 表示没有触点
+static int g_i_dirty = 0;       //上一个 SYN_REPORT 之后有状态变化
+static int g_i_dropping = 0;    //收到 SYN_DROPPED，丢弃到下一个 SYN_REPORT
+
+//一批 read 的结果
+static struct input_event g_at_events[EVDEV_BATCH];
+static evdevsample g_at_samples[EVDEV_BATCH];   //每个 SYN_REPORT 最多一个样本，一批事件不会超过 EVDEV_BATCH 个样本
+static unsigned int g_i_samplepos = 0;          //下一个要交出的样本
+static unsigned int g_i_samplecount = 0;        //这一批组装出的样本数
+static touchscreenstat g_t_evdevstat;
+
+//统计只有读取触摸屏的线程写，写用原子存储，其他线程读时不会读到撕裂的值
+#define EVDEV_ADD(field, v) __atomic_store_n(&(field), (field) + (v), __ATOMIC_RELAXED)
+
+/*
+设置 evdev 后端的校准矩阵，在 input_deviceinit 之前调用
+输入参数：a0~a6，格式和 tslib 的 pointercal 相同
+返回值：a6 为0时返回 -1
+*/
+int settouchcalibration(int ai_matrix[7])
+{
+    if(ai_matrix[6] == 0)
+        return -1;
+    memcpy(g_ai_calib, ai_matrix, sizeof(g_ai_calib));
+    g_i_calibset = 1;
+    return 0;
+}
+
+/*
+获取 evdev 后端的统计
+输入参数：统计结构体指针
+*/
+int evdevtouch_getstat(p_touchscreenstat pt_touchscreenstat)
+{
+    pt_touchscreenstat->backend     = TOUCHSCREEN_EVDEV;
+    pt_touchscreenstat->reads       = __atomic_load_n(&g_t_evdevstat.reads, __ATOMIC_RELAXED);
+    pt_touchscreenstat->samples     = __atomic_load_n(&g_t_evdevstat.samples, __ATOMIC_RELAXED);
+    pt_touchscreenstat->cost_ns     = __atomic_load_n(&g_t_evdevstat.cost_ns, __ATOMIC_RELAXED);
+    pt_touchscreenstat->max_cost_ns = __atomic_load_n(&g_t_evdevstat.max_cost_ns, __ATOMIC_RELAXED);
+    pt_touchscreenstat->latency_us  = __atomic_load_n(&g_t_evdevstat.latency_us, __ATOMIC_RELAXED);
+    pt_touchscreenstat->drops       = __atomic_load_n(&g_t_evdevstat.drops, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/*
+没有用 settouchcalibration 设置时，从 pointercal 文件读取校准矩阵
+文件不存在或格式不对时不换算
+*/
+static void evdevtouch_loadcalib(void)
+{
+    FILE *pt_file;
+    char *pc_path;
+    int ai_matrix[7];
+
+    if(g_i_calibset)
+        return;
+    pc_path = getenv("TSLIB_CALIBFILE");
+    pt_file = fopen(pc_path ? pc_path : EVDEV_DEFAULT_CALIBFILE, "r");
+    if(!pt_file)
+        return;
+    if(fscanf(pt_file, "%d %d %d %d %d %d %d", &ai_matrix[0], &ai_matrix[1], &ai_matrix[2],
+              &ai_matrix[3], &ai_matrix[4], &ai_matrix[5], &ai_matrix[6]) == 7 && ai_matrix[6] != 0)
+        memcpy(g_ai_calib, ai_matrix, sizeof(g_ai_calib));
+    fclose(pt_file);
+}
+
+/*
+读取多点触摸设备 0 号槽的一个轴的当前值
+输入参数：轴（ABS_MT_*），值
+*/
+static int evdevtouch_getslot0(unsigned int i_code, int *pi_value)
+{
+    int ai_request[2];//EVIOCGMTSLOTS 的参数：轴，后面是各槽的值（这里只要 0 号槽）
+
+    ai_request[0] = i_code;
+    if(ioctl(g_i_evdevfd, EVIOCGMTSLOTS(sizeof(ai_request)), ai_request) < 0)
+        return -1;
+    *pi_value = ai_request[1];
+    return 0;
+}
+
+/*
+用 ioctl 读回设备的当前状态，初始化时和 SYN_DROPPED 之后调用
+*/
+static void evdevtouch_resync(void)
+{
+    struct input_absinfo t_absinfo;
+    int i_value;
+    unsigned long aul_keys[KEY_CNT / EVDEV_LONGBITS + 1];
+
+    if(g_i_mt)
+    {
+        //EVIOCGABS 返回的是当前槽的值，0 号槽的值用 EVIOCGMTSLOTS 读
+        if(ioctl(g_i_evdevfd, EVIOCGABS(ABS_MT_SLOT), &t_absinfo) == 0)
+            g_i_slot = t_absinfo.value;
+        if(evdevtouch_getslot0(ABS_MT_POSITION_X, &i_value) == 0)
+            g_i_rawx = i_value;
+        if(evdevtouch_getslot0(ABS_MT_POSITION_Y, &i_value) == 0)
+            g_i_rawy = i_value;
+        if(evdevtouch_getslot0(ABS_MT_TRACKING_ID, &i_value) == 0)
+            g_i_trackingid = i_value;
+        if(g_i_haspressure && evdevtouch_getslot0(ABS_MT_PRESSURE, &i_value) == 0)
+            g_i_rawpressure = i_value;
+    }
+    else
+    {
+        if(ioctl(g_i_evdevfd, EVIOCGABS(ABS_X), &t_absinfo) == 0)
+            g_i_rawx = t_absinfo.value;
+        if(ioctl(g_i_evdevfd, EVIOCGABS(ABS_Y), &t_absinfo) == 0)
+            g_i_rawy = t_absinfo.value;
+        if(g_i_haspressure && ioctl(g_i_evdevfd, EVIOCGABS(ABS_PRESSURE), &t_absinfo) == 0)
+            g_i_rawpressure = t_absinfo.value;
+    }
+    memset(aul_keys, 0, sizeof(aul_keys));
+    if(g_i_hasbtntouch && ioctl(g_i_evdevfd, EVIOCGKEY(sizeof(aul_keys)), aul_keys) >= 0)
+        g_i_btntouch = EVDEV_TESTBIT(aul_keys, BTN_TOUCH);
+}
+
+//设备初始化：非阻塞打开设备文件，探测设备能力 （输入设备初始化流程2.1）
+static int evdevtouch_deviceinit(void)
+{
+    unsigned long aul_absbits[ABS_CNT / EVDEV_LONGBITS + 1];
+    unsigned long aul_keybits[KEY_CNT / EVDEV_LONGBITS + 1];
+    char *pc_device = g_pc_evdevdevice;
+
+    if(!pc_device)
+        pc_device = getenv("TSLIB_TSDEVICE");//和 tslib 用同一个环境变量，切换后端不用改现场配置
+    if(!pc_device)
+        pc_device = EVDEV_DEFAULT_DEVICE;
+    //非阻塞打开，由输入管理层的反应器 epoll 等待
+    g_i_evdevfd = open(pc_device, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if(g_i_evdevfd < 0)
+    {
+        printf("open %s err\n", pc_device);
+        return -1;
+    }
+
+    memset(aul_absbits, 0, sizeof(aul_absbits));
+    memset(aul_keybits, 0, sizeof(aul_keybits));
+    ioctl(g_i_evdevfd, EVIOCGBIT(EV_ABS, sizeof(aul_absbits)), aul_absbits);
+    ioctl(g_i_evdevfd, EVIOCGBIT(EV_KEY, sizeof(aul_keybits)), aul_keybits);
+    g_i_mt = EVDEV_TESTBIT(aul_absbits, ABS_MT_SLOT) && EVDEV_TESTBIT(aul_absbits, ABS_MT_POSITION_X);
+    if(!g_i_mt && !EVDEV_TESTBIT(aul_absbits, ABS_X))
+    {
+        printf("%s is not a touchscreen\n", pc_device);
+        close(g_i_evdevfd);
+        g_i_evdevfd = -1;
+        return -1;
+    }
+    g_i_haspressure = EVDEV_TESTBIT(aul_absbits, g_i_mt ? ABS_MT_PRESSURE : ABS_PRESSURE);
+    g_i_hasbtntouch = EVDEV_TESTBIT(aul_keybits, BTN_TOUCH);
+    //单点设备既没有 BTN_TOUCH 也没有压力轴时无法判断按下和抬起，交给 tslib 后端
+    if(!g_i_mt && !g_i_hasbtntouch && !g_i_haspressure)
+    {
+        printf("%s reports neither BTN_TOUCH nor pressure, use the tslib backend\n", pc_device);
+        close(g_i_evdevfd);
+        g_i_evdevfd = -1;
+        return -1;
+    }
+
+    evdevtouch_loadcalib();
+    evdevtouch_resync();
+    g_i_samplepos = g_i_samplecount = 0;
+    g_i_dirty = g_i_dropping = 0;
+    return 0;
+}
+
+/*
+处理一个 EV_ABS 或 EV_KEY 事件，更新正在组装的样本
+输入参数：事件
+*/
+static void evdevtouch_update(struct input_event *pt_event)
+{
+    if(pt_event->type == EV_KEY)
+    {
+        if(pt_event->code == BTN_TOUCH)
+        {
+            g_i_btntouch = pt_event->value;
+            g_i_dirty = 1;
+        }
+        return;
+    }
+    if(g_i_mt)
+    {
+        if(pt_event->code == ABS_MT_SLOT)
+        {
+            g_i_slot = pt_event->value;
+            return;
+        }
+        if(g_i_slot != 0)
+            return;
+        switch(pt_event->code)
+        {
+        case ABS_MT_POSITION_X:  g_i_rawx = pt_event->value; break;
+        case ABS_MT_POSITION_Y:  g_i_rawy = pt_event->value; break;
+        case ABS_MT_PRESSURE:    g_i_rawpressure = pt_event->value; break;
+        case ABS_MT_TRACKING_ID: g_i_trackingid = pt_event->value; break;
+        default: return;
+        }
+    }
+    else
+    {
+        switch(pt_event->code)
+        {
+        case ABS_X:        g_i_rawx = pt_event->value; break;
+        case ABS_Y:        g_i_rawy = pt_event->value; break;
+        case ABS_PRESSURE: g_i_rawpressure = pt_event->value; break;
+        default: return;
+        }
+    }
+    g_i_dirty = 1;
+}
+
+/*
+在 SYN_REPORT 处把当前状态做成一个样本：判断按下、换算坐标、带上内核时间戳
+输入参数：SYN_REPORT 事件，样本
+*/
+static void evdevtouch_makesample(struct input_event *pt_event, p_evdevsample pt_sample)
+{
+    int i_down;
+
+    if(g_i_mt)
+        i_down = g_i_trackingid >= 0;
+    else if(g_i_hasbtntouch)
+        i_down = g_i_btntouch;
+    else
+        i_down = g_i_rawpressure > 0;
+
+    pt_sample->i_x = ((long long)g_ai_calib[2] + (long long)g_ai_calib[0] * g_i_rawx
+                      + (long long)g_ai_calib[1] * g_i_rawy) / g_ai_calib[6];
+    pt_sample->i_y = ((long long)g_ai_calib[5] + (long long)g_ai_calib[3] * g_i_rawx
+                      + (long long)g_ai_calib[4] * g_i_rawy) / g_ai_calib[6];
+    if(!i_down)
+        pt_sample->i_pressure = 0;
+    else
+        pt_sample->i_pressure = (g_i_haspressure && g_i_rawpressure > 0) ? g_i_rawpressure : EVDEV_NOPRESSURE;
+    pt_sample->tTime.tv_sec  = pt_event->input_event_sec;
+    pt_sample->tTime.tv_usec = pt_event->input_event_usec;
+}
+
+/*
+把一批事件组装成样本，放入 g_at_samples
+输入参数：事件个数
+返回值：组装出的样本数
+*/
+static unsigned int evdevtouch_parse(unsigned int i_count)
+{
+    struct input_event *pt_event;
+    unsigned int i, i_samples = 0;
+
+    for(i = 0; i < i_count; i++)
+    {
+        pt_event = &g_at_events[i];
+        if(pt_event->type == EV_SYN)
+        {
+            if(pt_event->code == SYN_DROPPED)
+            {
+                g_i_dropping = 1;
+                EVDEV_ADD(g_t_evdevstat.drops, 1);
+            }
+            else if(pt_event->code == SYN_REPORT)
+            {
+                if(g_i_dropping)
+                {
+                    //丢掉的事件可能改变了任何状态，读回设备的当前状态再报一个样本
+                    g_i_dropping = 0;
+                    evdevtouch_resync();
+                    g_i_dirty = 1;
+                }
+                if(g_i_dirty)
+                {
+                    evdevtouch_makesample(pt_event, &g_at_samples[i_samples++]);
+                    g_i_dirty = 0;
+                }
+            }
+        }
+        else if(!g_i_dropping && (pt_event->type == EV_ABS || pt_event->type == EV_KEY))
+            evdevtouch_update(pt_event);
+    }
+    return i_samples;
+}
+
+/*
+非阻塞读取一个触摸样本，向上报的数据结构中填充事件类型、坐标、压力、时间戳
+上一批的样本交完后才读设备，一次 read 读入一批事件
+输入参数：上报的数据结构
+返回值：0 读到，1 暂时没有样本，-1 出错
+*/
+static int evdevtouch_draininputevent(p_inputevent pt_inputevent)
+{
+    struct timespec t_start, t_end;
+    struct timeval t_now;
+    unsigned long long l_cost;
+    long long l_latency;
+    p_evdevsample pt_sample;
+    ssize_t i_len;
+
+    while(g_i_samplepos == g_i_samplecount)
+    {
+        //读取和组装一起计入处理开销；没有数据的那次 read 也算，和 tslib 后端的统计口径相同
+        clock_gettime(CLOCK_MONOTONIC, &t_start);
+        i_len = read(g_i_evdevfd, g_at_events, sizeof(g_at_events));
+        if(i_len > 0)
+        {
+            g_i_samplepos = 0;
+            g_i_samplecount = evdevtouch_parse(i_len / sizeof(struct input_event));
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t_end);
+        l_cost = (t_end.tv_sec - t_start.tv_sec) * 1000000000ULL + t_end.tv_nsec - t_start.tv_nsec;
+        EVDEV_ADD(g_t_evdevstat.reads, 1);
+        EVDEV_ADD(g_t_evdevstat.cost_ns, l_cost);
+        if(l_cost > g_t_evdevstat.max_cost_ns)
+            __atomic_store_n(&g_t_evdevstat.max_cost_ns, l_cost, __ATOMIC_RELAXED);
+        if(i_len < 0)
+            return (errno == EAGAIN || errno == EINTR) ? 1 : -1;
+        if(i_len == 0)
+            return -1;
+    }
+
+    pt_sample = &g_at_samples[g_i_samplepos++];
+    pt_inputevent->i_type     = INPUT_TYPE_TOUCH;
+    pt_inputevent->i_x        = pt_sample->i_x;
+    pt_inputevent->i_y        = pt_sample->i_y;
+    pt_inputevent->i_pressure = pt_sample->i_pressure;
+    pt_inputevent->tTime      = pt_sample->tTime;
+
+    gettimeofday(&t_now, NULL);
+    l_latency = (t_now.tv_sec - pt_sample->tTime.tv_sec) * 1000000LL + t_now.tv_usec - pt_sample->tTime.tv_usec;
+    EVDEV_ADD(g_t_evdevstat.samples, 1);
+    if(l_latency > 0)
+        EVDEV_ADD(g_t_evdevstat.latency_us, l_latency);
+    return 0;
+}
+
+/*
+阻塞读取一个触摸样本（设备是非阻塞打开的，没有样本时用 poll 等待）
+输入参数：上报的数据结构
+*/
+static int evdevtouch_getinputevent(p_inputevent pt_inputevent)
+{
+    struct pollfd t_pollfd;
+    int ret;
+
+    while((ret = evdevtouch_draininputevent(pt_inputevent)) == 1)
+    {
+        t_pollfd.fd = g_i_evdevfd;
+        t_pollfd.events = POLLIN;
+        poll(&t_pollfd, 1, -1);
+    }
+    return ret;
+}
+
+//设备文件描述符，由反应器监听
+static int evdevtouch_getfd(void)
+{
+    return g_i_evdevfd;
+}
+
+/*
+设备清除
+*/
+static int evdevtouch_deviceexit(void)
+{
+    if(g_i_evdevfd >= 0)
+        close(g_i_evdevfd);
+    g_i_evdevfd = -1;
+    return 0;
+}
+
+/*
+evdev 触摸屏设备接口封装（inputdevice 结构体）
+*/
+static inputdevice g_t_evdevtouch_dev ={
+    .name = "evdevtouch",
+    .deviceinit         = evdevtouch_deviceinit,
+    .get_inputevent     = evdevtouch_getinputevent,
+    .deviceexit         = evdevtouch_deviceexit,
+    .get_fd             = evdevtouch_getfd,
+    .drain_inputevent   = evdevtouch_draininputevent,
+};
+
+/*
+注册 evdev 触摸屏结构体  （输入初始化流程1.1）
+输入参数：设备文件，NULL 表示 TSLIB_TSDEVICE 环境变量或 EVDEV_DEFAULT_DEVICE
+*/
+void evdevtouch_register(char *a_devname)
+{
+    g_pc_evdevdevice = a_devname;
+    register_inputdevice(&g_t_evdevtouch_dev);
+}
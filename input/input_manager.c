@@ -1,51 +1,339 @@
 /*
-该文件是输入系统的核心管理中间层，目标是实现 “多输入源并行处理”“线程安全的事件传递”“上层业务无感知对接”，具体设计思路体现在 4 个方面：
+该文件是输入系统的核心管理中间层，目标是实现 “多输入源并行处理”“线程安全的事件传递”“上层业务无感知对接”，具体设计思路体现在 5 个方面：
 1. 多设备管理：链表 + 统一接口
 用 g_inputdevs 链表管理所有输入设备，通过 inputdevice 结构体标准化接口（deviceinit/get_inputevent），新增设备（如按键输入）只需实现接口并注册，无需修改核心逻辑；
-遍历链表初始化设备并创建线程，实现多设备并行处理，避免单线程阻塞。
-2. 线程同步：互斥锁 + 条件变量
-互斥锁（g_tMutex）保护 “缓冲区读写”“设备链表操作” 等临界区，防止多线程（如 2 个生产者线程 + 1 个消费者线程）数据竞争；
-条件变量（g_tConVar）实现 “生产者 - 消费者” 同步：生产者写数据后唤醒消费者，消费者无数据时等待，避免 CPU 空转。
-3. 事件暂存：环形缓冲区
-用环形缓冲区暂存事件，解耦 “事件读取”（生产者线程）与 “事件处理”（上层业务）：
-避免生产者线程因 “消费者处理慢” 导致事件丢失；
-避免消费者线程因 “生产者无数据” 导致阻塞；
-环形结构实现缓冲区复用，比线性缓冲区更高效。
-4. 上层接口统一：get_inputevent
+遍历链表初始化设备：能提供文件描述符和非阻塞读取的设备由一个反应器线程用 epoll 统一监听，可读时一次读到没有数据为止；
+只有阻塞读取接口的旧设备仍各用一个兼容线程，读取出错时逐渐延长重试间隔，不会空转占满一个核。
+2. 线程同步：无锁队列 + futex
+以前用互斥锁和条件变量保护 20 个事件的环形缓冲区，触摸和成批到来的 UDP 进度消息同时写入时，生产者线程和界面线程争同一把锁，缓冲区满时事件被悄悄丢掉；
+现在是有界的多生产者单消费者无锁队列：生产者用 CAS 占位，写完事件后发布序号，互不等待，也不等消费者；
+消费者（界面线程）只在队列为空时才在 futex 上睡眠，生产者只在消费者睡眠时才唤醒它，平时没有系统调用。
+3. 事件暂存：2 的幂容量的环形队列
+容量由 setinputqueuesize 在 input_deviceinit 之前设置（向上取整为 2 的幂），下标用掩码回绕；
+队列满时丢弃新事件并计数，入队、出队、丢弃次数由 getinputqueuestat 获取，用来确定现场需要的容量。
+4. 事件头部 + 载荷池
+事件只有时间、类型、坐标、压力、设备编号等固定的小头部，每个队列槽占一个缓存行；
+网络消息等变长数据放在预先分配的载荷池中（无锁的空闲栈，池用完时直接分配），设备直接收进载荷缓冲区，事件只带指针，
+经过队列交给上层时不再拷贝，上层用完后 inputevent_release 还回池中。
+5. 上层接口统一：get_inputevent
 上层业务只需调用 get_inputevent 即可读取所有输入设备的事件，无需区分触摸、网络等输入源，实现 “输入源无关性”；
 封装同步与缓冲区细节，降低上层开发复杂度。
+6. 触摸屏后端的选择
+默认经过 tslib；settouchscreen 在 input_system_register 之前可以改为直接读取 evdev 的后端，两个后端只注册一个，
+每个样本的处理开销由 gettouchscreenstat 获取，用来在现场比较两条路径。
 */
 
-#include <pthread.h>    // 线程库头文件（线程创建、互斥锁、条件变量）
+#include <pthread.h>    // 线程库头文件（线程创建）
 #include <stdio.h>      // 标准输入输出（调试打印）
-#include <unistd.h>     // 系统调用（无显式用，为线程相关依赖兜底）
-#include <semaphore.h>  // 信号量头文件（虽未显式用，为同步机制标准依赖）
-#include <string.h>     // 字符串操作（无显式用，为输入事件结构体拷贝兜底）
+#include <stdlib.h>     // 内存分配（队列的槽数组、载荷池）
+#include <unistd.h>     // 系统调用（syscall）
+#include <string.h>     // 字符串操作（strcmp 选择触摸屏后端）
+#include <limits.h>     // INT_MAX（futex 唤醒全部等待者）
+#include <sys/syscall.h>// SYS_futex
+#include <sys/epoll.h>  // 反应器线程（epoll_create1、epoll_wait）
+#include <linux/futex.h>// FUTEX_WAIT_PRIVATE、FUTEX_WAKE_PRIVATE
 
 #include <input_manager.h>   // 输入系统头文件（定义 inputdevice/inputevent 结构体、函数声明）
 
 
-//初始化一个互斥锁,保护“环形缓冲区读写”“设备链表操作”等临界区，防止多线程数据竞争
-static pthread_mutex_t g_tMutex  = PTHREAD_MUTEX_INITIALIZER;
-//初始化条件变量（在互斥锁中临时释放锁）实现“读事件线程”与“取事件线程”的同步（无数据时等待，有数据时唤醒）
-static pthread_cond_t  g_tConVar = PTHREAD_COND_INITIALIZER;
 //初始化输入设备链表的头指针为空，准备后续挂载设备
 static p_inputdevice g_inputdevs = NULL;
+static int g_i_sources = 0;//已注册的设备数，用来分配设备编号
+static int g_i_touchevdev = 0;                     //触摸屏后端：0 tslib，1 evdev
+static char *g_pc_touchdevice = NULL;              //触摸屏的设备文件，NULL 表示后端的默认值
 
-//start of 实现环形buffer
-#define BUFFER_LEN 20 //环形缓冲区最大容量（最多存 20 个输入事件）
-static int gi_read = 0;// 缓冲区读指针（指向待读取的事件位置）
-static int gi_write = 0;// 缓冲区写指针（指向待写入的事件位置）
-static inputevent g_atinputevent[BUFFER_LEN];// 环形缓冲区数组（存储 inputevent 结构体）
+static void *input_recv_thread_func(void *data);
+static void *input_reactor_thread_func(void *data);
+static void put_inputevent_tobuffer(p_inputevent pt_inputevent);
+static int get_inputevent_frombuffer(p_inputevent pt_inputevent);
+
+#define INPUT_EPOLL_EVENTS 8      //反应器一次 epoll_wait 取回的最多设备数
+#define INPUT_RETRY_MAX_US 200000 //兼容线程读取出错时的最长重试间隔，微秒
+#define INPUT_ERRORS_MAX 8        //反应器中设备连续出错这么多次才停止监听
+static int g_i_epollfd = -1;      //反应器的 epoll 文件描述符
+
+//start of 实现无锁队列
+#define INPUT_QUEUE_DEFAULT 256 //默认容量（事件个数）
+
+#define INPUT_CACHELINE 64
+
+/*
+队列的槽，每个槽单独占一个缓存行，相邻槽的生产者不会互相抢缓存行
+i_seq 是这个槽的序号：等于写位置时可以写，等于写位置+1 时已写好可以读，读完后加上容量留给下一圈
+*/
+typedef struct inputslot
+{
+    unsigned int i_seq;
+    inputevent t_event;
+}__attribute__((aligned(INPUT_CACHELINE))) inputslot,*p_inputslot;
+
+static p_inputslot g_pt_slots = NULL;              //槽数组，input_deviceinit 时分配
+static unsigned int g_i_capacity = INPUT_QUEUE_DEFAULT;//容量，2 的幂
+static unsigned int g_i_mask;                       //容量-1，下标回绕用
+static unsigned int g_i_write = 0;                  //下一个写位置（生产者之间 CAS）
+static unsigned int g_i_read = 0;                   //下一个读位置（只有消费者使用）
+static int g_i_futex = 0;                           //唤醒计数，消费者在它上面睡眠
+static int g_i_sleeping = 0;                        //消费者正在（或准备）睡眠
+static inputqueuestat g_t_inputqueuestat;           //入队、出队、丢弃计数（原子地增加）
+
+//载荷池
+#define INPUT_PAYLOAD_DEFAULT 128 //默认载荷个数的下限（建立池时至少是设备占着的载荷加上队列容量）
+#define INPUT_PAYLOAD_MAX (1U << 16) //载荷个数的上限
+#define INPUT_PAYLOAD_STRIDE  ((sizeof(inputpayload) + INPUT_PAYLOAD_SIZE + INPUT_CACHELINE - 1) & ~(INPUT_CACHELINE - 1))
+
+static unsigned char *g_puc_payloads = NULL;        //载荷数组，每个 INPUT_PAYLOAD_STRIDE 字节
+static unsigned int *g_pi_payloadnext = NULL;       //空闲栈中下一个载荷的序号+1，0 表示栈底
+static unsigned int g_i_payloads = INPUT_PAYLOAD_DEFAULT;
+//空闲栈的栈顶：低 32 位是载荷序号+1（0 表示空），高 32 位是每次修改都加一的标记，防止 CAS 的 ABA 问题
+static unsigned long long g_l_payloadtop = 0;
+
+static long input_futex(int *pi_addr, int i_op, int i_val)
+{
+    return syscall(SYS_futex, pi_addr, i_op, i_val, NULL, NULL, 0);
+}
+
+/*
+设置输入事件队列的容量（输入初始化流程1 之后、流程2 之前）
+输入参数：事件个数，向上取整为 2 的幂
+返回值：队列已经建立（input_deviceinit 之后）时返回 -1
+*/
+int setinputqueuesize(unsigned int i_capacity)
+{
+    unsigned int i_size = 2;
+
+    if(g_pt_slots || i_capacity == 0 || i_capacity > (1U << 20))
+        return -1;
+    while(i_size < i_capacity)
+        i_size <<= 1;
+    g_i_capacity = i_size;
+    return 0;
+}
+
+/*
+获取输入事件队列的统计
+输入参数：统计结构体指针
+*/
+int getinputqueuestat(p_inputqueuestat pt_inputqueuestat)
+{
+    pt_inputqueuestat->enqueued = __atomic_load_n(&g_t_inputqueuestat.enqueued, __ATOMIC_RELAXED);
+    pt_inputqueuestat->dequeued = __atomic_load_n(&g_t_inputqueuestat.dequeued, __ATOMIC_RELAXED);
+    pt_inputqueuestat->dropped  = __atomic_load_n(&g_t_inputqueuestat.dropped, __ATOMIC_RELAXED);
+    pt_inputqueuestat->capacity = g_i_capacity;
+    pt_inputqueuestat->payloads = g_i_payloads;
+    pt_inputqueuestat->payload_mallocs = __atomic_load_n(&g_t_inputqueuestat.payload_mallocs, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/*
+设置载荷池的大小（与 setinputqueuesize 一样在 input_deviceinit 之前调用）
+建立池时还要留出设备一直占着的载荷（inputdevice 的 i_payloads）和队列装满时在途的载荷，这里设置的值更小时按这个下限；
+超过池大小的载荷（如上层长时间持有）直接分配，并在统计中计数
+输入参数：载荷个数
+返回值：池已经建立时返回 -1
+*/
+int setinputpayloadpool(unsigned int i_count)
+{
+    if(g_puc_payloads || i_count == 0 || i_count > INPUT_PAYLOAD_MAX)
+        return -1;
+    g_i_payloads = i_count;
+    return 0;
+}
+
+static p_inputpayload inputpayload_at(unsigned int i_index)
+{
+    return (p_inputpayload)(g_puc_payloads + (size_t)i_index * INPUT_PAYLOAD_STRIDE);
+}
+
+//把载荷压回空闲栈（任何线程）
+static void inputpayload_push(unsigned int i_index)
+{
+    unsigned long long l_top = __atomic_load_n(&g_l_payloadtop, __ATOMIC_RELAXED);
+    unsigned long long l_new;
+
+    do
+    {
+        __atomic_store_n(&g_pi_payloadnext[i_index], (unsigned int)l_top, __ATOMIC_RELAXED);
+        l_new = ((l_top >> 32) + 1) << 32 | (i_index + 1);
+    }while(!__atomic_compare_exchange_n(&g_l_payloadtop, &l_top, l_new, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+取得一个载荷（设备线程调用）
+从池的空闲栈弹出一个，池用完时直接分配；引用计数为1，放进事件后随事件交给上层
+返回值：载荷，失败返回 NULL
+*/
+p_inputpayload inputpayload_get(void)
+{
+    unsigned long long l_top = __atomic_load_n(&g_l_payloadtop, __ATOMIC_ACQUIRE);
+    unsigned long long l_new;
+    unsigned int i_index;
+    p_inputpayload pt_payload;
+
+    while((unsigned int)l_top)
+    {
+        i_index = (unsigned int)l_top - 1;
+        l_new = ((l_top >> 32) + 1) << 32 | __atomic_load_n(&g_pi_payloadnext[i_index], __ATOMIC_RELAXED);
+        if(__atomic_compare_exchange_n(&g_l_payloadtop, &l_top, l_new, 1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+        {
+            pt_payload = inputpayload_at(i_index);
+            pt_payload->i_refs = 1;
+            pt_payload->i_len = 0;
+            pt_payload->ac_data[0] = '\0';
+            return pt_payload;
+        }
+    }
+
+    pt_payload = malloc(sizeof(inputpayload) + INPUT_PAYLOAD_SIZE);
+    if(!pt_payload)
+        return NULL;
+    __atomic_fetch_add(&g_t_inputqueuestat.payload_mallocs, 1, __ATOMIC_RELAXED);
+    pt_payload->i_refs = 1;
+    pt_payload->i_index = -1;
+    pt_payload->i_len = 0;
+    pt_payload->i_size = INPUT_PAYLOAD_SIZE;
+    pt_payload->ac_data[0] = '\0';
+    return pt_payload;
+}
+
+/*
+增加载荷的引用（上层要把载荷交给别的线程或留到以后用时）
+*/
+void inputpayload_hold(p_inputpayload pt_payload)
+{
+    __atomic_fetch_add(&pt_payload->i_refs, 1, __ATOMIC_RELAXED);
+}
+
+/*
+释放载荷的引用，为0时还回池中（直接分配的释放掉）
+*/
+void inputpayload_release(p_inputpayload pt_payload)
+{
+    if(!pt_payload || __atomic_sub_fetch(&pt_payload->i_refs, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+    if(pt_payload->i_index < 0)
+        free(pt_payload);
+    else
+        inputpayload_push(pt_payload->i_index);
+}
+
+/*
+上层处理完 get_inputevent 取到的事件后调用，释放事件带的载荷
+输入参数：上报的数据结构体指针
+*/
+void inputevent_release(p_inputevent pt_inputevent)
+{
+    inputpayload_release(pt_inputevent->pt_payload);
+    pt_inputevent->pt_payload = NULL;
+}
+
+/*
+建立载荷池：分配载荷数组，全部压入空闲栈
+池的大小至少是所有设备占着的载荷加上队列容量，网络设备预取一整批之后，队列装满时在途的事件仍然从池中取载荷，不会退回逐个分配
+*/
+static int input_payloadinit(void)
+{
+    unsigned int i;
+    unsigned long l_need = g_i_capacity;
+    p_inputdevice pt_tmp;
+
+    if(g_puc_payloads)
+        return 0;
+    for(pt_tmp = g_inputdevs; pt_tmp; pt_tmp = pt_tmp->pt_next)
+        l_need += pt_tmp->i_payloads;
+    if(l_need > INPUT_PAYLOAD_MAX)
+        l_need = INPUT_PAYLOAD_MAX;
+    if(g_i_payloads < l_need)
+        g_i_payloads = l_need;
+    g_pi_payloadnext = calloc(g_i_payloads, sizeof(unsigned int));
+    if(!g_pi_payloadnext || posix_memalign((void **)&g_puc_payloads, INPUT_CACHELINE, (size_t)g_i_payloads * INPUT_PAYLOAD_STRIDE))
+    {
+        printf("input payload malloc err\n");
+        free(g_pi_payloadnext);
+        g_pi_payloadnext = NULL;
+        g_puc_payloads = NULL;
+        return -1;
+    }
+    for(i = g_i_payloads; i > 0; i--)
+    {
+        inputpayload_at(i - 1)->i_index = i - 1;
+        inputpayload_at(i - 1)->i_size = INPUT_PAYLOAD_SIZE;
+        inputpayload_push(i - 1);
+    }
+    return 0;
+}
+
+/*
+建立队列：分配槽数组（按缓存行对齐），每个槽的序号初始化为它的下标；同时建立载荷池
+*/
+static int input_queueinit(void)
+{
+    unsigned int i;
+
+    if(input_payloadinit())
+        return -1;
+    if(g_pt_slots)
+        return 0;
+    if(posix_memalign((void **)&g_pt_slots, INPUT_CACHELINE, g_i_capacity * sizeof(inputslot)))
+    {
+        g_pt_slots = NULL;
+        printf("input queue malloc err\n");
+        return -1;
+    }
+    for(i = 0; i < g_i_capacity; i++)
+        g_pt_slots[i].i_seq = i;
+    g_i_mask = g_i_capacity - 1;
+    g_t_inputqueuestat.capacity = g_i_capacity;
+    return 0;
+}
+
+/*
+选择触摸屏后端，在 input_system_register 之前调用
+输入参数：后端名称（TOUCHSCREEN_TSLIB 或 TOUCHSCREEN_EVDEV，NULL 表示 tslib），设备文件（NULL 表示后端的默认值）
+返回值：后端名称不认识或设备已经注册时返回 -1
+*/
+int settouchscreen(char *a_backend, char *a_devname)
+{
+    if(g_i_sources)
+        return -1;
+    if(!a_backend || strcmp(a_backend, TOUCHSCREEN_TSLIB) == 0)
+        g_i_touchevdev = 0;
+    else if(strcmp(a_backend, TOUCHSCREEN_EVDEV) == 0)
+        g_i_touchevdev = 1;
+    else
+    {
+        printf("unknown touchscreen backend %s\n", a_backend);
+        return -1;
+    }
+    g_pc_touchdevice = a_devname;
+    return 0;
+}
+
+/*
+获取正在使用的触摸屏后端的统计
+输入参数：统计结构体指针
+*/
+int gettouchscreenstat(p_touchscreenstat pt_touchscreenstat)
+{
+    extern int touchscreen_getstat(p_touchscreenstat pt_touchscreenstat);
+    extern int evdevtouch_getstat(p_touchscreenstat pt_touchscreenstat);
+
+    if(g_i_touchevdev)
+        return evdevtouch_getstat(pt_touchscreenstat);
+    return touchscreen_getstat(pt_touchscreenstat);
+}
 
 /*
 输入系统注册（输入初始化流程1）
-也就是把两个输入设备结构体都注册到链表中  
+也就是把两个输入设备结构体都注册到链表中（触摸屏只注册 settouchscreen 选择的后端）
 */
 void input_system_register(void)
 {
-    extern void touchscreen_register(void); // 声明外部函数
-    touchscreen_register(); //调用，触发触摸屏注册
+    extern void touchscreen_register(char *a_devname); // 声明外部函数
+    extern void evdevtouch_register(char *a_devname);
+    if(g_i_touchevdev)
+        evdevtouch_register(g_pc_touchdevice); //直接读取 evdev 的触摸屏
+    else
+        touchscreen_register(g_pc_touchdevice); //调用，触发触摸屏注册
 
     extern void netinput_register(void);// 声明外部函数
     netinput_register(); //调用，触发网络输入注册
@@ -57,6 +345,7 @@ void input_system_register(void)
 //两设备都初始化执行完毕后。g_inputdevs为网络输入结构体。触摸屏结构体的pt_next为NULL。网络输入结构体的pt_next为触摸屏结构体。
 void register_inputdevice(p_inputdevice pt_inputdev)
 {
+    pt_inputdev->i_source = g_i_sources++; // 分配设备编号
     pt_inputdev->pt_next = g_inputdevs; // 新设备的 next 指向当前链表头
     g_inputdevs = pt_inputdev;          // 链表头更新为新设备（头插法）
 }
@@ -66,7 +355,9 @@ void register_inputdevice(p_inputdevice pt_inputdev)
 
 /*
 输入设备初始化（输入设备初始化流程2）
-遍历输入设备链表。从链表中取出设备，设备初始化然后创建一个线程。 
+遍历输入设备链表。从链表中取出设备，设备初始化后：
+提供 get_fd 和 drain_inputevent 的设备加入反应器的 epoll，所有这样的设备共用一个反应器线程；
+只提供 get_inputevent 的设备创建一个兼容线程阻塞读取
 pt_tmp->deviceinit时调用的是inputdevice类型结构体的设备接口输入
 也就是触摸屏结构体的.deviceinit     = touchscreen_deviceinit,
 和网络输入结构体的.deviceinit     = net_deviceinit,
@@ -74,26 +365,103 @@ pt_tmp->deviceinit时调用的是inputdevice类型结构体的设备接口输入
 void input_deviceinit(void)
 {
     int ret;
+    int i_fd;
+    int i_polled = 0;//加入 epoll 的设备数
     pthread_t tid;// 线程 ID（存储创建的线程标识）
-    //对于每一个输入设备都先初始化设备，然后创建线程
+    struct epoll_event t_epollevent;
     p_inputdevice pt_tmp = g_inputdevs;
+
+    //先建立事件队列，设备线程一启动就可能写入
+    if(input_queueinit())
+        return;
     while(pt_tmp)
     {
-        //// 1. 初始化当前设备（调用设备自带的初始化函数）
+        //// 1. 初始化当前设备（调用设备自带的初始化函数），失败的设备不再读取
         ret = pt_tmp->deviceinit();
-        //创建线程
-        if(!ret)
+        if(ret)
+        {
+            printf("input device %s init err\n", pt_tmp->name);
+            pt_tmp = pt_tmp->pt_next;
+            continue;
+        }
+
+        //// 2. 能轮询的设备交给反应器
+        i_fd = (pt_tmp->get_fd && pt_tmp->drain_inputevent) ? pt_tmp->get_fd() : -1;
+        if(i_fd >= 0)
         {
-            ret = pthread_create(&tid,NULL,input_recv_thread_func,pt_tmp);
+            if(g_i_epollfd < 0)
+                g_i_epollfd = epoll_create1(EPOLL_CLOEXEC);
+            t_epollevent.events = EPOLLIN;
+            t_epollevent.data.ptr = pt_tmp;
+            if(g_i_epollfd >= 0 && epoll_ctl(g_i_epollfd, EPOLL_CTL_ADD, i_fd, &t_epollevent) == 0)
+            {
+                i_polled++;
+                pt_tmp = pt_tmp->pt_next;
+                continue;
+            }
+            printf("input device %s epoll err\n", pt_tmp->name);
         }
+
+        //// 3. 只能阻塞读取的设备（或加入 epoll 失败）用兼容线程
+        if(pt_tmp->get_inputevent)
+            pthread_create(&tid,NULL,input_recv_thread_func,pt_tmp);
         pt_tmp = pt_tmp->pt_next;
     }
+    if(i_polled)
+        pthread_create(&tid,NULL,input_reactor_thread_func,NULL);
+}
+
+
+/*
+反应器线程   （输入设备初始化流程3）
+用 epoll 等待所有能轮询的设备，某个设备可读时反复调用它的 drain_inputevent，直到暂时没有数据，读到的事件逐个写入队列；
+设备报告出错时先计数，读到数据后清零：一次含糊的读取错误（如驱动把“暂时没有数据”报成出错）不会让设备永久失效；
+描述符挂断（EPOLLHUP、EPOLLERR）或连续出错 INPUT_ERRORS_MAX 次时才从 epoll 中删除，不会因为一个坏设备一直被唤醒
+*/
+static void *input_reactor_thread_func(void *data)
+{
+    struct epoll_event at_epollevents[INPUT_EPOLL_EVENTS];
+    p_inputdevice pt_inputdev;
+    inputevent t_event;
+    int i_count, i, ret;
+
+    while(1)
+    {
+        i_count = epoll_wait(g_i_epollfd, at_epollevents, INPUT_EPOLL_EVENTS, -1);
+        for(i = 0; i < i_count; i++)
+        {
+            pt_inputdev = at_epollevents[i].data.ptr;
+            while(1)
+            {
+                t_event.pt_payload = NULL;
+                ret = pt_inputdev->drain_inputevent(&t_event);
+                if(ret)
+                    break;
+                t_event.i_source = pt_inputdev->i_source;
+                put_inputevent_tobuffer(&t_event);
+                pt_inputdev->i_errors = 0;
+            }
+            if(ret > 0)
+            {
+                pt_inputdev->i_errors = 0;
+                continue;
+            }
+            pt_inputdev->i_errors++;
+            if((at_epollevents[i].events & (EPOLLHUP | EPOLLERR)) || pt_inputdev->i_errors >= INPUT_ERRORS_MAX)
+            {
+                printf("input device %s err, stop polling\n", pt_inputdev->name);
+                epoll_ctl(g_i_epollfd, EPOLL_CTL_DEL, pt_inputdev->get_fd(), NULL);
+            }
+        }
+    }
+    return NULL;
 }
 
 
 /*
-读取设备事件并写入缓冲区   （输入设备初始化流程3）
-不断调用getinputevent获取事件数据，读取数据函数后将事件数据写入缓冲区保存数据，唤醒等待数据的线程 
+兼容线程：读取设备事件并写入队列   （输入设备初始化流程3）
+不断调用getinputevent获取事件数据，读取数据函数后将事件数据写入队列，需要时唤醒等待数据的线程
+连续读取出错时每次把重试间隔加倍（最长 INPUT_RETRY_MAX_US），读到事件后恢复，出错的设备不会空转
 输入参数：任意数据
 
 pt_tmp作为输入参数其实也就是把设备的链表地址也就是把挂载的设备的inputdevice类型结构体的设备接口输入
@@ -106,113 +474,124 @@ static void *input_recv_thread_func(void *data)
     p_inputdevice t_inputdev = (p_inputdevice)data; // 转换参数：获取当前设备结构体
     inputevent t_event;// 临时存储读取到的输入事件结构体参数
     int ret;
+    int i_retry_us = 0;//当前的重试间隔
     while(1)
     {
-        //读取数据（阻塞式，无事件时等待）
+        //读取数据（阻塞式，无事件时等待）；不带载荷的设备（触摸屏）不用管 pt_payload
+        t_event.pt_payload = NULL;
         ret = t_inputdev->get_inputevent(&t_event);
         if(!ret)
         {
-            //保存数据，
-            pthread_mutex_lock(&g_tMutex);// 加锁：保护环形缓冲区（临界区操作，防止多线程同时写）
-            put_inputevent_tobuffer(&t_event);// 将事件写入缓冲区
-            pthread_cond_signal(&g_tConVar);// // 发送信号：唤醒等待事件的上层线程
-            pthread_mutex_unlock(&g_tMutex);// 解锁：释放临界区
+            i_retry_us = 0;
+            t_event.i_source = t_inputdev->i_source;
+            put_inputevent_tobuffer(&t_event);//写入队列，不加锁；载荷的引用随事件转交
+        }
+        else
+        {
+            i_retry_us = i_retry_us ? i_retry_us * 2 : 1000;
+            if(i_retry_us > INPUT_RETRY_MAX_US)
+                i_retry_us = INPUT_RETRY_MAX_US;
+            usleep(i_retry_us);
         }
     }
     return NULL;
 }
 
 /*
-向环形缓冲区写如输入参数中的数据 （输入设备初始化流程3.2）
+向队列写入输入参数中的数据 （输入设备初始化流程3.2）
+几个设备线程可以同时调用：先用 CAS 占住一个写位置，再拷贝事件，最后发布槽的序号；
+队列满时丢弃事件（释放它的载荷）并计数。写完后只有消费者在睡眠时才做 futex 唤醒
 输入参数：上报数据的结构体指针
 */
 static void put_inputevent_tobuffer(p_inputevent pt_inputevent)
 {
-    if(!is_inputbuffer_full()) // 缓冲区未满时才写入（避免溢出）
+    p_inputslot pt_slot;
+    unsigned int i_pos = __atomic_load_n(&g_i_write, __ATOMIC_RELAXED);
+    unsigned int i_seq;
+    int i_dif;
+
+    while(1)
     {
-        g_atinputevent[gi_write] = *pt_inputevent;// 拷贝事件到缓冲区当前写位置
-        gi_write =(gi_write + 1)% BUFFER_LEN; // 写指针后移，环形循环（超界时重置为 0）
+        pt_slot = &g_pt_slots[i_pos & g_i_mask];
+        i_seq = __atomic_load_n(&pt_slot->i_seq, __ATOMIC_ACQUIRE);
+        i_dif = (int)(i_seq - i_pos);
+        if(i_dif == 0)
+        {
+            //槽空着：占住这个写位置（失败时 i_pos 被更新为最新的写位置）
+            if(__atomic_compare_exchange_n(&g_i_write, &i_pos, i_pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if(i_dif < 0)
+        {
+            //消费者还没读走上一圈的事件：队列满
+            __atomic_fetch_add(&g_t_inputqueuestat.dropped, 1, __ATOMIC_RELAXED);
+            inputevent_release(pt_inputevent);
+            return;
+        }
+        else
+            i_pos = __atomic_load_n(&g_i_write, __ATOMIC_RELAXED);//别的生产者已经占了，重新取写位置
+    }
+
+    pt_slot->t_event = *pt_inputevent;// 拷贝事件头部到占住的槽，载荷只拷贝指针
+    __atomic_store_n(&pt_slot->i_seq, i_pos + 1, __ATOMIC_RELEASE);// 发布：消费者可以读了
+    __atomic_fetch_add(&g_t_inputqueuestat.enqueued, 1, __ATOMIC_RELAXED);
+
+    //发布和检查睡眠标志之间要全屏障，与消费者“先置睡眠标志再检查队列”配对，不会丢失唤醒
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&g_i_sleeping, __ATOMIC_RELAXED))
+    {
+        __atomic_fetch_add(&g_i_futex, 1, __ATOMIC_RELAXED);
+        input_futex(&g_i_futex, FUTEX_WAKE_PRIVATE, INT_MAX);
     }
 }
 
 /*
 上层业务读事件接口  （输入设备初始化流程4）
-调用函数从环形缓冲区中读取数据，放入输入参数中
+从队列中读取数据，放入输入参数中；队列为空时在 futex 上睡眠，直到有事件
+只能有一个线程调用（界面线程）；事件带载荷时，用完后调用 inputevent_release
 输入参数：上报的数据结构体指针
+返回值：成功返回0，还没有 input_deviceinit 时返回 -1
 */
 int get_inputevent(p_inputevent pt_inputevent)
 {
-    inputevent t_event;
-    int ret;
-    //无数据则休眠，有数据再写入
-    pthread_mutex_lock(&g_tMutex);
-    if(get_inputevent_frombuffer(&t_event))
-    {
-        *pt_inputevent = t_event;
-        pthread_mutex_unlock(&g_tMutex);
-        return 0;
-    }
-    else
+    int i_futex;
+
+    if(!g_pt_slots)
+        return -1;
+    while(!get_inputevent_frombuffer(pt_inputevent))
     {
-        //休眠等待，调用条件变量等待（自动释放锁，避免死锁）
-        pthread_cond_wait(&g_tConVar,&g_tMutex);
-        //唤醒后，再次尝试读取（防止“虚假唤醒”）
-        if(get_inputevent_frombuffer(&t_event))
+        //先取唤醒计数，再置睡眠标志并重新检查队列：
+        //检查之后才写入的生产者一定能看到睡眠标志并改变唤醒计数，FUTEX_WAIT 会立即返回
+        i_futex = __atomic_load_n(&g_i_futex, __ATOMIC_RELAXED);
+        __atomic_store_n(&g_i_sleeping, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if(get_inputevent_frombuffer(pt_inputevent))
         {
-            *pt_inputevent = t_event;
-            ret = 0;
+            __atomic_store_n(&g_i_sleeping, 0, __ATOMIC_RELAXED);
+            break;
         }
-        else
-        {
-            ret = -1;
-        }
-        pthread_mutex_unlock(&g_tMutex);
+        input_futex(&g_i_futex, FUTEX_WAIT_PRIVATE, i_futex);
+        __atomic_store_n(&g_i_sleeping, 0, __ATOMIC_RELAXED);
     }
-    return ret;
+    return 0;
 }
 
 
 /*
-取出环形缓冲区的数据存放在输入参数中  （输入设备初始化流程4.1）
+取出队列的数据存放在输入参数中  （输入设备初始化流程4.1）
+读位置的槽已发布时拷贝出事件，再把槽的序号推进一圈还给生产者
 输入参数：上报的数据结构体指针
+返回值：取到事件返回1，队列为空返回0
 */
 static int get_inputevent_frombuffer(p_inputevent pt_inputevent)
 {
-    if(!is_inputbuffer_empty())
-    {
-        *pt_inputevent = g_atinputevent[gi_read];
-        gi_read =(gi_read + 1)% BUFFER_LEN;
-        return 1;
-    }
-    else
-    {
-        return 0;
-    }  
-}
+    p_inputslot pt_slot = &g_pt_slots[g_i_read & g_i_mask];
 
-
-//环形缓冲区为空的判断函数，返回0因为只有两个都为0时才会相等是
-static int is_inputbuffer_empty(void)
-{
-    return(gi_read == gi_write);
-}
-//环形缓冲区为满的判断函数，返回满时的长度（不一定为BUFFER_LEN）
-static int is_inputbuffer_full(void)
-{
-    return(gi_read == (gi_write + 1) % BUFFER_LEN);
+    if(__atomic_load_n(&pt_slot->i_seq, __ATOMIC_ACQUIRE) != g_i_read + 1)
+        return 0;
+    *pt_inputevent = pt_slot->t_event;
+    __atomic_store_n(&pt_slot->i_seq, g_i_read + g_i_capacity, __ATOMIC_RELEASE);
+    g_i_read++;
+    __atomic_fetch_add(&g_t_inputqueuestat.dequeued, 1, __ATOMIC_RELAXED);
+    return 1;
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
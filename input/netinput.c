@@ -12,27 +12,89 @@
 
 下层：对网络硬件（网卡）和系统内核（socket 系统调用），实现 UDP 数据的接收与基础处理；
 上层：为输入管理器（input_manager.c）提供标准 inputdevice 接口，支撑上层业务（如根据网络输入更新 UI、执行控制命令）。
+六、批量接收
+几十个工位同时上报进度时，一次 recvfrom 只收一个数据报，系统调用开销大，接收缓冲区也容易满；
+现在用 recvmmsg 一次收最多 g_i_batch 个数据报，直接收进预先从载荷池取好的缓冲区，再逐个交给输入管理层；
+接收缓冲区大小（SO_RCVBUF）可以设置，批大小分布和内核丢弃数（SO_RXQ_OVFL）由 getnetinputstat 获取，用来按现场规模调整。
 
 */
 
+#define _GNU_SOURCE    // recvmmsg、MSG_WAITFORONE
 #include <sys/types.h>// 系统基础数据类型（如 socket 相关的 int、size_t）
-#include <sys/socket.h>// socket 编程核心头文件（socket、bind、recvfrom 等函数）
+#include <sys/socket.h>// socket 编程核心头文件（socket、bind、recvmmsg 等函数）
+#include <sys/uio.h>   // struct iovec（recvmmsg 的接收缓冲区）
 #include <netinet/in.h>// IPv4 地址结构体（sockaddr_in）和字节序转换（htons 等）
 #include <arpa/inet.h>// IP 地址转换函数（虽未显式用，但为 socket 编程标准依赖）
 
 #include <unistd.h> // 系统调用（close 等）
+#include <errno.h>  // EAGAIN（非阻塞读取时暂时没有数据）
 
 #include  <stdio.h> // 标准输入输出（printf 调试信息）
-#include <string.h>// 字符串操作（memset、strncpy 等）
+#include <string.h>// 字符串操作（memset）
 #include <input_manager.h>
 
 /*
 socket
 bind
-sendto/recvfrom
+sendto/recvmmsg
 */ 
 #define SERVER_POPRT 8888  // UDP 服务器端口号（8888，注意宏名笔误，应为 SERVER_PORT）
-static int g_i_socketserver; // UDP 服务器套接字文件描述符（唯一标识服务器 socket）
+#define NETINPUT_BATCH_DEFAULT 32 // 默认批大小
+static int g_i_socketserver = -1; // UDP 服务器套接字文件描述符（唯一标识服务器 socket）
+
+//批量接收
+static unsigned int g_i_batch = NETINPUT_BATCH_DEFAULT;   // 一次 recvmmsg 最多接收的数据报数
+static int g_i_rcvbuf = 0;                                // SO_RCVBUF，0 表示用系统默认值
+static struct mmsghdr g_at_msgs[NETINPUT_BATCH_MAX];
+static struct iovec g_at_iovs[NETINPUT_BATCH_MAX];
+static union
+{
+    struct cmsghdr t_align;
+    char ac_buf[CMSG_SPACE(sizeof(unsigned int))];
+}g_at_cmsgs[NETINPUT_BATCH_MAX];                          // 每个数据报的控制信息（SO_RXQ_OVFL 丢弃计数）
+static p_inputpayload g_apt_payloads[NETINPUT_BATCH_MAX]; // 预先取好的接收缓冲区，交给事件后置为 NULL，下次补上
+static unsigned int g_i_batchpos = 0;                     // 这一批中下一个要交出的数据报
+static unsigned int g_i_batchcount = 0;                   // 这一批收到的数据报数
+static struct timeval g_t_batchtime;                      // 这一批的接收时间
+static netinputstat g_t_netinputstat;
+static inputdevice g_t_netinput_dev;                      // 设备结构体，定义在文件末尾（setnetinputbatch 更新它占着的载荷数）
+
+//统计只有读取网络设备的线程写，写用原子存储，其他线程读时不会读到撕裂的值
+#define NETINPUT_SET(field, v) __atomic_store_n(&(field), (v), __ATOMIC_RELAXED)
+
+/*
+设置批量接收的参数，在 input_deviceinit 之前调用
+输入参数：一次最多接收的数据报数（1 到 NETINPUT_BATCH_MAX），接收缓冲区大小（字节，0 表示系统默认值）
+返回值：设备已经初始化时返回 -1
+*/
+int setnetinputbatch(unsigned int i_batch, int i_rcvbuf)
+{
+    if(g_i_socketserver >= 0 || i_batch == 0 || i_batch > NETINPUT_BATCH_MAX || i_rcvbuf < 0)
+        return -1;
+    g_i_batch = i_batch;
+    g_i_rcvbuf = i_rcvbuf;
+    g_t_netinput_dev.i_payloads = i_batch;//一整批接收缓冲区一直占着载荷，输入管理层建立载荷池时留出
+    return 0;
+}
+
+/*
+获取网络输入设备的统计
+输入参数：统计结构体指针
+*/
+int getnetinputstat(p_netinputstat pt_netinputstat)
+{
+    int i;
+
+    pt_netinputstat->batches      = __atomic_load_n(&g_t_netinputstat.batches, __ATOMIC_RELAXED);
+    pt_netinputstat->datagrams    = __atomic_load_n(&g_t_netinputstat.datagrams, __ATOMIC_RELAXED);
+    for(i = 0; i < NETINPUT_HIST_BUCKETS; i++)
+        pt_netinputstat->batch_hist[i] = __atomic_load_n(&g_t_netinputstat.batch_hist[i], __ATOMIC_RELAXED);
+    pt_netinputstat->max_batch    = __atomic_load_n(&g_t_netinputstat.max_batch, __ATOMIC_RELAXED);
+    pt_netinputstat->kernel_drops = __atomic_load_n(&g_t_netinputstat.kernel_drops, __ATOMIC_RELAXED);
+    pt_netinputstat->rcvbuf       = __atomic_load_n(&g_t_netinputstat.rcvbuf, __ATOMIC_RELAXED);
+    pt_netinputstat->batch        = g_i_batch;
+    return 0;
+}
 
 /*
 网络输入数据初始化(UDP) （输入设备初始化流程2.1）
@@ -41,6 +103,8 @@ static int net_deviceinit(void)
 {
     struct sockaddr_in t_socketserver_addr; // IPv4 专用地址结构体，存储服务器 （IP+端口）
     int i_ret;
+    int i_on = 1;
+    socklen_t i_optlen = sizeof(int);
 
     // 1. 创建 UDP 套接字（SOCK_DGRAM 表示 UDP 协议，0 表示默认协议族）
     g_i_socketserver = socket(AF_INET,SOCK_DGRAM,0);
@@ -60,10 +124,22 @@ static int net_deviceinit(void)
     // 3. 将套接字与地址绑定（让 socket 监听指定端口和网卡）
     //将创建的套接字 g_i_socketserver 与配置好的地址（t_socketserver_addr）绑定，使套接字能接收发往该地址的数据。
     i_ret = bind(g_i_socketserver,(const struct sockaddr *)&t_socketserver_addr,sizeof(struct sockaddr));
+    //绑定失败时设备不可用：以前仍返回成功，读取线程对着没绑定的套接字空转
     if(-1 == i_ret)
     {
         printf("bind err!\n");
+        close(g_i_socketserver);
+        g_i_socketserver = -1;
+        return -1;
     }
+
+    // 4. 接收缓冲区大小（内核按两倍记账，实际值写入统计），并让每个数据报带上内核的丢弃计数
+    if(g_i_rcvbuf > 0 && setsockopt(g_i_socketserver, SOL_SOCKET, SO_RCVBUF, &g_i_rcvbuf, sizeof(int)) == -1)
+        printf("SO_RCVBUF err!\n");
+    if(getsockopt(g_i_socketserver, SOL_SOCKET, SO_RCVBUF, &i_ret, &i_optlen) == 0)
+        NETINPUT_SET(g_t_netinputstat.rcvbuf, i_ret);
+    if(setsockopt(g_i_socketserver, SOL_SOCKET, SO_RXQ_OVFL, &i_on, sizeof(int)) == -1)
+        printf("SO_RXQ_OVFL err!\n");
     return 0;
 }
 
@@ -71,26 +147,135 @@ static int net_deviceinit(void)
 
 
 
-//网络输入事件读取函数  (输入设备初始化 3.1)
-static int net_getinputevent(p_inputevent pt_inputevent)
+/*
+接收一批数据报
+给每个空的接收缓冲区补上载荷，用一次 recvmmsg 收进来，并记录批大小和内核丢弃计数
+输入参数：recvmmsg 的标志（MSG_WAITFORONE 阻塞到收到第一个，MSG_DONTWAIT 非阻塞）
+返回值：0 收到，1 非阻塞时暂时没有数据，-1 出错
+*/
+static int net_recvbatch(int i_flags)
 {
-    struct sockaddr_in t_socketclient_addr;// IPv4 专用地址结构体，存储客户端地址（IP+端口）
-    int i_recvlen;//接收的数据长度
-    char arecvbuf[1000];//接收数据的缓冲区（最大 999 字节有效数据 + 1 字节终止符）
-    unsigned int i_addrlen = sizeof(struct sockaddr);//客户端地址结构体长度
-    //阻塞等待 UDP 数据报，接收后填充 arecvbuf，并记录客户端地址
-    i_recvlen = recvform(g_i_socketserver,arecvbuf,999,0,(struct sockaddr *)&t_socketclient_addr,&i_addrlen);
-    if(i_recvlen >0)
+    struct cmsghdr *pt_cmsg;
+    unsigned int i_drops;
+    unsigned int i_count;
+    int i_recvcnt;
+    int i_bucket;
+    unsigned int j;
+
+    //补上接收缓冲区（载荷池暂时取不到时这一批就小一些）
+    for(i_count = 0; i_count < g_i_batch; i_count++)
+    {
+        if(!g_apt_payloads[i_count] && !(g_apt_payloads[i_count] = inputpayload_get()))
+            break;
+        g_at_iovs[i_count].iov_base = g_apt_payloads[i_count]->ac_data;
+        g_at_iovs[i_count].iov_len  = g_apt_payloads[i_count]->i_size - 1;//留 1 字节给终止符
+        memset(&g_at_msgs[i_count].msg_hdr, 0, sizeof(struct msghdr));
+        g_at_msgs[i_count].msg_hdr.msg_iov        = &g_at_iovs[i_count];
+        g_at_msgs[i_count].msg_hdr.msg_iovlen     = 1;
+        g_at_msgs[i_count].msg_hdr.msg_control    = g_at_cmsgs[i_count].ac_buf;
+        g_at_msgs[i_count].msg_hdr.msg_controllen = sizeof(g_at_cmsgs[i_count].ac_buf);
+    }
+    if(i_count == 0)
+        return -1;
+
+    i_recvcnt = recvmmsg(g_i_socketserver, g_at_msgs, i_count, i_flags, NULL);
+    if(i_recvcnt < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 1 : -1;
+    if(i_recvcnt == 0)
+        return 1;
+    gettimeofday(&g_t_batchtime,NULL); // 记录这一批的接收时间
+    g_i_batchpos = 0;
+    g_i_batchcount = i_recvcnt;
+
+    //统计：批大小分布和最大批
+    for(i_bucket = 0; i_bucket < NETINPUT_HIST_BUCKETS - 1 && (2 << i_bucket) <= i_recvcnt; i_bucket++)
+        ;
+    NETINPUT_SET(g_t_netinputstat.batches, g_t_netinputstat.batches + 1);
+    NETINPUT_SET(g_t_netinputstat.datagrams, g_t_netinputstat.datagrams + i_recvcnt);
+    NETINPUT_SET(g_t_netinputstat.batch_hist[i_bucket], g_t_netinputstat.batch_hist[i_bucket] + 1);
+    if((unsigned int)i_recvcnt > g_t_netinputstat.max_batch)
+        NETINPUT_SET(g_t_netinputstat.max_batch, i_recvcnt);
+
+    //SO_RXQ_OVFL：套接字创建以来内核丢弃的数据报总数，没有丢弃时不带
+    for(j = 0; j < (unsigned int)i_recvcnt; j++)
     {
-        arecvbuf[i_recvlen] = '\0';// 给接收数据加字符串终止符，方便后续处理
+        for(pt_cmsg = CMSG_FIRSTHDR(&g_at_msgs[j].msg_hdr); pt_cmsg; pt_cmsg = CMSG_NXTHDR(&g_at_msgs[j].msg_hdr, pt_cmsg))
+        {
+            if(pt_cmsg->cmsg_level != SOL_SOCKET || pt_cmsg->cmsg_type != SO_RXQ_OVFL)
+                continue;
+            memcpy(&i_drops, CMSG_DATA(pt_cmsg), sizeof(i_drops));
+            if(i_drops > g_t_netinputstat.kernel_drops)
+                NETINPUT_SET(g_t_netinputstat.kernel_drops, i_drops);
+        }
+    }
+    return 0;
+}
+
+/*
+从已经收到的这一批中交出下一个数据报，载荷的引用交给事件（空数据报跳过，缓冲区留着下次用）
+返回值：0 交出，1 这一批已经交完
+*/
+static int net_nextevent(p_inputevent pt_inputevent)
+{
+    p_inputpayload pt_payload;
+    unsigned int j;
+
+    while(g_i_batchpos < g_i_batchcount)
+    {
+        j = g_i_batchpos++;
+        if(g_at_msgs[j].msg_len == 0)
+            continue;
+        pt_payload = g_apt_payloads[j];
+        g_apt_payloads[j] = NULL;
+        pt_payload->i_len = g_at_msgs[j].msg_len;
+        pt_payload->ac_data[pt_payload->i_len] = '\0';// 给接收数据加字符串终止符，方便后续处理
         pt_inputevent->i_type   = INPUT_TYPE_NET;//设置事件类型为网络输入
-        gettimeofday(&pt_inputevent->tTime,NULL); // 记录事件发生的时间（实际是“接收数据的时间”）
-        strncpy(pt_inputevent->str,arecvbuf,1000); // 保存原始接收数据到 inputevent 的 str 成员（最多 1000 字节）
-        pt_inputevent->str[999] = '\0'; // 强制终止，防止数组溢出 
+        pt_inputevent->tTime    = g_t_batchtime;
+        pt_inputevent->pt_payload = pt_payload;
         return 0;
     }
-    else
-        return -1;
+    return 1;
+}
+
+/*
+生成一个网络输入事件：这一批还有数据报时直接交出，交完了再收一批
+数据报直接收进载荷池的缓冲区，事件只带载荷的指针，经过输入队列交给上层时不再拷贝
+输入参数：上报的数据结构，recvmmsg 的标志
+返回值：0 收到，1 非阻塞时暂时没有数据，-1 出错
+*/
+static int net_recvevent(p_inputevent pt_inputevent, int i_flags)
+{
+    int ret;
+
+    while(net_nextevent(pt_inputevent))
+    {
+        ret = net_recvbatch(i_flags);
+        if(ret)
+            return ret;
+    }
+    return 0;
+}
+
+/*
+网络输入事件读取函数  (输入设备初始化 3.1)
+阻塞读取，设备不能加入反应器时由兼容线程调用
+*/
+static int net_getinputevent(p_inputevent pt_inputevent)
+{
+    return net_recvevent(pt_inputevent, MSG_WAITFORONE) == 0 ? 0 : -1;
+}
+
+/*
+反应器用的接口：套接字可读时被反复调用，直到暂时没有数据；每一批只有一次系统调用
+*/
+static int net_getfd(void)
+{
+    return g_i_socketserver;
+}
+
+static int net_draininputevent(p_inputevent pt_inputevent)
+{
+    return net_recvevent(pt_inputevent, MSG_DONTWAIT);
 }
 
 /*
@@ -98,7 +283,16 @@ static int net_getinputevent(p_inputevent pt_inputevent)
 */
 static int net_deviceexit(void)
 {
+    unsigned int j;
+
     close(g_i_socketserver);
+    g_i_socketserver = -1;
+    for(j = 0; j < NETINPUT_BATCH_MAX; j++)
+    {
+        inputpayload_release(g_apt_payloads[j]);
+        g_apt_payloads[j] = NULL;
+    }
+    g_i_batchpos = g_i_batchcount = 0;
     return 0;
 }
 
@@ -108,6 +302,9 @@ static inputdevice g_t_netinput_dev ={
     .deviceinit         = net_deviceinit,      //绑定“设备初始化”函数     
     .get_inputevent     = net_getinputevent,   //绑定“读取事件”函数
     .deviceexit         = net_deviceexit,      // 绑定“设备退出”函数 
+    .get_fd             = net_getfd,           //套接字，由反应器监听
+    .drain_inputevent   = net_draininputevent, //非阻塞读取
+    .i_payloads         = NETINPUT_BATCH_DEFAULT, //预先取好的一批接收缓冲区
 };
 
 /*
@@ -115,7 +312,7 @@ static inputdevice g_t_netinput_dev ={
 */
 void netinput_register(void)
 {
-    register_inputdecive(&g_t_netinput_dev);
+    register_inputdevice(&g_t_netinput_dev);
 }
 
 
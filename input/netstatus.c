@@ -0,0 +1,140 @@
+/*
+网络状态消息的解码（属于输入驱动抽象层，格式见 net_status.h）
+以前每个 UDP 数据报是一行 "名字 状态"，主页面先用 sscanf 取名字找按钮，按下函数里再 sscanf 一遍名字和状态，
+都拷贝到 100 字节的数组中，一个数据报只能更新一个按钮。
+现在网络事件交给上层时先 netstatus_open 判断格式：
+二进制消息只检查头部，记录由 netstatus_record 按序号直接从接收缓冲区中解码；
+文本消息只解析一次，在载荷缓冲区中原地切分出名字和状态（载荷由取到事件的一方独占）。
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <net_status.h>
+
+//读取大端的 16 位、32 位整数（缓冲区不一定对齐）
+static unsigned int netstatus_get16(const unsigned char *puc)
+{
+    return (puc[0] << 8) | puc[1];
+}
+
+static unsigned int netstatus_get32(const unsigned char *puc)
+{
+    return ((unsigned int)puc[0] << 24) | (puc[1] << 16) | (puc[2] << 8) | puc[3];
+}
+
+//是否为分隔符（切分过的消息中名字后面已经写上了 '\0'，同一个载荷可以再次打开）
+static int netstatus_isspace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\0';
+}
+
+//跳过空白，返回下一个字符串的开头
+static char *netstatus_skipspace(char *pc, char *pc_end)
+{
+    while(pc < pc_end && netstatus_isspace(*pc))
+        pc++;
+    return pc;
+}
+
+//找到字符串的结尾，并原地写上 '\0'，返回结尾之后的位置
+static char *netstatus_cutword(char *pc, char *pc_end)
+{
+    while(pc < pc_end && !netstatus_isspace(*pc))
+        pc++;
+    if(pc < pc_end)
+        *pc++ = '\0';
+    return pc;
+}
+
+/*
+解析文本消息 "名字 状态"
+输入参数：数据，数据长度（之后是结尾的 '\0'），消息结构体指针
+*/
+static int netstatus_opentext(char *pc_data, int i_len, p_netstatusframe pt_frame)
+{
+    p_netstatusrecord pt_record = &pt_frame->t_text;
+    char *pc_end = pc_data + i_len;
+    char *pc = netstatus_skipspace(pc_data, pc_end);
+
+    if(pc == pc_end)
+        return -1;
+    pt_record->i_item = -1;
+    pt_record->pc_name = pc;
+    pc = netstatus_skipspace(netstatus_cutword(pc, pc_end), pc_end);
+    pt_record->pc_statustext = pc;
+    netstatus_cutword(pc, pc_end);
+    pt_record->i_percent = 0;
+
+    if(strcmp(pc, "ok") == 0)
+        pt_record->i_status = NETSTATUS_OK;
+    else if(strcmp(pc, "cancel") == 0)
+        pt_record->i_status = NETSTATUS_CANCEL;
+    else if(*pc >= '0' && *pc <= '9')
+    {
+        pt_record->i_status = NETSTATUS_PERCENT;
+        pt_record->i_percent = atoi(pc);
+    }
+    else
+        pt_record->i_status = -1;//未知状态，由上层忽略
+
+    pt_frame->i_binary = 0;
+    pt_frame->i_version = 0;
+    pt_frame->i_seq = 0;
+    pt_frame->i_count = 1;
+    pt_frame->puc_records = NULL;
+    return 1;
+}
+
+/*
+打开一个网络状态消息：判断格式，检查二进制消息的头部，或解析文本消息
+输入参数：网络事件的载荷，消息结构体指针
+返回值：记录数，消息无效时返回 -1
+*/
+int netstatus_open(p_inputpayload pt_payload, p_netstatusframe pt_frame)
+{
+    const unsigned char *puc = (const unsigned char *)pt_payload->ac_data;
+    int i_count;
+
+    if(pt_payload->i_len >= 2 && puc[0] == NETSTATUS_MAGIC0 && puc[1] == NETSTATUS_MAGIC1)
+    {
+        if(pt_payload->i_len < NETSTATUS_HEADER_SIZE || puc[2] != NETSTATUS_VERSION)
+            return -1;
+        i_count = puc[3];
+        if(NETSTATUS_HEADER_SIZE + i_count * NETSTATUS_RECORD_SIZE > pt_payload->i_len)
+            return -1;//记录被截断
+        pt_frame->i_binary = 1;
+        pt_frame->i_version = puc[2];
+        pt_frame->i_seq = netstatus_get32(puc + 4);
+        pt_frame->i_count = i_count;
+        pt_frame->puc_records = puc + NETSTATUS_HEADER_SIZE;
+        return i_count;
+    }
+    return netstatus_opentext(pt_payload->ac_data, pt_payload->i_len, pt_frame);
+}
+
+/*
+取得消息中的一条记录
+二进制记录直接从接收缓冲区解码
+输入参数：netstatus_open 打开的消息，记录序号，记录结构体指针
+返回值：成功返回0
+*/
+int netstatus_record(p_netstatusframe pt_frame, int i_index, p_netstatusrecord pt_record)
+{
+    const unsigned char *puc;
+
+    if(i_index < 0 || i_index >= pt_frame->i_count)
+        return -1;
+    if(!pt_frame->i_binary)
+    {
+        *pt_record = pt_frame->t_text;
+        return 0;
+    }
+    puc = pt_frame->puc_records + i_index * NETSTATUS_RECORD_SIZE;
+    pt_record->i_item = netstatus_get16(puc);
+    pt_record->pc_name = NULL;
+    pt_record->pc_statustext = NULL;
+    pt_record->i_status = puc[2] <= NETSTATUS_PERCENT ? puc[2] : -1;
+    pt_record->i_percent = puc[3] <= 100 ? puc[3] : 100;
+    return 0;
+}
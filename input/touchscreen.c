@@ -8,6 +8,7 @@
 可管理与可扩展：通过 touchscreen_register 注册设备，输入管理器可动态管理多个输入设备（如同时启用触摸屏和按键）；
             新增输入设备时，只需按 inputdevice 接口实现并注册，无需改动核心逻辑；
 资源安全：touchscreen_deviceinit 与 touchscreen_deviceexit 对称设计，确保初始化的触摸屏资源能被正确释放，避免设备文件泄漏。
+另一个后端 evdevtouch.c 不经过 tslib，直接批量读取 input_event；两个后端统计相同的处理开销（touchscreenstat），由 settouchscreen 选择。
 五、文件所在层级
 结合项目架构（参考输入 / 显示系统的分层设计），该文件属于输入驱动抽象层，位于：
 
@@ -19,17 +20,41 @@
 #include <tslib.h> // tslib 触摸屏库头文件（提供触摸屏初始化、读取、关闭等函数）
 
 #include <stdio.h> // 标准输入输出（printf 调试信息）
+#include <errno.h> // EAGAIN（非阻塞读取时暂时没有样本）
+#include <poll.h>  // 兼容线程阻塞读取时等待设备可读
+#include <time.h>  // clock_gettime（统计处理开销）
 
 #include <input_manager.h>
 
 static struct tsdev *g_ts;//触摸设备句柄（tslib 库定义，代表触摸屏设备）
+static char *g_pc_tsdevice = NULL;//设备文件，NULL 表示由 tslib 决定（TSLIB_TSDEVICE 环境变量或自动探测）
+static touchscreenstat g_t_touchscreenstat;
+
+//统计只有读取触摸屏的线程写，写用原子存储，其他线程读时不会读到撕裂的值
+#define TOUCHSCREEN_ADD(field, v) __atomic_store_n(&(field), (field) + (v), __ATOMIC_RELAXED)
+
+/*
+获取 tslib 后端的统计
+输入参数：统计结构体指针
+*/
+int touchscreen_getstat(p_touchscreenstat pt_touchscreenstat)
+{
+    pt_touchscreenstat->backend     = TOUCHSCREEN_TSLIB;
+    pt_touchscreenstat->reads       = __atomic_load_n(&g_t_touchscreenstat.reads, __ATOMIC_RELAXED);
+    pt_touchscreenstat->samples     = __atomic_load_n(&g_t_touchscreenstat.samples, __ATOMIC_RELAXED);
+    pt_touchscreenstat->cost_ns     = __atomic_load_n(&g_t_touchscreenstat.cost_ns, __ATOMIC_RELAXED);
+    pt_touchscreenstat->max_cost_ns = __atomic_load_n(&g_t_touchscreenstat.max_cost_ns, __ATOMIC_RELAXED);
+    pt_touchscreenstat->latency_us  = __atomic_load_n(&g_t_touchscreenstat.latency_us, __ATOMIC_RELAXED);
+    pt_touchscreenstat->drops       = 0;
+    return 0;
+}
 
 //设备初始化，获得触摸屏句柄 （输入设备初始化流程2.1）
 static int touchscreen_deviceinit(void)
 {
     // 调用 tslib 的 ts_setup 初始化触摸屏
-    //参数1=设备名（NULL 表示自动探测，如 /dev/input/event0），参数2=非阻塞模式（0 表示阻塞）
-    g_ts = ts_setup(NULL,0);
+    //参数1=设备名（NULL 表示自动探测，如 /dev/input/event0），参数2=非阻塞模式（1 表示非阻塞，由输入管理层的反应器 epoll 等待）
+    g_ts = ts_setup(g_pc_tsdevice,1);
     if(!g_ts)
     {
         printf("ts_setup err\n");
@@ -50,18 +75,40 @@ struct ts_sample
 */
 
 /*
-触摸事件读取函数 (输入设备初始化 3.1)
-读取一个触摸样本，向上报的数据结构中填充事件类型、坐标、压力、时间戳  
+非阻塞读取一个触摸样本，向上报的数据结构中填充事件类型、坐标、压力、时间戳
+反应器在触摸屏可读时反复调用，直到暂时没有样本
 输入参数：上报的数据结构
+返回值：0 读到，1 暂时没有样本，-1 出错
 */
-static int touchscreen_getinputevent(p_inputevent pt_inputevent)
+static int touchscreen_draininputevent(p_inputevent pt_inputevent)
 {
     struct ts_sample samp;
+    struct timespec t_start, t_end;
+    struct timeval t_now;
+    unsigned long long l_cost;
+    long long l_latency;
     int ret;
-    // 读取触摸数据：调用 tslib 的 ts_read，填充 samp
+    int i_errno;
+
+    // 读取触摸数据：调用 tslib 的 ts_read，填充 samp；没有得到样本的调用也算进处理开销
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+    errno = 0;
     ret = ts_read(g_ts,&samp,1);
+    i_errno = errno;//clock_gettime 可能改写 errno
+    clock_gettime(CLOCK_MONOTONIC, &t_end);
+    l_cost = (t_end.tv_sec - t_start.tv_sec) * 1000000000ULL + t_end.tv_nsec - t_start.tv_nsec;
+    TOUCHSCREEN_ADD(g_t_touchscreenstat.reads, 1);
+    TOUCHSCREEN_ADD(g_t_touchscreenstat.cost_ns, l_cost);
+    if(l_cost > g_t_touchscreenstat.max_cost_ns)
+        __atomic_store_n(&g_t_touchscreenstat.max_cost_ns, l_cost, __ATOMIC_RELAXED);
     if(ret != 1)
     {
+        //滤波器还没凑够样本或设备暂时没有数据：
+        //有的 tslib 版本返回 -EAGAIN，有的 raw 模块返回 -1、把 EAGAIN 留在 errno 中
+        if(ret == 0 || ret == -EAGAIN || ret == -EINTR)
+            return 1;
+        if(ret < 0 && (i_errno == EAGAIN || i_errno == EINTR))
+            return 1;
         return -1;
     }
     pt_inputevent->i_type   = INPUT_TYPE_TOUCH;
@@ -69,9 +116,41 @@ static int touchscreen_getinputevent(p_inputevent pt_inputevent)
     pt_inputevent->i_y      = samp.y;
     pt_inputevent->i_pressure = samp.pressure;
     pt_inputevent->tTime      = samp.tv;
+
+    //样本的时间戳是内核记录的，到这里的延迟包括 tslib 滤波器攒样本的时间
+    gettimeofday(&t_now, NULL);
+    l_latency = (t_now.tv_sec - samp.tv.tv_sec) * 1000000LL + t_now.tv_usec - samp.tv.tv_usec;
+    TOUCHSCREEN_ADD(g_t_touchscreenstat.samples, 1);
+    if(l_latency > 0)
+        TOUCHSCREEN_ADD(g_t_touchscreenstat.latency_us, l_latency);
     return 0;
 }
 
+/*
+触摸事件读取函数 (输入设备初始化 3.1)
+阻塞读取一个触摸样本（设备是非阻塞打开的，没有样本时用 poll 等待）
+输入参数：上报的数据结构
+*/
+static int touchscreen_getinputevent(p_inputevent pt_inputevent)
+{
+    struct pollfd t_pollfd;
+    int ret;
+
+    while((ret = touchscreen_draininputevent(pt_inputevent)) == 1)
+    {
+        t_pollfd.fd = ts_fd(g_ts);
+        t_pollfd.events = POLLIN;
+        poll(&t_pollfd, 1, -1);
+    }
+    return ret;
+}
+
+//触摸屏的文件描述符，由反应器监听
+static int touchscreen_getfd(void)
+{
+    return ts_fd(g_ts);
+}
+
 /*
 设备清除
 */
@@ -89,12 +168,18 @@ static inputdevice g_t_touchscreen_dev ={
     .deviceinit         = touchscreen_deviceinit,      //绑定“设备初始化”函数（启动时调用）
     .get_inputevent     = touchscreen_getinputevent,   //绑定“读取事件”函数（核心功能）   
     .deviceexit         = touchscreen_deviceexit,      // 绑定“设备退出”函数 （关闭时调用）
+    .get_fd             = touchscreen_getfd,           //触摸屏的文件描述符
+    .drain_inputevent   = touchscreen_draininputevent, //非阻塞读取
 };
 
-//注册触摸屏结构体  （输入初始化流程1.1）
-void touchscreen_register(void)
+/*
+注册触摸屏结构体  （输入初始化流程1.1）
+输入参数：设备文件，NULL 表示由 tslib 决定
+*/
+void touchscreen_register(char *a_devname)
 {
-    register_inputdecive(&g_t_touchscreen_dev);
+    g_pc_tsdevice = a_devname;
+    register_inputdevice(&g_t_touchscreen_dev);
 }
 
 //测试是否能接收到数据
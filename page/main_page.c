@@ -8,6 +8,7 @@
 #include <stdlib.h>
 
 #include <page_manager.h>
+#include <net_status.h>
 //#include <disp_manager.h>
 //#include <font_manager.h>
 //#include <input_manager.h>
@@ -20,6 +21,14 @@
 static button g_t_buttons[ITEMCFG_MAX_NUM];// 存储主页面所有按钮的数组
 static int g_t_buttoncnt;//记录实际按钮数量
 
+static int getfontsize_forbutton(char *str, p_button pt_button);
+static int mainpage_showstatus(p_button pt_button, pdispbuff pt_dispbuff, unsigned int dwcolor, char *strbutton);
+static void mainpage_runcommand(p_button pt_button, int command_status_index);
+static void prewarm_buttons(void);
+static p_button get_button_by_name(char *name);
+static int mainpage_on_netstatus(p_inputevent pt_inputevent, pdispbuff pt_dispbuff, p_button pt_only);
+int mainpage_on_pressed(struct button *pt_button , pdispbuff pt_dispbuff , p_inputevent pt_inputevent);
+
 
 /*
 生成按钮  
@@ -39,7 +48,6 @@ static int generate_buttons(void)
     int pre_start_x,pre_start_y;//下一个按钮 的xy值
     p_button p_button;
     int i = 0;
-    int i_fontsize;//合适的字体大小
 
     //算出单个按钮的width和height
     g_t_buttoncnt  = n = get_itemcfg_count(); // 获取配置项数量（即按钮总数）
@@ -77,36 +85,63 @@ static int generate_buttons(void)
             i++;
         }
     }
-    //为了防止生成按钮后有其他的函数修改字体大小，所以把字体大小也放入按钮结构体
-    i_fontsize = getfontsize_forallbutton();
-
-    //绘制按钮
+    //绘制按钮：整页记录为一个显示列表，所有按钮回放完只刷新一次
+    //为了防止生成按钮后有其他的函数修改字体大小，所以把每个按钮的字体大小放入按钮结构体
+    displist_begin();
     for(int i = 0; i < n; i++)
     {
-        g_t_buttons[i].font_size = i_fontsize;
+        g_t_buttons[i].font_size = getfontsize_forbutton(g_t_buttons[i].name, &g_t_buttons[i]);
         g_t_buttons[i].on_draw(&g_t_buttons[i], p_dispbuff);
     }
+    displist_end();
+    //字号都定下来了，后台预热按钮上之后会出现的文字
+    prewarm_buttons();
     return 0;
 }
 
+/*
+后台预热按钮上会出现的文字
+名字的字形在生成按钮时已经画过；进度更新显示的数字和 % 字号与名字不同，第一次出现时要现场光栅化，造成卡顿。
+这里按 mainpage_on_pressed 的规则求出每个按钮显示百分比可能用到的字号（等宽数字下与位数有关），
+把名字和 "0123456789%" 交给字体管理层的后台线程，界面线程不等它
+*/
+static void prewarm_buttons(void)
+{
+    char *samples[] = {"8", "88", "100", "8%", "88%", "100%"};
+    int nsamples = sizeof(samples) / sizeof(samples[0]);
+    int sizes[ITEMCFG_MAX_NUM * 6];
+    int nsizes = 0;
+    int i, j, k, i_fontsize;
+
+    for(i = 0; i < g_t_buttoncnt; i++)
+    {
+        prewarmfont(g_t_buttons[i].name, g_t_buttons[i].font_size);
+        for(j = 0; j < nsamples; j++)
+        {
+            i_fontsize = getfontsize_forbutton(samples[j], &g_t_buttons[i]);
+            if(i_fontsize > g_t_buttons[i].font_size)
+                i_fontsize = g_t_buttons[i].font_size;
+            for(k = 0; k < nsizes && sizes[k] != i_fontsize; k++)
+                ;
+            if(k == nsizes)
+                sizes[nsizes++] = i_fontsize;
+        }
+    }
+    for(k = 0; k < nsizes; k++)
+        prewarmfont("0123456789%", sizes[k]);
+}
+
 
 /*
 按钮按下执行的函数
-切换按钮状态，更新颜色
+触摸时切换按钮状态，更新颜色；网络状态消息中有这个按钮的记录时按记录更新
 输入参数：按钮的结构体指针，缓冲区指针，上报数据指针
 */
 int mainpage_on_pressed(struct button *pt_button , pdispbuff pt_dispbuff , p_inputevent pt_inputevent) 
 {
     unsigned int dwcolor = BUTTON_DEFAULT_COLOR; // 按钮初始的颜色 
-    char name[100];
-    char status[100];
-    char *strbutton; // 按钮上显示的文字（可能是名称或状态值）
-    char *command_status[3] = {"err", "ok", "percent"};
     int command_status_index = 0;
-    char command[1000];
-    p_itemcfg pt_itemcfg;
 
-    strbutton = pt_button->name; // 默认显示按钮名称
     //对于触摸屏事件
     if(pt_inputevent->i_type == INPUT_TYPE_TOUCH)
     {
@@ -123,100 +158,156 @@ int mainpage_on_pressed(struct button *pt_button , pdispbuff pt_dispbuff , p_inp
             dwcolor = BUTTON_PRESSED_COLOR;
             command_status_index = 1;
         }
+        //先画出来并刷新，再执行命令，命令执行得慢也不耽误显示
+        mainpage_showstatus(pt_button, pt_dispbuff, dwcolor, pt_button->name);
+        mainpage_runcommand(pt_button, command_status_index);
+        return 0;
     }
     //对于网络类事件
     else if(pt_inputevent->i_type == INPUT_TYPE_NET)
     {
-        //根据传进来的字符串修改颜色
-        //从网络事件字符串中解析出“名称”和“状态”（格式如"button1 ok"）
-        sscanf(pt_inputevent->str,"%s %s",name,status);
-        if(strcmp(status,"ok") == 0)
-        {
-            dwcolor = BUTTON_PRESSED_COLOR;
-            command_status_index = 1;
-        }
-        else if(strcmp(status,"cancel") == 0)
-        {
-            dwcolor = BUTTON_DEFAULT_COLOR;
-            command_status_index = 0;
-        }
-        else if (status[0] >= '0' && status[0] <= '9')
-        {
-            dwcolor = BUTTON_PERCENT_COLOR;
-            strbutton = status;
-            command_status_index = 2;
-        }
-        else
-        {
-            return -1; //未知状态
-        }
-    }
-    else 
-    {
-        return -1;
+        return mainpage_on_netstatus(pt_inputevent, pt_dispbuff, pt_button) > 0 ? 0 : -1;
     }
+    return -1;
+}
+
+/*
+显示按钮的新状态
+在外层的显示列表中调用时只记录，随外层的 displist_end 一起刷新
+输入参数：按钮的结构体指针，缓冲区指针，底色，按钮上显示的文字（名称或状态值）
+*/
+static int mainpage_showstatus(p_button pt_button, pdispbuff pt_dispbuff, unsigned int dwcolor, char *strbutton)
+{
+    int i_fontsize;
 
+    //显示的是百分比等状态值时，字号不超过名字的字号，但也不能超出按钮
+    i_fontsize = getfontsize_forbutton(strbutton, pt_button);
+    if(i_fontsize > pt_button->font_size)
+        i_fontsize = pt_button->font_size;
+
+    displist_begin();
     // 绘制底色
     draw_region(&pt_button->t_region, dwcolor);
     //居中显示文字
+    setfontsize(i_fontsize);
     drawtext_inregioncentral(strbutton,&pt_button->t_region,BUTTON_TEXT_COLOR);
     //刷新到硬件上
     flushdisplayregion(&pt_button->t_region, pt_dispbuff);
+    displist_end();
+    return 0;
+}
+
+/*
+执行按钮关联的命令，在按钮的新状态刷新到屏幕之后调用
+输入参数：按钮的结构体指针，命令参数（0 err，1 ok，2 percent）
+*/
+static void mainpage_runcommand(p_button pt_button, int command_status_index)
+{
+    char *command_status[3] = {"err", "ok", "percent"};
+    char command[1000];
+    p_itemcfg pt_itemcfg;
 
-    //执行command
     pt_itemcfg = get_itemcfg_byname(pt_button->name);
     if(pt_itemcfg->command[0] != '\0')
     {
-        printf(command , "%s %s",pt_itemcfg->command,command_status[command_status_index]);
+        snprintf(command, sizeof(command), "%s %s",pt_itemcfg->command,command_status[command_status_index]);
         //执行命令
         system(command);// 调用系统命令（如启动程序、发送指令）
     }
-
-    return 0;
 }
 
 /*
-根据最长的名字算出适合的字体大小
-输出参数：字体大小 
+按一条网络状态记录重绘按钮（命令由调用者在刷新之后执行）
+输入参数：按钮的结构体指针，缓冲区指针，状态记录
+返回值：要执行的命令参数（0 err，1 ok，2 percent），未知状态返回 -1
 */
-static int getfontsize_forallbutton(void)
+static int mainpage_setstatus(p_button pt_button, pdispbuff pt_dispbuff, p_netstatusrecord pt_record)
 {
-    int i;
-    int max_len = -1;
-    int max_index;
-    int len;
-    region_cartesian t_regioncar;
-    float k,kx,ky;
+    char percent[8];
 
-    //第一步：找出name最长的button
-    for(i = 0; i < g_t_buttoncnt; i++)
+    switch(pt_record->i_status)
     {
-        len = strlen(g_t_buttons[i].name);
-        if(len > max_len)
-        {
-            max_len = len;
-            max_index = i;
-        }
+        case NETSTATUS_OK:
+            mainpage_showstatus(pt_button, pt_dispbuff, BUTTON_PRESSED_COLOR, pt_button->name);
+            return 1;
+        case NETSTATUS_CANCEL:
+            mainpage_showstatus(pt_button, pt_dispbuff, BUTTON_DEFAULT_COLOR, pt_button->name);
+            return 0;
+        case NETSTATUS_PERCENT:
+            //文本消息显示状态原文，二进制消息显示 "百分比%"
+            if(!pt_record->pc_statustext)
+                snprintf(percent, sizeof(percent), "%d%%", pt_record->i_percent);
+            mainpage_showstatus(pt_button, pt_dispbuff, BUTTON_PERCENT_COLOR,
+                                pt_record->pc_statustext ? pt_record->pc_statustext : percent);
+            return 2;
+        default:
+            return -1; //未知状态
     }
+}
 
-    //第二步：以foont_size= 100,算出他的外框
-    setfontsize(100);
-    getstring_regioncar(g_t_buttons[max_index].name,&t_regioncar);
+/*
+状态记录对应的按钮：二进制记录按项目序号（与配置文件的顺序相同），文本记录按名字
+*/
+static p_button get_button_by_record(p_netstatusrecord pt_record)
+{
+    if(pt_record->i_item >= 0)
+        return pt_record->i_item < g_t_buttoncnt ? &g_t_buttons[pt_record->i_item] : NULL;
+    return get_button_by_name(pt_record->pc_name);
+}
 
-    //第三步：把文字的外框缩放为button的外框
-    kx = g_t_buttons[max_index].t_region.width / t_regioncar.width; // x方向缩放比例
-    ky = g_t_buttons[max_index].t_region.height / t_regioncar.height; // y方向缩放比例
-    if(kx < ky)
-    {
-        k = kx; // 取较小的缩放比例，保证文字不会超出按钮区域
-    }
-    else
+/*
+处理网络状态消息
+文本消息 "名字 状态" 只解析一次；二进制消息中的记录直接在接收缓冲区中逐条解码，一个数据报可以更新一个工位的所有按钮，
+这些按钮在一个显示列表中重绘，只刷新一次；各按钮的命令在刷新之后按记录的顺序执行，命令执行得慢也不耽误显示
+输入参数：网络输入事件，缓冲区指针，只更新这个按钮（NULL 表示消息中的所有按钮）
+返回值：更新的按钮数，消息无效时返回 -1
+*/
+static int mainpage_on_netstatus(p_inputevent pt_inputevent, pdispbuff pt_dispbuff, p_button pt_only)
+{
+    netstatusframe t_frame;
+    netstatusrecord t_record;
+    p_button pt_button;
+    p_button apt_commands[NETSTATUS_RECORD_MAX];//刷新之后要执行命令的按钮
+    int ai_commandstatus[NETSTATUS_RECORD_MAX]; //对应的命令参数
+    int i_count, i, i_status;
+    int i_updated = 0;
+
+    if(!pt_inputevent->pt_payload)
+        return -1;
+    i_count = netstatus_open(pt_inputevent->pt_payload, &t_frame);
+    if(i_count < 0)
+        return -1;
+
+    displist_begin();
+    for(i = 0; i < i_count; i++)
     {
-        k = ky;
+        netstatus_record(&t_frame, i, &t_record);
+        pt_button = get_button_by_record(&t_record);
+        if(!pt_button || (pt_only && pt_button != pt_only))
+            continue;
+        i_status = mainpage_setstatus(pt_button, pt_dispbuff, &t_record);
+        if(i_status < 0)
+            continue;
+        apt_commands[i_updated] = pt_button;
+        ai_commandstatus[i_updated] = i_status;
+        i_updated++;
     }
+    displist_end();
 
-    //第四步：根据缩放比例计算出合适的字体大小，只取0.8为了美观
-    return (int)(100 * k * 0.8);
+    for(i = 0; i < i_updated; i++)
+        mainpage_runcommand(apt_commands[i], ai_commandstatus[i]);
+    return i_updated;
+}
+
+/*
+算出适合按钮的字体大小
+每个按钮单独求解：文字外框不超过按钮区域的 0.8（为了美观），短名字不会被最长的名字拖小，长名字也不会超出按钮
+输入参数：要显示的字符串，按钮结构体指针
+输出参数：字体大小
+*/
+static int getfontsize_forbutton(char *str, p_button pt_button)
+{
+    return getfontsize_forregion(str, pt_button->t_region.width * 4 / 5, pt_button->t_region.height * 4 / 5);
 }
 
 
@@ -261,7 +352,8 @@ static int isTouchPointInRegion(int x, int y, p_region pt_region)
 static p_button get_button_by_inputevent(p_inputevent pt_inputevent)
 {   
     int i;
-    char name[100];
+    netstatusframe t_frame;
+    netstatusrecord t_record;
     if(pt_inputevent->i_type == INPUT_TYPE_TOUCH)
     {
         for(i = 0; i < g_t_buttoncnt; i++)
@@ -273,10 +365,12 @@ static p_button get_button_by_inputevent(p_inputevent pt_inputevent)
         }
 
     }
-    else if(pt_inputevent->i_type == INPUT_TYPE_NET)
+    else if(pt_inputevent->i_type == INPUT_TYPE_NET && pt_inputevent->pt_payload)
     {
-       sscanf(pt_inputevent->str,"%s",name);
-       return get_button_by_name(name);
+       //消息中第一条记录对应的按钮（二进制消息可能有多条，由 mainpage_on_netstatus 全部处理）
+       if(netstatus_open(pt_inputevent->pt_payload, &t_frame) <= 0 || netstatus_record(&t_frame, 0, &t_record))
+           return NULL;
+       return get_button_by_record(&t_record);
     }
     else
     {
@@ -294,7 +388,7 @@ static void mainpage_run(void *p_params)
     int error;
     inputevent t_inputevent;
     p_button pt_button;
-    pdispbuff pt_disbuff = getdispbuff();
+    pdispbuff pt_disbuff = getdisplaybuffer();
 
     //初始化步骤：
     //1、调用parse_configfile解析配置文件（获取按钮名称、是否可触摸等信息）。
@@ -312,14 +406,21 @@ static void mainpage_run(void *p_params)
         {
             continue;
         }
-        //根据输入事件找到按钮
-        pt_button = get_button_by_inputevent(&t_inputevent);
-        if(!pt_button)
+        if(t_inputevent.i_type == INPUT_TYPE_NET)
         {
-            continue;
+            //网络状态消息可能更新好几个按钮，解码一次，逐条处理
+            mainpage_on_netstatus(&t_inputevent, pt_disbuff, NULL);
+        }
+        else
+        {
+            //根据输入事件找到按钮
+            pt_button = get_button_by_inputevent(&t_inputevent);
+            //调用按钮的on_pressed函数
+            if(pt_button)
+                pt_button->on_pressed(pt_button, pt_disbuff, &t_inputevent);
         }
-        //调用按钮的on_pressed函数
-        pt_button->on_pressed(pt_button, pt_disbuff, &t_inputevent);
+        //网络消息的载荷还回输入系统的池中
+        inputevent_release(&t_inputevent);
     }
 }
 
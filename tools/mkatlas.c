@@ -0,0 +1,279 @@
+/*
+离线生成字形图集（格式见 include/font_atlas.h）
+开机时不再需要 FT_Init_FreeType、FT_New_Face 和逐个光栅化：板子上的 "atlas" 字体引擎直接 mmap 这个文件。
+字符集默认是可打印 ASCII，-c 可以再加入一个 UTF-8 文本文件里出现的所有字符（比如直接用 gui.conf）。
+用法：mkatlas -f font.ttf -o out.atlas -s 16,24,32 [-c chars.txt] [-m] [-r /板子上/font.ttf]
+    -m  生成单色位图（默认 8 位灰度）
+    -r  图集里缺的字符回退到 FreeType 时使用的字体路径（默认与 -f 相同）
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <font_manager.h>
+#include <font_atlas.h>
+
+#define MAX_SIZES 32
+#define ALIGN_UP(x) (((x) + FONTATLAS_ALIGN - 1) & ~(FONTATLAS_ALIGN - 1))
+
+static unsigned int *g_pi_codes;
+static int g_i_ncodes;
+static int g_i_maxcodes;
+
+static void add_code(unsigned int code)
+{
+    if(g_i_ncodes == g_i_maxcodes)
+    {
+        g_i_maxcodes = g_i_maxcodes ? g_i_maxcodes * 2 : 256;
+        g_pi_codes = realloc(g_pi_codes, g_i_maxcodes * sizeof(unsigned int));
+        if(!g_pi_codes)
+        {
+            printf("out of memory\n");
+            exit(1);
+        }
+    }
+    g_pi_codes[g_i_ncodes++] = code;
+}
+
+/*
+把 UTF-8 文件中出现的字符加入字符集，非法字节跳过
+*/
+static int add_codes_from_file(char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    int c, n, i;
+    unsigned int code;
+
+    if(!fp)
+    {
+        printf("can not open file %s\n", path);
+        return -1;
+    }
+    while((c = fgetc(fp)) != EOF)
+    {
+        if(c < 0x80)
+        {
+            if(c >= 0x20)
+                add_code(c);
+            continue;
+        }
+        if((c & 0xE0) == 0xC0)      { code = c & 0x1F; n = 1; }
+        else if((c & 0xF0) == 0xE0) { code = c & 0x0F; n = 2; }
+        else if((c & 0xF8) == 0xF0) { code = c & 0x07; n = 3; }
+        else continue;
+        for(i = 0; i < n; i++)
+        {
+            c = fgetc(fp);
+            if(c == EOF || (c & 0xC0) != 0x80)
+                break;
+            code = (code << 6) | (c & 0x3F);
+        }
+        if(i == n)
+            add_code(code);
+    }
+    fclose(fp);
+    return 0;
+}
+
+static int cmp_uint(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+    return (x > y) - (x < y);
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+int main(int argc, char **argv)
+{
+    char *fontfile = NULL, *outfile = NULL, *charfile = NULL, *runtimepath = NULL;
+    int sizes[MAX_SIZES];
+    int nsizes = 0;
+    int mono = 0;
+    int opt, i, j, s, n;
+    char *p;
+    FT_Library library;
+    FT_Face face;
+    FT_GlyphSlot slot;
+    fontatlas_header t_header;
+    fontatlas_units *pt_units;
+    fontatlas_glyph *pt_glyphs;
+    unsigned char *puc_bitmaps = NULL;
+    unsigned long bitmaps_size = 0, bitmaps_max = 0, bytes;
+    unsigned int offset;
+    FILE *fp;
+    static const unsigned char zero[FONTATLAS_ALIGN];
+
+    while((opt = getopt(argc, argv, "f:o:s:c:r:m")) != -1)
+    {
+        switch (opt)
+        {
+            case 'f': fontfile = optarg; break;
+            case 'o': outfile = optarg; break;
+            case 'c': charfile = optarg; break;
+            case 'r': runtimepath = optarg; break;
+            case 'm': mono = 1; break;
+            case 's':
+                for(p = strtok(optarg, ","); p && nsizes < MAX_SIZES; p = strtok(NULL, ","))
+                    if(atoi(p) > 0)
+                        sizes[nsizes++] = atoi(p);
+                break;
+            default:
+                printf("Usage: %s -f font.ttf -o out.atlas -s 16,24,32 [-c chars.txt] [-m] [-r runtime_font_path]\n", argv[0]);
+                return -1;
+        }
+    }
+    if(!fontfile || !outfile || nsizes == 0)
+    {
+        printf("Usage: %s -f font.ttf -o out.atlas -s 16,24,32 [-c chars.txt] [-m] [-r runtime_font_path]\n", argv[0]);
+        return -1;
+    }
+    if(!runtimepath)
+        runtimepath = fontfile;
+
+    if(FT_Init_FreeType(&library) || FT_New_Face(library, fontfile, 0, &face))
+    {
+        printf("can not open font %s\n", fontfile);
+        return -1;
+    }
+    if(!FT_IS_SCALABLE(face))
+    {
+        printf("%s is not a scalable font\n", fontfile);
+        return -1;
+    }
+    slot = face->glyph;
+
+    //字符集：可打印 ASCII + 文件中的字符，排序去重，去掉字体里没有的
+    for(i = 0x20; i < 0x7F; i++)
+        add_code(i);
+    if(charfile && add_codes_from_file(charfile))
+        return -1;
+    qsort(g_pi_codes, g_i_ncodes, sizeof(unsigned int), cmp_uint);
+    for(i = 0, n = 0; i < g_i_ncodes; i++)
+    {
+        if(n && g_pi_codes[n - 1] == g_pi_codes[i])
+            continue;
+        if(FT_Get_Char_Index(face, g_pi_codes[i]) == 0)
+        {
+            printf("U+%04X not in font, skipped\n", g_pi_codes[i]);
+            continue;
+        }
+        g_pi_codes[n++] = g_pi_codes[i];
+    }
+    g_i_ncodes = n;
+    qsort(sizes, nsizes, sizeof(int), cmp_int);
+
+    pt_units = calloc(g_i_ncodes, sizeof(fontatlas_units));
+    pt_glyphs = calloc(nsizes * g_i_ncodes, sizeof(fontatlas_glyph));
+    if(!pt_units || !pt_glyphs)
+    {
+        printf("out of memory\n");
+        return -1;
+    }
+
+    //设计单位度量
+    for(i = 0; i < g_i_ncodes; i++)
+    {
+        if(FT_Load_Char(face, g_pi_codes[i], FT_LOAD_NO_SCALE))
+            continue;
+        pt_units[i].code    = g_pi_codes[i];
+        pt_units[i].x_min   = slot->metrics.horiBearingX;
+        pt_units[i].y_max   = slot->metrics.horiBearingY;
+        pt_units[i].width   = slot->metrics.width;
+        pt_units[i].height  = slot->metrics.height;
+        pt_units[i].advance = slot->advance.x;
+    }
+
+    //逐个字号渲染
+    for(s = 0; s < nsizes; s++)
+    {
+        FT_Set_Pixel_Sizes(face, sizes[s], 0);
+        for(i = 0; i < g_i_ncodes; i++)
+        {
+            fontatlas_glyph *pt_glyph = &pt_glyphs[s * g_i_ncodes + i];
+
+            if(FT_Load_Char(face, g_pi_codes[i], FT_LOAD_RENDER | (mono ? FT_LOAD_TARGET_MONO : 0)))
+            {
+                printf("U+%04X size %d render failed\n", g_pi_codes[i], sizes[s]);
+                continue;
+            }
+            pt_glyph->left    = slot->bitmap_left;
+            pt_glyph->top     = -slot->bitmap_top;
+            pt_glyph->width   = slot->bitmap.width;
+            pt_glyph->height  = slot->bitmap.rows;
+            pt_glyph->pitch   = slot->bitmap.pitch > 0 ? slot->bitmap.pitch : 0;
+            pt_glyph->advance = slot->advance.x >> 6;
+
+            bytes = (unsigned long)pt_glyph->pitch * pt_glyph->height;
+            if(bitmaps_size + ALIGN_UP(bytes) > bitmaps_max)
+            {
+                bitmaps_max = (bitmaps_max + ALIGN_UP(bytes)) * 2;
+                puc_bitmaps = realloc(puc_bitmaps, bitmaps_max);
+                if(!puc_bitmaps)
+                {
+                    printf("out of memory\n");
+                    return -1;
+                }
+            }
+            pt_glyph->bitmap_offset = bitmaps_size;
+            for(j = 0; j < pt_glyph->height; j++)
+                memcpy(puc_bitmaps + bitmaps_size + j * pt_glyph->pitch,
+                       slot->bitmap.buffer + j * slot->bitmap.pitch, pt_glyph->pitch);
+            memset(puc_bitmaps + bitmaps_size + bytes, 0, ALIGN_UP(bytes) - bytes);
+            bitmaps_size += ALIGN_UP(bytes);
+        }
+    }
+
+    //计算各段偏移
+    memset(&t_header, 0, sizeof(t_header));
+    t_header.magic        = FONTATLAS_MAGIC;
+    t_header.version      = FONTATLAS_VERSION;
+    t_header.nsizes       = nsizes;
+    t_header.ncodes       = g_i_ncodes;
+    t_header.pixelmode    = mono ? FONT_PIXEL_MODE_MONO : FONT_PIXEL_MODE_GRAY;
+    t_header.units_per_em = face->units_per_EM;
+    offset = ALIGN_UP(sizeof(t_header));
+    t_header.sizes_offset = offset;
+    offset = ALIGN_UP(offset + nsizes * sizeof(int));
+    t_header.units_offset = offset;
+    offset = ALIGN_UP(offset + g_i_ncodes * sizeof(fontatlas_units));
+    t_header.glyphs_offset = offset;
+    offset = ALIGN_UP(offset + nsizes * g_i_ncodes * sizeof(fontatlas_glyph));
+    t_header.fontpath_offset = offset;
+    offset = ALIGN_UP(offset + strlen(runtimepath) + 1);
+    t_header.bitmaps_offset = offset;
+    t_header.file_size = offset + bitmaps_size;
+
+    fp = fopen(outfile, "wb");
+    if(!fp)
+    {
+        printf("can not open file %s\n", outfile);
+        return -1;
+    }
+#define WRITE_ALIGNED(ptr, len) do { \
+        fwrite((ptr), 1, (len), fp); \
+        fwrite(zero, 1, ALIGN_UP(len) - (len), fp); \
+    } while(0)
+    WRITE_ALIGNED(&t_header, sizeof(t_header));
+    WRITE_ALIGNED(sizes, nsizes * sizeof(int));
+    WRITE_ALIGNED(pt_units, g_i_ncodes * sizeof(fontatlas_units));
+    WRITE_ALIGNED(pt_glyphs, nsizes * g_i_ncodes * sizeof(fontatlas_glyph));
+    WRITE_ALIGNED(runtimepath, strlen(runtimepath) + 1);
+    fwrite(puc_bitmaps, 1, bitmaps_size, fp);
+    if(fclose(fp))
+    {
+        printf("write %s failed\n", outfile);
+        return -1;
+    }
+
+    printf("%s: %d chars x %d sizes, %u bytes (%lu bytes of bitmaps)\n",
+           outfile, g_i_ncodes, nsizes, t_header.file_size, bitmaps_size);
+    return 0;
+}
@@ -32,6 +32,8 @@
 
 static  int default_on_draw(struct button *pt_button,pdispbuff pt_dispbuff)//绘制按钮的函数
 {
+    //先记录到显示列表，displist_end 时底色和文字按条带一起回放、只刷新一次
+    displist_begin();
     //绘制底色（红色）
     draw_region(&pt_button->t_region, BUTTON_DEFAULT_COLOR);
     //居中显示文字
@@ -39,6 +41,7 @@ static  int default_on_draw(struct button *pt_button,pdispbuff pt_dispbuff)//绘
     drawtext_inregioncentral(pt_button->name,&pt_button->t_region,BUTTON_TEXT_COLOR);
     //刷新到硬件上
     flushdisplayregion(&pt_button->t_region, pt_dispbuff);
+    displist_end();
     return 0; //假设默认实现返回 0 表示成功
 
 }
@@ -55,6 +58,7 @@ static int default_on_pressed(struct button *pt_button,pdispbuff pt_dispbuff,p_i
     if(pt_button->status)
         dwcolor = BUTTON_PRESSED_COLOR; // 按钮被按下时颜色变为绿色
 
+    displist_begin();
     // 绘制底色
     draw_region(&pt_button->t_region, dwcolor);
     //居中显示文字
@@ -62,6 +66,7 @@ static int default_on_pressed(struct button *pt_button,pdispbuff pt_dispbuff,p_i
     drawtext_inregioncentral(pt_button->name,&pt_button->t_region,BUTTON_TEXT_COLOR);
     //刷新到硬件上
     flushdisplayregion(&pt_button->t_region, pt_dispbuff);
+    displist_end();
     return 0; //假设默认实现返回 0 表示成功
 }
 
@@ -0,0 +1,119 @@
+#include <sys/time.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <disp_manager.h>
+
+#define BENCH_XRES 1024
+#define BENCH_YRES 600
+#define BENCH_BUTTONS 30
+#define BENCH_LOOPS 50
+
+static dispbuff g_tbuff;
+
+/*
+旧的绘制路径：与原来 draw_region 一样，每个像素调用一次 putpixel
+*/
+static void legacy_putpixel(int x, int y, unsigned int dwcolor)
+{
+    int line_width = g_tbuff.ixres * g_tbuff.ibpp / 8;
+    int pixel_width = g_tbuff.ibpp / 8;
+    unsigned char *pen_8 = (unsigned char *)g_tbuff.buff + y * line_width + x * pixel_width;
+    unsigned int red,green,blue;
+
+    switch (g_tbuff.ibpp)
+    {
+        case 8:
+            *pen_8 = dwcolor;
+            break;
+        case 16:
+            red = (dwcolor >> 16) & 0xFF;
+            green = (dwcolor >> 8) & 0xFF;
+            blue = (dwcolor >> 0) & 0xFF;
+            *(unsigned short *)pen_8 = ((red >> 3) << 11) | ((green >> 2) << 5) | (blue >> 3);
+            break;
+        case 32:
+            *(unsigned int *)pen_8 = dwcolor;
+            break;
+    }
+}
+
+static void legacy_draw_region(p_region pt_region, unsigned int dwcolor)
+{
+    int i, j;
+    for (j = pt_region->y; j < pt_region->y + pt_region->height; j++)
+        for (i = pt_region->x; i < pt_region->x + pt_region->width; i++)
+            legacy_putpixel(i, j, dwcolor);
+}
+
+static long long now_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+/*
+按 main_page 的布局生成 30 个按钮，分别用旧路径和填充引擎重绘整屏若干次
+*/
+static void bench_bpp(int ibpp)
+{
+    region at_regions[BENCH_BUTTONS];
+    int n_per_line = 6;
+    int width = BENCH_XRES / n_per_line;
+    int height = BENCH_YRES / (BENCH_BUTTONS / n_per_line);
+    long long t0, t1, t2;
+    int i, loop;
+    p_pixelopr pt_pixopr;
+    region t_clipped;
+    unsigned int color;
+
+    g_tbuff.ixres = BENCH_XRES;
+    g_tbuff.iyres = BENCH_YRES;
+    g_tbuff.ibpp  = ibpp;
+    g_tbuff.buff  = malloc(BENCH_XRES * BENCH_YRES * ibpp / 8);
+    //和 initdefaultdisplay 一样，操作表只选一次
+    pt_pixopr = getpixelopr(&g_tbuff);
+    if(!pt_pixopr)
+    {
+        free(g_tbuff.buff);
+        return;
+    }
+
+    for(i = 0; i < BENCH_BUTTONS; i++)
+    {
+        at_regions[i].x = (i % n_per_line) * width;
+        at_regions[i].y = (i / n_per_line) * height;
+        at_regions[i].width = width - 5;
+        at_regions[i].height = height - 5;
+    }
+
+    t0 = now_us();
+    for(loop = 0; loop < BENCH_LOOPS; loop++)
+        for(i = 0; i < BENCH_BUTTONS; i++)
+            legacy_draw_region(&at_regions[i], loop & 1 ? 0xFF0000 : 0x00FF00);
+    t1 = now_us();
+    for(loop = 0; loop < BENCH_LOOPS; loop++)
+        for(i = 0; i < BENCH_BUTTONS; i++)
+        {
+            //与 draw_region 相同：裁剪一次、颜色转换一次，再按整行填充
+            color = pt_pixopr->mapcolor(loop & 1 ? 0xFF0000 : 0x00FF00);
+            if(clip_region(&g_tbuff, &at_regions[i], NULL, &t_clipped))
+                pt_pixopr->fillrect(&g_tbuff, &t_clipped, color);
+        }
+    t2 = now_us();
+
+    printf("%2d bpp: putpixel %8.1f us/screen, fillrect %8.1f us/screen, x%.1f\n", ibpp,
+           (double)(t1 - t0) / BENCH_LOOPS, (double)(t2 - t1) / BENCH_LOOPS,
+           (double)(t1 - t0) / (t2 - t1 ? t2 - t1 : 1));
+    free(g_tbuff.buff);
+}
+
+int main(int argc,char **argv)
+{
+    bench_bpp(8);
+    bench_bpp(16);
+    bench_bpp(32);
+    return 0;
+}
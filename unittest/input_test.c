@@ -13,7 +13,11 @@ int main(int argc,char **argv)
 {
     int ret;
     inputevent event;
-    input_init();
+    touchscreenstat t_stat;
+    //可选参数：触摸屏后端（tslib 或 evdev），每 100 个触摸样本打印一次每个样本的处理开销，用来比较两个后端
+    if(settouchscreen(argc > 1 ? argv[1] : NULL, NULL))
+        return -1;
+    input_system_register();
     input_deviceinit();
     while(1)
     {
@@ -31,12 +35,18 @@ int main(int argc,char **argv)
                 printf("x         :%d\n",event.i_x);
                 printf("y         :%d\n",event.i_y);
                 printf("pressure  :%d\n",event.i_pressure);
+                gettouchscreenstat(&t_stat);
+                if(t_stat.samples % 100 == 0)
+                    printf("%s: %llu samples, %llu reads, %llu ns/sample, max %llu ns, latency %llu us/sample, drops %llu\n",
+                           t_stat.backend, t_stat.samples, t_stat.reads, t_stat.cost_ns / t_stat.samples,
+                           t_stat.max_cost_ns, t_stat.latency_us / t_stat.samples, t_stat.drops);
             }
             else if(event.i_type == INPUT_TYPE_NET)
             {
                 printf("tyep  :%d\n",event.i_type);
-                printf("str   :%d\n",event.str);
-            }           
+                printf("str   :%s\n",event.pt_payload ? event.pt_payload->ac_data : "");
+            }
+            inputevent_release(&event);
         } 
     }
     return 0;
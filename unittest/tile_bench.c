@@ -0,0 +1,143 @@
+#include <sys/time.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <disp_manager.h>
+#include <font_manager.h>
+
+#define BENCH_XRES 1024
+#define BENCH_YRES 600
+#define BENCH_BUTTONS 30
+#define BENCH_LOOPS 50
+
+static region g_at_regions[BENCH_BUTTONS];
+
+static long long now_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+/*
+从按钮左边开始逐个绘制字符（与 drawtext_inregioncentral 一样每个字形一条命令）
+*/
+static void draw_label(char *str, p_region pt_region)
+{
+    fontbitmap t_fontbitmap;
+    int i;
+
+    t_fontbitmap.i_cur_originx = pt_region->x + 8;
+    t_fontbitmap.i_cur_originy = pt_region->y + pt_region->height * 2 / 3;
+    for(i = 0; str[i]; i++)
+    {
+        if(getfontbitmap(str[i], &t_fontbitmap))
+            return;
+        drawfontbitmap(&t_fontbitmap, 0x000000);
+        t_fontbitmap.i_cur_originx = t_fontbitmap.i_next_originx;
+        t_fontbitmap.i_cur_originy = t_fontbitmap.i_next_originy;
+    }
+}
+
+/*
+按 main_page 的布局重绘整页：背景 + 30 个按钮（底色 + 文字）
+*/
+static void draw_grid(int loop)
+{
+    region t_full = {0, 0, BENCH_XRES, BENCH_YRES};
+    char name[32];
+    int i;
+
+    displist_begin();
+    draw_region(&t_full, 0x202020);
+    for(i = 0; i < BENCH_BUTTONS; i++)
+    {
+        draw_region(&g_at_regions[i], (loop + i) & 1 ? 0xFF0000 : 0x00FF00);
+        snprintf(name, sizeof(name), "button%02d", i);
+        draw_label(name, &g_at_regions[i]);
+    }
+    flushdisplayregion(&t_full, getdisplaybuffer());
+    displist_end();
+}
+
+/*
+用不同的线程数重绘整页，比较回放耗时；第一次的结果作为参考画面，检查并行回放的结果一致
+*/
+static void bench_bpp(int ibpp, int imaxthreads)
+{
+    pdispbuff pt_dispbuff = getdisplaybuffer();
+    int size = BENCH_XRES * BENCH_YRES * ibpp / 8;
+    unsigned char *puc_ref = malloc(size);
+    long long t0, t_replay, t_single = 0;
+    displiststat t_stat;
+    int ithreads, loop;
+
+    for(ithreads = 1; ithreads <= imaxthreads; ithreads *= 2)
+    {
+        tilerender_setthreads(ithreads);
+        draw_grid(0);//预热：创建线程、填满字形缓存
+        if(ithreads == 1)
+            memcpy(puc_ref, pt_dispbuff->buff, size);
+        else if(memcmp(puc_ref, pt_dispbuff->buff, size))
+            printf("%d threads: output differs from single thread!\n", ithreads);
+
+        t_replay = 0;
+        t0 = now_us();
+        for(loop = 0; loop < BENCH_LOOPS; loop++)
+        {
+            draw_grid(loop);
+            getdispliststat(&t_stat);
+            t_replay += t_stat.replay_us_lastframe;
+        }
+        t0 = now_us() - t0;
+        if(ithreads == 1)
+            t_single = t_replay;
+        printf("%2d bpp, %d threads (used %u): replay %8.1f us/screen, frame %8.1f us/screen, x%.2f\n",
+               ibpp, ithreads, t_stat.threads_lastframe,
+               (double)t_replay / BENCH_LOOPS, (double)t0 / BENCH_LOOPS,
+               (double)t_single / (t_replay ? t_replay : 1));
+    }
+    free(puc_ref);
+}
+
+int main(int argc,char **argv)
+{
+    int n_per_line = 6;
+    int width = BENCH_XRES / n_per_line;
+    int height = BENCH_YRES / (BENCH_BUTTONS / n_per_line);
+    int ibpp = 32;
+    int i;
+
+    if(argc < 2)
+    {
+        printf("Usage: %s <font_file> [bpp]\n", argv[0]);
+        return -1;
+    }
+    if(argc > 2)
+        ibpp = strtol(argv[2], NULL, 0);
+
+    for(i = 0; i < BENCH_BUTTONS; i++)
+    {
+        g_at_regions[i].x = (i % n_per_line) * width;
+        g_at_regions[i].y = (i / n_per_line) * height;
+        g_at_regions[i].width = width - 5;
+        g_at_regions[i].height = height - 5;
+    }
+
+    //在无头显示设备上测试，不需要 /dev/fb0
+    display_system_register();
+    memdisplay_setmode(BENCH_XRES, BENCH_YRES, ibpp);
+    selectdefaultdisplay("mem");
+    initdefaultdisplay();
+
+    font_system_register();
+    if(selectandinitfont("freetype", argv[1]))
+        return -1;
+    settextmode(TEXT_MODE_BLEND);
+    setfontsize(24);
+
+    printf("%d cpus online\n", tilerender_getthreads());
+    bench_bpp(ibpp, 8);
+    return 0;
+}